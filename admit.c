@@ -0,0 +1,244 @@
+/* Admission control for background jobs
+ *
+ * The queue holds job numbers in arrival order.  It is only ever a
+ * handful of entries long in practice, so it is a plain array that is
+ * shifted down on removal.
+ **********************************************************************/
+#include <sys/types.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "admit.h"
+#include "jobs.h"
+#include "loop.h"
+
+static AdmitFn start_job = NULL;
+
+static int* queue = NULL;
+static unsigned int nqueued = 0;
+static unsigned int queue_size = 0;
+
+static unsigned int max_jobs = 0;       /* 0: no cap */
+static unsigned int per_cpu = 0;        /* 0: no cap */
+static double max_cpu_pressure = 0;     /* 0: ignore */
+static double max_mem_pressure = 0;     /* 0: ignore */
+
+static int timer_fd = -1;
+static int timer_armed = 0;
+
+
+/* "some avg10" of /proc/pressure/<what>, or -1 if unavailable */
+static double pressure (const char* what)
+{
+    char path[64];
+    double avg10 = -1;
+    FILE* fp;
+
+    snprintf (path, sizeof(path), "/proc/pressure/%s", what);
+
+    if ((fp = fopen (path, "r"))) {
+        if (fscanf (fp, "some avg10=%lf", &avg10) != 1)
+            avg10 = -1;
+        fclose (fp);
+    }
+
+    return avg10;
+}
+
+
+static unsigned int running ()
+{
+    unsigned int k, n = 0;
+
+    for (k=0; k<njobs; k++)
+        if (J[k].name && J[k].status == BG)
+            n++;
+
+    return n;
+}
+
+
+static unsigned int cap ()
+{
+    unsigned int c = 0;
+
+    if (per_cpu)
+        c = per_cpu * sysconf (_SC_NPROCESSORS_ONLN);
+
+    if (max_jobs && (!c || max_jobs < c))
+        c = max_jobs;
+
+    return c;
+}
+
+
+static int pressure_ok ()
+{
+    if (max_cpu_pressure && pressure ("cpu") > max_cpu_pressure)
+        return 0;
+
+    if (max_mem_pressure && pressure ("memory") > max_mem_pressure)
+        return 0;
+
+    return 1;
+}
+
+
+static void arm (int on)
+{
+    struct itimerspec its;
+
+    if (on == timer_armed)
+        return;
+
+    memset (&its, 0, sizeof(its));
+    if (on) {
+        its.it_value.tv_sec = ADMIT_RECHECK;
+        its.it_interval.tv_sec = ADMIT_RECHECK;
+    }
+    timerfd_settime (timer_fd, 0, &its, NULL);
+    timer_armed = on;
+}
+
+
+static void on_timer (int fd, unsigned int events, void* data)
+{
+    unsigned long expirations;
+
+    if (read (fd, &expirations, sizeof(expirations)) > 0)
+        admit_pump ();
+}
+
+
+/* start is called to launch a job as it leaves the queue */
+void admit_init (AdmitFn start)
+{
+    start_job = start;
+    nqueued = 0;                /* again in a subshell: the queue is not ours */
+    timer_armed = 0;
+
+    timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd == -1) {
+        perror("timerfd_create() failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    loop_add (timer_fd, EPOLLIN, on_timer, NULL);
+}
+
+
+/* may another background job start right now? */
+int admit_ok ()
+{
+    unsigned int c = cap ();
+
+    if (c && running () >= c)
+        return 0;
+
+    return pressure_ok ();
+}
+
+
+void admit_enqueue (int k)
+{
+    if (nqueued == queue_size) {
+        queue_size = queue_size ? 2*queue_size : 16;
+        queue = realloc (queue, queue_size * sizeof(*queue));
+    }
+
+    queue[nqueued++] = k;
+    J[k].status = QUEUED;
+
+    if (max_cpu_pressure || max_mem_pressure)
+        arm (1);
+}
+
+
+void admit_remove (int k)
+{
+    unsigned int i;
+
+    for (i=0; i<nqueued; i++) {
+        if (queue[i] == k) {
+            memmove (&queue[i], &queue[i+1], (nqueued-i-1) * sizeof(*queue));
+            nqueued--;
+            break;
+        }
+    }
+
+    if (!nqueued)
+        arm (0);
+}
+
+
+/* 1-based place of job k in the queue (0: not queued) */
+unsigned int admit_position (int k)
+{
+    unsigned int i;
+
+    for (i=0; i<nqueued; i++)
+        if (queue[i] == k)
+            return i+1;
+
+    return 0;
+}
+
+
+unsigned int admit_queued ()
+{
+    return nqueued;
+}
+
+
+/* starts queued jobs, oldest first, for as long as there is room */
+void admit_pump ()
+{
+    int k;
+
+    while (nqueued && admit_ok ()) {
+        k = queue[0];
+        admit_remove (k);
+        start_job (k);
+    }
+}
+
+
+void admit_set_max (unsigned int n)
+{
+    max_jobs = n;
+    admit_pump ();
+}
+
+
+void admit_set_per_cpu (unsigned int n)
+{
+    per_cpu = n;
+    admit_pump ();
+}
+
+
+void admit_set_pressure (double cpu, double mem)
+{
+    max_cpu_pressure = cpu;
+    max_mem_pressure = mem;
+    arm (nqueued && (cpu || mem));
+    admit_pump ();
+}
+
+
+void admit_print ()
+{
+    unsigned int c = cap ();
+
+    printf("max jobs:        %u\n", max_jobs);
+    printf("per cpu:         %u\n", per_cpu);
+    printf("cap:             %u%s\n", c, c ? "" : " (none)");
+    printf("cpu pressure:    %.2f (now %.2f)\n", max_cpu_pressure, pressure ("cpu"));
+    printf("memory pressure: %.2f (now %.2f)\n", max_mem_pressure, pressure ("memory"));
+    printf("running:         %u\n", running ());
+    printf("queued:          %u\n", nqueued);
+}
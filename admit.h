@@ -0,0 +1,30 @@
+#ifndef _admit_h_
+#define _admit_h_
+
+/* Admission control for background jobs
+ *
+ * A background pipeline is only started right away if the number of
+ * running background jobs is under the configured cap and the CPU and
+ * memory pressure (PSI "some avg10" from /proc/pressure) are under
+ * their thresholds.  Otherwise its job is parked in the QUEUED state
+ * and started, first in first out, once a slot frees up: when a job
+ * finishes, or on a periodic re-check while pressure is what's holding
+ * the queue back.  Every limit is off (0) by default. */
+
+#define ADMIT_RECHECK 1      /* seconds between pressure re-checks */
+
+typedef void (*AdmitFn) (int k);
+
+void admit_init (AdmitFn start);
+int admit_ok ();
+void admit_enqueue (int k);
+void admit_remove (int k);
+unsigned int admit_position (int k);
+unsigned int admit_queued ();
+void admit_pump ();
+void admit_set_max (unsigned int n);
+void admit_set_per_cpu (unsigned int n);
+void admit_set_pressure (double cpu, double mem);
+void admit_print ();
+
+#endif /* _admit_h_ */
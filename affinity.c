@@ -0,0 +1,339 @@
+/* CPU placement of pipeline stages
+ *
+ * The topology is read from sysfs the first time auto placement needs
+ * it.  Every online CPU gets a sort key of (NUMA node, last level cache
+ * domain, L2 domain, cpu number), where a cache domain is named after
+ * the lowest CPU in its shared_cpu_list.  Walking the sorted list
+ * therefore visits L2 siblings back to back and never leaves an LLC
+ * domain (or a node) before it is exhausted.
+ **********************************************************************/
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+
+#include "affinity.h"
+
+#define SYS_CPU  "/sys/devices/system/cpu"
+#define SYS_NODE "/sys/devices/system/node"
+
+typedef struct {
+    int cpu;
+    int node;
+    int llc;     /* lowest cpu sharing the last level cache */
+    int l2;      /* lowest cpu sharing the L2 */
+} CpuInfo;
+
+static CpuInfo* cpus = NULL;    /* sorted for placement */
+static int ncpus = -1;          /* -1: topology not read yet */
+
+static int auto_mode = 0;
+static cpu_set_t default_set;
+static char* default_list = NULL;
+
+static int pipeline_start = 0;  /* index into cpus of stage 0 */
+static int next_domain = 0;     /* first cpu index of the next LLC domain */
+
+
+/* parses a kernel style cpu list ("0-3,8,10-11") into set */
+int affinity_parse (const char* list, cpu_set_t* set)
+{
+    const char* s = list;
+    char* end;
+    long lo, hi;
+
+    CPU_ZERO (set);
+
+    if (!*s)
+        return -1;
+
+    while (*s) {
+        lo = hi = strtol (s, &end, 10);
+        if (end == s || lo < 0)
+            return -1;
+
+        if (*end == '-') {
+            s = end + 1;
+            hi = strtol (s, &end, 10);
+            if (end == s || hi < lo)
+                return -1;
+        }
+
+        if (hi >= CPU_SETSIZE)
+            return -1;
+
+        for (; lo <= hi; lo++)
+            CPU_SET (lo, set);
+
+        if (*end == ',')
+            end++;
+        else if (*end && *end != '\n')
+            return -1;
+        else if (*end)
+            break;
+
+        s = end;
+    }
+
+    return 0;
+}
+
+
+/* lowest cpu listed in a sysfs cpu list file, or -1 */
+static int first_cpu (const char* path)
+{
+    char buf[1024];
+    cpu_set_t set;
+    FILE* fp;
+    int c;
+
+    if (!(fp = fopen (path, "r")))
+        return -1;
+
+    if (!fgets (buf, sizeof(buf), fp) || affinity_parse (buf, &set) == -1) {
+        fclose (fp);
+        return -1;
+    }
+    fclose (fp);
+
+    for (c=0; c<CPU_SETSIZE; c++)
+        if (CPU_ISSET (c, &set))
+            return c;
+
+    return -1;
+}
+
+
+static void cache_domains (CpuInfo* ci)
+{
+    char path[128];
+    int idx, level, best = 0, id;
+    FILE* fp;
+
+    ci->llc = ci->l2 = ci->cpu;
+
+    for (idx=0; ; idx++) {
+        snprintf (path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/level",
+                  ci->cpu, idx);
+        if (!(fp = fopen (path, "r")))
+            break;
+        if (fscanf (fp, "%d", &level) != 1)
+            level = 0;
+        fclose (fp);
+
+        snprintf (path, sizeof(path),
+                  SYS_CPU "/cpu%d/cache/index%d/shared_cpu_list", ci->cpu, idx);
+        if ((id = first_cpu (path)) == -1)
+            continue;
+
+        if (level == 2)
+            ci->l2 = id;
+        if (level >= best) {
+            best = level;
+            ci->llc = id;
+        }
+    }
+}
+
+
+static void numa_nodes ()
+{
+    char path[320];
+    cpu_set_t set;
+    char buf[1024];
+    struct dirent* d;
+    DIR* dir;
+    FILE* fp;
+    int node, i;
+
+    if (!(dir = opendir (SYS_NODE)))
+        return;
+
+    while ((d = readdir (dir))) {
+        if (sscanf (d->d_name, "node%d", &node) != 1)
+            continue;
+
+        snprintf (path, sizeof(path), SYS_NODE "/%s/cpulist", d->d_name);
+        if (!(fp = fopen (path, "r")))
+            continue;
+        if (fgets (buf, sizeof(buf), fp) && affinity_parse (buf, &set) == 0)
+            for (i=0; i<ncpus; i++)
+                if (CPU_ISSET (cpus[i].cpu, &set))
+                    cpus[i].node = node;
+        fclose (fp);
+    }
+
+    closedir (dir);
+}
+
+
+static int cmp_cpu (const void* a, const void* b)
+{
+    const CpuInfo* x = a;
+    const CpuInfo* y = b;
+
+    if (x->node != y->node)
+        return x->node - y->node;
+    if (x->llc != y->llc)
+        return x->llc - y->llc;
+    if (x->l2 != y->l2)
+        return x->l2 - y->l2;
+    return x->cpu - y->cpu;
+}
+
+
+static void topology_load ()
+{
+    cpu_set_t online;
+    char buf[1024];
+    FILE* fp;
+    int c;
+
+    if (ncpus != -1)
+        return;
+
+    /* only what we're allowed to run on: not every online cpu */
+    if (sched_getaffinity (0, sizeof(online), &online) == -1) {
+        CPU_ZERO (&online);
+        if ((fp = fopen (SYS_CPU "/online", "r"))) {
+            if (fgets (buf, sizeof(buf), fp))
+                affinity_parse (buf, &online);
+            fclose (fp);
+        }
+    }
+
+    cpus = malloc (CPU_COUNT (&online) * sizeof(*cpus) + 1);
+    ncpus = 0;
+
+    for (c=0; c<CPU_SETSIZE; c++) {
+        if (!CPU_ISSET (c, &online))
+            continue;
+        cpus[ncpus].cpu = c;
+        cpus[ncpus].node = 0;
+        cache_domains (&cpus[ncpus]);
+        ncpus++;
+    }
+
+    numa_nodes ();
+    qsort (cpus, ncpus, sizeof(*cpus), cmp_cpu);
+}
+
+
+/* Picks where the next pipeline goes in auto mode: every pipeline
+ * starts at the beginning of the LLC domain after the previous one's,
+ * so successive pipelines rotate through the domains. */
+void affinity_begin_pipeline (unsigned int nstages)
+{
+    int i;
+
+    if (!auto_mode)
+        return;
+
+    topology_load ();
+    if (!ncpus)
+        return;
+
+    pipeline_start = next_domain % ncpus;
+
+    /* the domain after the one this pipeline starts in */
+    for (i=pipeline_start; i<ncpus && cpus[i].llc == cpus[pipeline_start].llc &&
+                           cpus[i].node == cpus[pipeline_start].node; i++);
+    next_domain = i % ncpus;
+}
+
+
+/* Fills set with the CPUs stage may run on, given its `@cpus=` list
+ * (or NULL).  Returns 0 if the stage should just inherit ours. */
+int affinity_stage (unsigned int stage, const char* list, cpu_set_t* set)
+{
+    if (list) {
+        if (affinity_parse (list, set) == 0)
+            return 1;
+        printf("pssh: @cpus=%s: invalid cpu list\n", list);
+        return 0;
+    }
+
+    if (default_list) {
+        *set = default_set;
+        return 1;
+    }
+
+    if (auto_mode && ncpus > 0) {
+        CPU_ZERO (set);
+        CPU_SET (cpus[(pipeline_start + stage) % ncpus].cpu, set);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/* moves every thread of pid onto set */
+int affinity_pin_pid (pid_t pid, cpu_set_t* set)
+{
+    char path[64];
+    struct dirent* d;
+    DIR* dir;
+    int ret = 0;
+
+    snprintf (path, sizeof(path), "/proc/%d/task", pid);
+
+    if (!(dir = opendir (path)))
+        return sched_setaffinity (pid, sizeof(*set), set);
+
+    while ((d = readdir (dir)))
+        if (d->d_name[0] != '.' &&
+            sched_setaffinity (atoi (d->d_name), sizeof(*set), set) == -1)
+            ret = -1;
+
+    closedir (dir);
+
+    return ret;
+}
+
+
+/* NULL clears the default */
+int affinity_set_default (const char* list)
+{
+    cpu_set_t set;
+
+    if (list && affinity_parse (list, &set) == -1)
+        return -1;
+
+    free (default_list);
+    default_list = NULL;
+
+    if (list) {
+        default_set = set;
+        default_list = strdup (list);
+    }
+
+    return 0;
+}
+
+
+void affinity_set_auto (int on)
+{
+    auto_mode = on;
+}
+
+
+void affinity_print ()
+{
+    int i;
+
+    printf("default: %s\n", default_list ? default_list : "(inherit)");
+    printf("auto:    %s\n", auto_mode ? "on" : "off");
+
+    if (!auto_mode)
+        return;
+
+    topology_load ();
+
+    printf("placement order (cpu node/llc/l2):");
+    for (i=0; i<ncpus; i++)
+        printf(" %d(%d/%d/%d)", cpus[i].cpu, cpus[i].node, cpus[i].llc, cpus[i].l2);
+    printf("\n");
+}
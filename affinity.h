@@ -0,0 +1,28 @@
+#ifndef _affinity_h_
+#define _affinity_h_
+
+#include <sched.h>       /* cpu_set_t needs _GNU_SOURCE */
+
+/* CPU placement of pipeline stages
+ *
+ * A stage's CPU set comes from, in order of precedence:
+ *   - its own `@cpus=<list>` prefix (ex: `@cpus=0-3,8 sort`)
+ *   - the default set by `pin <list>`
+ *   - `pin auto`: the stages of a pipeline are laid out on neighbouring
+ *     CPUs of one last level cache domain, ordered so that adjacent
+ *     stages land on cores sharing an L2 where the topology allows
+ *     it, and successive pipelines rotate through the domains (see
+ *     /sys/devices/system/cpu/cpuN/cache and /sys/devices/system/node)
+ * and otherwise is inherited from the shell.
+ *
+ * `pin %<job> <list>` re-pins every thread of a running job. */
+
+void affinity_begin_pipeline (unsigned int nstages);
+int affinity_stage (unsigned int stage, const char* cpus, cpu_set_t* set);
+int affinity_parse (const char* list, cpu_set_t* set);
+int affinity_pin_pid (pid_t pid, cpu_set_t* set);
+int affinity_set_default (const char* list);
+void affinity_set_auto (int on);
+void affinity_print ();
+
+#endif /* _affinity_h_ */
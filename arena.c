@@ -0,0 +1,148 @@
+/* Bump allocator
+ *
+ * An arena is a list of chunks that are filled front to back.  When
+ * the current chunk can't satisfy a request the next (already
+ * allocated) chunk is tried, and only when the list is exhausted is a
+ * new chunk malloc()ed.  Resetting just rewinds to the first chunk, so
+ * after warming up an arena stops calling malloc() at all.
+ **********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+
+
+static ArenaChunk* chunk_new (size_t size)
+{
+    ArenaChunk* c = malloc (sizeof(*c) + size);
+
+    if (!c) {
+        perror("arena: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+
+    return c;
+}
+
+
+Arena* arena_new (size_t chunk)
+{
+    Arena* A = malloc (sizeof(*A));
+
+    A->chunk = chunk ? chunk : ARENA_CHUNK;
+    A->head = chunk_new (A->chunk);
+    A->cur = A->head;
+
+    return A;
+}
+
+
+void* arena_alloc (Arena* A, size_t size)
+{
+    ArenaChunk *c, *big;
+    void* p;
+
+    size = (size + ARENA_ALIGN-1) & ~(size_t)(ARENA_ALIGN-1);
+
+    for (c=A->cur; c->used + size > c->size; c=c->next) {
+        if (!c->next) {
+            c->next = chunk_new (size > A->chunk ? size : A->chunk);
+        }
+        else if (c->next->size < size) {
+            /* oversized request: splice in a chunk just for it */
+            big = chunk_new (size);
+            big->next = c->next;
+            c->next = big;
+        }
+        else {
+            c->next->used = 0;
+        }
+    }
+
+    A->cur = c;
+    p = c->data + c->used;
+    c->used += size;
+
+    return p;
+}
+
+
+char* arena_strndup (Arena* A, const char* s, size_t n)
+{
+    char* d = arena_alloc (A, n+1);
+
+    memcpy (d, s, n);
+    d[n] = '\0';
+
+    return d;
+}
+
+
+char* arena_strdup (Arena* A, const char* s)
+{
+    return arena_strndup (A, s, strlen (s));
+}
+
+
+/* releases everything allocated from A */
+void arena_reset (Arena* A)
+{
+#if ARENA_DEBUG
+    ArenaChunk* c;
+
+    for (c=A->head; c != A->cur->next; c=c->next)
+        memset (c->data, ARENA_POISON, c->used);
+#endif
+
+    A->cur = A->head;
+    A->head->used = 0;
+}
+
+
+ArenaMark arena_mark (Arena* A)
+{
+    ArenaMark m = { A->cur, A->cur->used };
+
+    return m;
+}
+
+
+/* releases everything allocated from A since m was taken, so a loop
+ * can allocate per iteration without growing the arena */
+void arena_release (Arena* A, ArenaMark m)
+{
+#if ARENA_DEBUG
+    ArenaChunk* c;
+
+    memset (m.cur->data + m.used, ARENA_POISON, m.cur->used - m.used);
+    for (c=m.cur->next; c != A->cur->next; c=c->next)
+        memset (c->data, ARENA_POISON, c->used);
+#endif
+
+    A->cur = m.cur;
+    A->cur->used = m.used;
+}
+
+
+void arena_destroy (Arena** A)
+{
+    ArenaChunk *c, *next;
+
+    if (!*A)
+        return;
+
+    for (c=(*A)->head; c; c=next) {
+        next = c->next;
+        free (c);
+    }
+
+    free (*A);
+    *A = NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef _arena_h_
+#define _arena_h_
+
+#include <stddef.h>
+
+/* Bump allocator for things that all die together (ex: everything the
+ * parser produces for one command line).  arena_reset() releases it
+ * all at once in O(1); the chunks are kept for the next user. */
+
+/***************************************************************
+ * Set to 1 to poison memory released by arena_reset() so that *
+ * anything still holding on to it fails loudly, ex:           *
+ *     make CFLAGS="-g -Wall -DARENA_DEBUG=1"                  *
+ ***************************************************************/
+#ifndef ARENA_DEBUG
+#define ARENA_DEBUG 0
+#endif
+
+#define ARENA_CHUNK  16384
+#define ARENA_POISON 0xa5
+
+typedef struct ArenaChunk {
+    struct ArenaChunk* next;
+    size_t size;
+    size_t used;
+    char data[];
+} ArenaChunk;
+
+typedef struct {
+    ArenaChunk* head;
+    ArenaChunk* cur;
+    size_t chunk;       /* size of newly allocated chunks */
+} Arena;
+
+/* where an Arena is at, to go back to later (see arena_release()) */
+typedef struct {
+    ArenaChunk* cur;
+    size_t used;
+} ArenaMark;
+
+Arena* arena_new (size_t chunk);
+void* arena_alloc (Arena* A, size_t size);
+char* arena_strdup (Arena* A, const char* s);
+char* arena_strndup (Arena* A, const char* s, size_t n);
+void arena_reset (Arena* A);
+ArenaMark arena_mark (Arena* A);
+void arena_release (Arena* A, ArenaMark m);
+void arena_destroy (Arena** A);
+
+#endif /* _arena_h_ */
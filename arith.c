@@ -0,0 +1,476 @@
+/* Shell arithmetic
+ *
+ * The compiler is a recursive descent parser, with one function per
+ * precedence level for everything but the left associative binary
+ * operators, which share a table.  The lexer always takes the longest
+ * operator at hand, so `<` never mistakes itself for half of `<<=`.
+ **********************************************************************/
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arith.h"
+#include "vars.h"
+
+typedef enum {
+    A_NUM, A_VAR,
+    A_NEG, A_NOT, A_BNOT,
+    A_PREINC, A_PREDEC, A_POSTINC, A_POSTDEC,
+    A_POW, A_MUL, A_DIV, A_MOD, A_ADD, A_SUB, A_SHL, A_SHR,
+    A_LT, A_LE, A_GT, A_GE, A_EQ, A_NE,
+    A_BAND, A_BXOR, A_BOR, A_AND, A_OR,
+    A_COND, A_ASSIGN, A_COMMA,
+} ArithOp;
+
+struct Arith {
+    ArithOp op;
+    ArithOp with;         /* A_ASSIGN: the operator of `op=` (A_ASSIGN: none) */
+    long num;             /* A_NUM */
+    char* name;           /* A_VAR, A_ASSIGN and the ++/-- */
+    Arith *a, *b, *c;
+};
+
+static const struct {
+    const char* s;
+    ArithOp op;
+    ArithOp with;         /* what `s` does as an assignment */
+} ops[] = {               /* longest first */
+    { "<<=", A_ASSIGN, A_SHL }, { ">>=", A_ASSIGN, A_SHR },
+    { "**", A_POW }, { "++", A_PREINC }, { "--", A_PREDEC },
+    { "<<", A_SHL }, { ">>", A_SHR }, { "<=", A_LE }, { ">=", A_GE },
+    { "==", A_EQ }, { "!=", A_NE }, { "&&", A_AND }, { "||", A_OR },
+    { "+=", A_ASSIGN, A_ADD }, { "-=", A_ASSIGN, A_SUB },
+    { "*=", A_ASSIGN, A_MUL }, { "/=", A_ASSIGN, A_DIV },
+    { "%=", A_ASSIGN, A_MOD }, { "&=", A_ASSIGN, A_BAND },
+    { "^=", A_ASSIGN, A_BXOR }, { "|=", A_ASSIGN, A_BOR },
+    { "+", A_ADD }, { "-", A_SUB }, { "*", A_MUL }, { "/", A_DIV },
+    { "%", A_MOD }, { "<", A_LT }, { ">", A_GT }, { "&", A_BAND },
+    { "^", A_BXOR }, { "|", A_BOR }, { "!", A_NOT }, { "~", A_BNOT },
+    { "?", A_COND }, { "=", A_ASSIGN, A_ASSIGN }, { ",", A_COMMA },
+};
+
+#define NOPS (sizeof(ops)/sizeof(*ops))
+#define OP_NONE (-1)
+
+/* the left associative binary operators, loosest first */
+static const ArithOp levels[][4] = {
+    { A_OR }, { A_AND }, { A_BOR }, { A_BXOR }, { A_BAND },
+    { A_EQ, A_NE }, { A_LT, A_LE, A_GT, A_GE }, { A_SHL, A_SHR },
+    { A_ADD, A_SUB }, { A_MUL, A_DIV, A_MOD },
+};
+
+#define NLEVELS (sizeof(levels)/sizeof(*levels))
+
+typedef struct {
+    Arena* A;
+    const char* s;
+    int error;
+} Compiler;
+
+
+static Arith* node (Compiler* C, ArithOp op, Arith* a, Arith* b)
+{
+    Arith* E = arena_alloc (C->A, sizeof(*E));
+
+    memset (E, 0, sizeof(*E));
+    E->op = op;
+    E->a = a;
+    E->b = b;
+
+    return E;
+}
+
+
+static void skip (Compiler* C)
+{
+    while (isspace ((unsigned char)*C->s))
+        C->s++;
+}
+
+
+/* the index in ops[] of the operator at the cursor (OP_NONE if none) */
+static int peek (Compiler* C)
+{
+    unsigned int i;
+
+    skip (C);
+
+    for (i=0; i<NOPS; i++)
+        if (ops[i].s[0] == *C->s && !strncmp (C->s, ops[i].s, strlen (ops[i].s)))
+            return i;
+
+    return OP_NONE;
+}
+
+
+static int accept (Compiler* C, ArithOp op)
+{
+    int i = peek (C);
+
+    if (i == OP_NONE || ops[i].op != op || (op == A_ASSIGN && ops[i].with != A_ASSIGN))
+        return 0;
+
+    C->s += strlen (ops[i].s);
+    return 1;
+}
+
+
+/* a name at the cursor (with an optional '$'), or NULL */
+static char* name (Compiler* C)
+{
+    const char* start;
+
+    skip (C);
+    start = C->s + (*C->s == '$');
+
+    if (isdigit ((unsigned char)*start) && *C->s == '$') {
+        C->s = start + 1;       /* $1 .. $9 */
+        return arena_strndup (C->A, start, 1);
+    }
+
+    if (!isalpha ((unsigned char)*start) && *start != '_')
+        return NULL;
+
+    for (C->s=start; isalnum ((unsigned char)*C->s) || *C->s == '_'; C->s++);
+
+    return arena_strndup (C->A, start, C->s - start);
+}
+
+
+static Arith* comma (Compiler* C);
+static Arith* assignment (Compiler* C);
+static Arith* unary (Compiler* C);
+
+
+static Arith* primary (Compiler* C)
+{
+    Arith* E;
+    char* end;
+    long n;
+
+    skip (C);
+
+    if (*C->s == '(') {
+        C->s++;
+        E = comma (C);
+        skip (C);
+        if (*C->s != ')')
+            C->error = 1;
+        C->s++;
+        return E;
+    }
+
+    if (isdigit ((unsigned char)*C->s)) {
+        n = strtol (C->s, &end, 0);
+        if (isalnum ((unsigned char)*end) || *end == '_')
+            C->error = 1;
+        C->s = end;
+        E = node (C, A_NUM, NULL, NULL);
+        E->num = n;
+        return E;
+    }
+
+    E = node (C, A_VAR, NULL, NULL);
+    if (!(E->name = name (C)))
+        C->error = 1;
+
+    return E;
+}
+
+
+static Arith* postfix (Compiler* C)
+{
+    Arith* E = primary (C);
+    int i = peek (C);
+
+    if (E->op == A_VAR && i != OP_NONE && (ops[i].op == A_PREINC || ops[i].op == A_PREDEC)) {
+        C->s += 2;
+        E->op = ops[i].op == A_PREINC ? A_POSTINC : A_POSTDEC;
+    }
+
+    return E;
+}
+
+
+static Arith* power (Compiler* C)
+{
+    Arith* E = unary (C);
+
+    /* right associative: 2**3**2 is 2**9 */
+    if (!C->error && accept (C, A_POW))
+        E = node (C, A_POW, E, power (C));
+
+    return E;
+}
+
+
+static Arith* unary (Compiler* C)
+{
+    Arith* E;
+    int i = peek (C);
+
+    if (i == OP_NONE)
+        return postfix (C);
+
+    switch (ops[i].op) {
+    case A_ADD:
+        C->s++;
+        return unary (C);
+    case A_SUB:
+        C->s++;
+        return node (C, A_NEG, unary (C), NULL);
+    case A_NOT:
+    case A_BNOT:
+        C->s++;
+        return node (C, ops[i].op, unary (C), NULL);
+    case A_PREINC:
+    case A_PREDEC:
+        C->s += 2;
+        E = node (C, ops[i].op, NULL, NULL);
+        if (!(E->name = name (C)))
+            C->error = 1;
+        return E;
+    default:
+        C->error = 1;
+        return node (C, A_NUM, NULL, NULL);
+    }
+}
+
+
+static int at_level (Compiler* C, unsigned int level, ArithOp* op)
+{
+    int i = peek (C);
+    unsigned int j;
+
+    if (i == OP_NONE)
+        return 0;
+
+    for (j=0; j<4 && levels[level][j]; j++) {
+        if (levels[level][j] == ops[i].op) {
+            C->s += strlen (ops[i].s);
+            *op = ops[i].op;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+static Arith* binary (Compiler* C, unsigned int level)
+{
+    Arith* E;
+    ArithOp op;
+
+    if (level == NLEVELS)
+        return power (C);
+
+    E = binary (C, level+1);
+
+    while (!C->error && at_level (C, level, &op))
+        E = node (C, op, E, binary (C, level+1));
+
+    return E;
+}
+
+
+static Arith* conditional (Compiler* C)
+{
+    Arith* E = binary (C, 0);
+
+    if (!C->error && accept (C, A_COND)) {
+        E = node (C, A_COND, E, comma (C));
+        skip (C);
+        if (*C->s != ':')
+            C->error = 1;
+        C->s++;
+        E->c = assignment (C);
+    }
+
+    return E;
+}
+
+
+static Arith* assignment (Compiler* C)
+{
+    const char* start = C->s;
+    Arith* E;
+    char* var;
+    int i;
+
+    if ((var = name (C)) && (i = peek (C)) != OP_NONE && ops[i].op == A_ASSIGN) {
+        C->s += strlen (ops[i].s);
+        E = node (C, A_ASSIGN, assignment (C), NULL);
+        E->name = var;
+        E->with = ops[i].with;
+        return E;
+    }
+
+    C->s = start;
+    return conditional (C);
+}
+
+
+static Arith* comma (Compiler* C)
+{
+    Arith* E = assignment (C);
+
+    while (!C->error && accept (C, A_COMMA))
+        E = node (C, A_COMMA, E, assignment (C));
+
+    return E;
+}
+
+
+/* NULL on a syntax error */
+Arith* arith_compile (Arena* A, const char* expr)
+{
+    Compiler C;
+    Arith* E;
+
+    C.A = A;
+    C.s = expr;
+    C.error = 0;
+
+    skip (&C);
+    if (!*C.s)                  /* $(( )) is 0 */
+        return node (&C, A_NUM, NULL, NULL);
+
+    E = comma (&C);
+    skip (&C);
+
+    return (C.error || *C.s) ? NULL : E;
+}
+
+
+static long value (const char* name)
+{
+    const char* s = var_value (name);
+
+    return s ? strtol (s, NULL, 0) : 0;
+}
+
+
+static void store (const char* name, long v)
+{
+    char buf[24];
+
+    snprintf (buf, sizeof(buf), "%ld", v);
+    var_set (name, buf);
+}
+
+
+static int apply (ArithOp op, long a, long b, long* v)
+{
+    switch (op) {
+    case A_POW:
+        if (b < 0) {
+            fprintf (stderr, "pssh: exponent less than 0\n");
+            return -1;
+        }
+        for (*v=1; b; b--)
+            *v *= a;
+        return 0;
+    case A_MUL:  *v = a * b;  return 0;
+    case A_DIV:
+    case A_MOD:
+        if (b == 0) {
+            fprintf (stderr, "pssh: division by 0\n");
+            return -1;
+        }
+        /* LONG_MIN / -1 overflows, and traps (SIGFPE) on x86: wrap
+         * around like bash does instead */
+        if (b == -1)
+            *v = op == A_DIV ? (long) -(unsigned long) a : 0;
+        else
+            *v = op == A_DIV ? a / b : a % b;
+        return 0;
+    case A_ADD:  *v = a + b;  return 0;
+    case A_SUB:  *v = a - b;  return 0;
+    case A_SHL:  *v = a << b; return 0;
+    case A_SHR:  *v = a >> b; return 0;
+    case A_LT:   *v = a < b;  return 0;
+    case A_LE:   *v = a <= b; return 0;
+    case A_GT:   *v = a > b;  return 0;
+    case A_GE:   *v = a >= b; return 0;
+    case A_EQ:   *v = a == b; return 0;
+    case A_NE:   *v = a != b; return 0;
+    case A_BAND: *v = a & b;  return 0;
+    case A_BXOR: *v = a ^ b;  return 0;
+    case A_BOR:  *v = a | b;  return 0;
+    default:     *v = b;      return 0;
+    }
+}
+
+
+/* -1 (with a message) on division by zero and the like */
+int arith_eval (const Arith* E, long* v)
+{
+    long a, b;
+
+    switch (E->op) {
+    case A_NUM:
+        *v = E->num;
+        return 0;
+
+    case A_VAR:
+        *v = value (E->name);
+        return 0;
+
+    case A_NEG:
+    case A_NOT:
+    case A_BNOT:
+        if (arith_eval (E->a, &a) == -1)
+            return -1;
+        *v = E->op == A_NEG ? -a : E->op == A_NOT ? !a : ~a;
+        return 0;
+
+    case A_PREINC:
+    case A_PREDEC:
+    case A_POSTINC:
+    case A_POSTDEC:
+        a = value (E->name);
+        b = (E->op == A_PREINC || E->op == A_POSTINC) ? a + 1 : a - 1;
+        store (E->name, b);
+        *v = (E->op == A_PREINC || E->op == A_PREDEC) ? b : a;
+        return 0;
+
+    case A_AND:
+    case A_OR:
+        if (arith_eval (E->a, &a) == -1)
+            return -1;
+        if ((E->op == A_AND) == !a) {
+            *v = !!a;
+            return 0;
+        }
+        if (arith_eval (E->b, &b) == -1)
+            return -1;
+        *v = !!b;
+        return 0;
+
+    case A_COND:
+        if (arith_eval (E->a, &a) == -1)
+            return -1;
+        return arith_eval (a ? E->b : E->c, v);
+
+    case A_ASSIGN:
+        if (arith_eval (E->a, &b) == -1)
+            return -1;
+        if (E->with != A_ASSIGN && apply (E->with, value (E->name), b, &b) == -1)
+            return -1;
+        store (E->name, b);
+        *v = b;
+        return 0;
+
+    case A_COMMA:
+        if (arith_eval (E->a, &a) == -1)
+            return -1;
+        return arith_eval (E->b, v);
+
+    default:
+        if (arith_eval (E->a, &a) == -1 || arith_eval (E->b, &b) == -1)
+            return -1;
+        return apply (E->op, a, b, v);
+    }
+}
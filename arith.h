@@ -0,0 +1,21 @@
+#ifndef _arith_h_
+#define _arith_h_
+
+#include "arena.h"
+
+/* Shell arithmetic: $(( expression ))
+ *
+ * Signed long integers with C's operators and precedence: , = += -=
+ * *= /= %= <<= >>= &= ^= |= ?: || && | ^ & == != < <= > >= << >> + -
+ * * / % ** and the unary + - ! ~ ++ --.  Numbers are decimal, 0x hex
+ * or 0 octal; a name (or $name) is a shell variable, 0 if unset.
+ *
+ * An expression is compiled once, when its command line is parsed,
+ * into a tree that is evaluated every time the expansion runs. */
+
+typedef struct Arith Arith;
+
+Arith* arith_compile (Arena* A, const char* expr);
+int arith_eval (const Arith* E, long* result);
+
+#endif /* _arith_h_ */
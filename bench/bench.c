@@ -0,0 +1,312 @@
+/* Micro-benchmarks for the shell's hot paths
+ *
+ *   - parse_cmdline() on a corpus of realistic and adversarial lines
+ *   - find_job() / find_availability() / remove_job() at several job
+ *     table sizes
+ *   - hash_lookup() (the old command_found()) cold and warm, with a
+ *     short and a long PATH
+ *
+ * Each benchmark collects BENCH_SAMPLES timings, where one sample is
+ * the mean over a batch of calls (so cheap calls aren't swamped by
+ * clock_gettime()), and reports percentiles over the samples as JSON
+ * on stdout.
+ *
+ * Build and run with:  make bench
+ **********************************************************************/
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "parse.h"
+#include "arena.h"
+#include "jobs.h"
+#include "hash.h"
+#include "vars.h"
+
+#define BENCH_SAMPLES 2000
+
+/* what the shell's variables (vars.c) expect it to have */
+int last_status = 0;
+pid_t shell_pid = 0;
+
+typedef void (*BenchFn) (void* arg, unsigned int batch);
+
+static int first = 1;
+
+
+static long now_ns ()
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+
+static int cmp_double (const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return (x > y) - (x < y);
+}
+
+
+static double pct (double* s, unsigned int n, double p)
+{
+    unsigned int i = (unsigned int)(p * (n-1) + 0.5);
+
+    return s[i];
+}
+
+
+/* runs fn BENCH_SAMPLES times over batches of `batch` calls and prints
+ * one JSON object with the per-call latency distribution */
+static void run (const char* name, const char* param, BenchFn fn,
+                 void* arg, unsigned int batch)
+{
+    static double s[BENCH_SAMPLES];
+    double sum = 0;
+    long start;
+    unsigned int i;
+
+    fn (arg, batch);    /* warm up */
+
+    for (i=0; i<BENCH_SAMPLES; i++) {
+        start = now_ns ();
+        fn (arg, batch);
+        s[i] = (double)(now_ns () - start) / batch;
+        sum += s[i];
+    }
+
+    qsort (s, BENCH_SAMPLES, sizeof(*s), cmp_double);
+
+    printf ("%s\n    {\"name\": \"%s\", \"param\": \"%s\", \"samples\": %d, "
+            "\"batch\": %u, \"ns\": {\"mean\": %.1f, \"p50\": %.1f, "
+            "\"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}, "
+            "\"ops_per_sec\": %.0f}",
+            first ? "" : ",", name, param, BENCH_SAMPLES, batch,
+            sum / BENCH_SAMPLES, pct (s, BENCH_SAMPLES, 0.50),
+            pct (s, BENCH_SAMPLES, 0.90), pct (s, BENCH_SAMPLES, 0.99),
+            s[BENCH_SAMPLES-1], 1e9 / (sum / BENCH_SAMPLES));
+
+    first = 0;
+    fflush (stdout);
+}
+
+
+/*** parser ***********************************************************/
+
+typedef struct {
+    Arena* A;
+    const char* line;
+} ParseArg;
+
+static void bench_parse (void* arg, unsigned int batch)
+{
+    ParseArg* a = arg;
+    Script* S;
+
+    while (batch--) {
+        S = parse_cmdline (a->A, a->line);
+        if (!S || S->invalid_syntax) {
+            fprintf (stderr, "bench: corpus line failed to parse\n");
+            exit (EXIT_FAILURE);
+        }
+        arena_reset (a->A);
+    }
+}
+
+
+static char* repeat (const char* head, const char* unit, unsigned int n,
+                     const char* tail)
+{
+    size_t ulen = strlen (unit);
+    char* s = malloc (strlen (head) + n * ulen + strlen (tail) + 1);
+    char* p = stpcpy (s, head);
+
+    while (n--)
+        p = stpcpy (p, unit);
+    strcpy (p, tail);
+
+    return s;
+}
+
+
+static void parser_benchmarks ()
+{
+    ParseArg a;
+    unsigned int i;
+    struct {
+        const char* name;
+        char* line;
+        unsigned int batch;
+    } corpus[] = {
+        { "simple", strdup ("ls -l"), 64 },
+        { "realistic", strdup ("grep -n 'foo bar' < in.txt | sort -k2 | "
+                               "uniq -c | head -20 > out.txt &"), 32 },
+        { "pipeline_64", repeat ("cat", " | cat", 63, ""), 4 },
+        { "argv_4096", repeat ("echo", " argument", 4096, ""), 1 },
+        { "quoting_512", repeat ("echo", " \"a | b\" 'c > d' e\\ f\\&g",
+                                 512, " | wc -c"), 1 },
+        { "list_256", repeat ("true", " && make || echo failed; ls", 256, ""), 1 },
+        { "unspaced_256", repeat ("true", "&&make||echo failed;ls|wc -l", 256, ""), 1 },
+        { "subshell_64", repeat ("", "(cd /tmp && ls) | ", 64, "wc -l"), 4 },
+        { "loop_64", repeat ("for f in a b c; do", " if [ -f $f ]; then n=$((n+1)); fi;",
+                             64, " done"), 4 },
+    };
+
+    a.A = arena_new (ARENA_CHUNK);
+
+    for (i=0; i<sizeof(corpus)/sizeof(*corpus); i++) {
+        char name[64], param[32];
+
+        a.line = corpus[i].line;
+        snprintf (name, sizeof(name), "parse_cmdline/%s", corpus[i].name);
+        snprintf (param, sizeof(param), "%zu bytes", strlen (a.line));
+        run (name, param, bench_parse, &a, corpus[i].batch);
+        free (corpus[i].line);
+    }
+
+    arena_destroy (&a.A);
+}
+
+
+/*** job table ********************************************************/
+
+typedef struct {
+    pid_t* pids;
+    unsigned int npids;
+    unsigned int next;
+} JobArg;
+
+static void bench_find_job (void* arg, unsigned int batch)
+{
+    JobArg* a = arg;
+
+    while (batch--) {
+        if (find_job (a->pids[a->next]) == -1) {
+            fprintf (stderr, "bench: lost a pid\n");
+            exit (EXIT_FAILURE);
+        }
+        a->next = (a->next + 7919) % a->npids;
+    }
+}
+
+
+static void bench_job_churn (void* arg, unsigned int batch)
+{
+    JobArg* a = arg;
+    int k;
+
+    while (batch--) {
+        k = find_availability ("sleep 1 | cat", 2);
+        job_add_pid (k, 4000000 + 2*a->next, "sleep");
+        job_add_pid (k, 4000001 + 2*a->next, "cat");
+        remove_job (k);
+        a->next++;
+    }
+}
+
+
+static void job_benchmarks ()
+{
+    unsigned int sizes[] = { 10, 1000, 10000, 100000 };
+    unsigned int s, i, n;
+    char param[32];
+    JobArg a;
+    unsigned int k;
+
+    new_jobs ();
+
+    for (s=0; s<sizeof(sizes)/sizeof(*sizes); s++) {
+        n = sizes[s];
+
+        /* a mix of 1, 2 and 3 stage pipelines */
+        a.pids = malloc (3 * n * sizeof(*a.pids));
+        a.npids = 0;
+        for (i=0; i<n; i++) {
+            k = find_availability ("background job", i%3 + 1);
+            while (J[k].npids < J[k].maxpids) {
+                a.pids[a.npids] = 1000 + a.npids;
+                job_add_pid (k, a.pids[a.npids++], "job");
+            }
+        }
+
+        snprintf (param, sizeof(param), "%u jobs", n);
+
+        a.next = 0;
+        run ("find_job", param, bench_find_job, &a, 256);
+
+        a.next = 0;
+        run ("find_availability+remove_job", param, bench_job_churn, &a, 64);
+
+        for (k=0; k<njobs; k++)
+            remove_job (k);
+        free (a.pids);
+    }
+}
+
+
+/*** PATH resolution **************************************************/
+
+static void bench_lookup_warm (void* arg, unsigned int batch)
+{
+    while (batch--)
+        if (!hash_lookup (arg)) {
+            fprintf (stderr, "bench: %s not found in PATH\n", (char*)arg);
+            exit (EXIT_FAILURE);
+        }
+}
+
+
+static void bench_lookup_cold (void* arg, unsigned int batch)
+{
+    while (batch--) {
+        hash_clear ();
+        bench_lookup_warm (arg, 1);
+    }
+}
+
+
+static void path_benchmarks ()
+{
+    char* longpath;
+    unsigned int i;
+
+    /* the table looks PATH up in the variable store (vars.h) */
+    var_set ("PATH", "/usr/bin:/bin");
+    run ("hash_lookup_cold", "short PATH", bench_lookup_cold, "ls", 4);
+    run ("hash_lookup_warm", "short PATH", bench_lookup_warm, "ls", 256);
+
+    /* 62 directories that don't have it before the one that does */
+    longpath = malloc (64 * 32);
+    longpath[0] = '\0';
+    for (i=0; i<62; i++)
+        sprintf (longpath + strlen (longpath), "/nonexistent/bench/%u:", i);
+    strcat (longpath, "/usr/bin:/bin");
+
+    var_set ("PATH", longpath);
+    run ("hash_lookup_cold", "long PATH", bench_lookup_cold, "ls", 1);
+    run ("hash_lookup_warm", "long PATH", bench_lookup_warm, "ls", 256);
+
+    free (longpath);
+    var_unset ("PATH");
+}
+
+
+int main (int argc, char** argv)
+{
+    printf ("{\"benchmarks\": [");
+
+    parser_benchmarks ();
+    job_benchmarks ();
+    path_benchmarks ();
+
+    printf ("\n]}\n");
+
+    return 0;
+}
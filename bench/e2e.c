@@ -0,0 +1,213 @@
+/* End-to-end benchmark: pssh vs. bash vs. dash
+ *
+ * Every run starts a fresh shell on its own pseudo-terminal (so pssh
+ * doesn't take any tty-less shortcuts we aren't asking for) and times
+ * it from fork() to exit:
+ *
+ *   first_exec    `true` via -c           startup + time-to-first-exec
+ *   pipeline_N    `true | true | ...`     launch latency of N stages
+ *   stream        a script of many lines  sustained commands/second
+ *   throughput    `head -c .. | cat | cat | wc -c`  bytes/second
+ *
+ * Shells that aren't installed are skipped.  A human readable table
+ * goes to stderr and a JSON document to stdout.
+ *
+ * Build and run with:  make bench-e2e
+ **********************************************************************/
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <pty.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#define E2E_RUNS       50
+#define STREAM_LINES   2000
+#define THROUGHPUT_MB  256
+
+typedef struct {
+    const char* name;
+    const char* path;
+} Shell;
+
+typedef struct {
+    const char* name;
+    char* arg;          /* -c string, or script file if is_script */
+    int is_script;
+    unsigned int runs;
+    double units;       /* work per run, for the rate column */
+    const char* unit;
+} Workload;
+
+static int first = 1;
+
+
+static double now ()
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static int cmp_double (const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/* runs one shell invocation on a fresh pty, draining its output, and
+ * returns the wall time in seconds (or -1 if it failed) */
+static double run_once (const Shell* sh, const Workload* w)
+{
+    char buf[4096];
+    double start;
+    pid_t pid;
+    int master, status;
+
+    start = now ();
+
+    pid = forkpty (&master, NULL, NULL, NULL);
+    if (pid == -1) {
+        perror ("forkpty");
+        exit (EXIT_FAILURE);
+    }
+
+    if (pid == 0) {
+        if (w->is_script)
+            execl (sh->path, sh->name, w->arg, (char*)NULL);
+        else
+            execl (sh->path, sh->name, "-c", w->arg, (char*)NULL);
+        _exit (127);
+    }
+
+    while (read (master, buf, sizeof(buf)) > 0);
+    close (master);
+
+    waitpid (pid, &status, 0);
+
+    if (!WIFEXITED (status) || WEXITSTATUS (status))
+        return -1;
+
+    return now () - start;
+}
+
+
+static void run (const Shell* sh, const Workload* w)
+{
+    double* s = malloc (w->runs * sizeof(*s));
+    double sum = 0, p50, p99;
+    unsigned int i;
+
+    for (i=0; i<w->runs; i++) {
+        if ((s[i] = run_once (sh, w)) < 0) {
+            fprintf (stderr, "%-6s %-14s failed\n", sh->name, w->name);
+            free (s);
+            return;
+        }
+        sum += s[i];
+    }
+
+    qsort (s, w->runs, sizeof(*s), cmp_double);
+    p50 = s[w->runs/2];
+    p99 = s[(unsigned int)((w->runs-1) * 0.99 + 0.5)];
+
+    fprintf (stderr, "%-6s %-14s %10.3f %10.3f %10.3f %14.1f %s/s\n",
+             sh->name, w->name, 1e3 * sum / w->runs, 1e3 * p50, 1e3 * p99,
+             w->units / p50, w->unit);
+
+    printf ("%s\n    {\"shell\": \"%s\", \"workload\": \"%s\", \"runs\": %u, "
+            "\"ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, "
+            "\"max\": %.3f}, \"rate\": %.1f, \"unit\": \"%s/s\"}",
+            first ? "" : ",", sh->name, w->name, w->runs,
+            1e3 * sum / w->runs, 1e3 * p50, 1e3 * p99, 1e3 * s[w->runs-1],
+            w->units / p50, w->unit);
+
+    first = 0;
+    fflush (stdout);
+    free (s);
+}
+
+
+static char* pipeline (unsigned int n)
+{
+    char* s = malloc (n * 7 + 1);
+    char* p = stpcpy (s, "true");
+
+    while (--n)
+        p = stpcpy (p, " | true");
+
+    return s;
+}
+
+
+static char* stream_script ()
+{
+    static char path[] = "/tmp/pssh-e2e-XXXXXX";
+    unsigned int i;
+    FILE* fp;
+    int fd;
+
+    fd = mkstemp (path);
+    if (fd == -1 || !(fp = fdopen (fd, "w"))) {
+        perror ("mkstemp");
+        exit (EXIT_FAILURE);
+    }
+
+    for (i=0; i<STREAM_LINES; i++)
+        fprintf (fp, i % 4 == 3 ? "true | true\n" : "true\n");
+    fclose (fp);
+
+    return path;
+}
+
+
+int main (int argc, char** argv)
+{
+    const char* pssh = argc > 1 ? argv[1] : "./pssh";
+    Shell shells[] = {
+        { "pssh", pssh },
+        { "bash", "/bin/bash" },
+        { "dash", "/bin/dash" },
+    };
+    char throughput[128];
+    char* script;
+    unsigned int s, w;
+
+    snprintf (throughput, sizeof(throughput),
+              "head -c %u < /dev/zero | cat | cat | wc -c",
+              THROUGHPUT_MB << 20);
+    script = stream_script ();
+
+    Workload workloads[] = {
+        { "first_exec",   "true",        0, E2E_RUNS, 1, "cmd" },
+        { "pipeline_2",   pipeline (2),  0, E2E_RUNS, 2, "stage" },
+        { "pipeline_8",   pipeline (8),  0, E2E_RUNS, 8, "stage" },
+        { "pipeline_32",  pipeline (32), 0, E2E_RUNS, 32, "stage" },
+        { "stream",       script,        1, 5, STREAM_LINES, "line" },
+        { "throughput",   throughput,    0, 5, THROUGHPUT_MB, "MB" },
+    };
+
+    fprintf (stderr, "%-6s %-14s %10s %10s %10s %14s\n", "shell", "workload",
+             "mean ms", "p50 ms", "p99 ms", "rate (p50)");
+
+    printf ("{\"e2e\": [");
+
+    for (w=0; w<sizeof(workloads)/sizeof(*workloads); w++)
+        for (s=0; s<sizeof(shells)/sizeof(*shells); s++)
+            if (access (shells[s].path, X_OK) == 0)
+                run (&shells[s], &workloads[w]);
+
+    printf ("\n]}\n");
+
+    unlink (script);
+    return 0;
+}
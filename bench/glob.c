@@ -0,0 +1,198 @@
+/* Pathname expansion benchmark: wildcard_expand() vs. glob(3)
+ *
+ * Fills a scratch directory with N files (f0000000.c, ... with every
+ * fourth one a .h, plus a few subdirectories) and times both engines
+ * on the same patterns, from that directory:
+ *
+ *   *           every name: the cost of reading and sorting
+ *   *.h         a suffix, a quarter of the names
+ *   f00001*     a prefix, a handful of names
+ *   *[13]7.c    a set, a few percent of the names
+ *   (d*)/(*.c)  *.c in each of the subdirectories (parentheses
+ *               only because the pattern would end this comment)
+ *
+ * The match counts of the two have to agree.  glob(3) is run with no
+ * flags (so it sorts too) and has no **, so that is only timed for us.
+ * A human readable table goes to stderr and a JSON document to stdout.
+ *
+ * Build and run with:  make bench-glob [GLOB_FILES="1000 1000000"]
+ **********************************************************************/
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glob.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "wildcard.h"
+
+#define GLOB_RUNS    7
+#define GLOB_SUBDIRS 16
+
+static int first = 1;
+
+
+static double now ()
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static int cmp_double (const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return (x > y) - (x < y);
+}
+
+
+static unsigned int run_ours (const char* pattern)
+{
+    char** m;
+
+    return wildcard_expand (pattern, &m);
+}
+
+
+static unsigned int run_libc (const char* pattern)
+{
+    glob_t g;
+    unsigned int n;
+
+    if (glob (pattern, 0, NULL, &g) != 0)
+        return 0;
+
+    n = g.gl_pathc;
+    globfree (&g);
+
+    return n;
+}
+
+
+/* times fn on pattern GLOB_RUNS times; returns the match count */
+static unsigned int run (const char* engine, unsigned int (*fn) (const char*),
+                         const char* pattern, unsigned int nfiles)
+{
+    double s[GLOB_RUNS];
+    double sum = 0, start;
+    unsigned int i, n = 0;
+
+    fn (pattern);       /* warm up the dentry cache */
+
+    for (i=0; i<GLOB_RUNS; i++) {
+        start = now ();
+        n = fn (pattern);
+        s[i] = now () - start;
+        sum += s[i];
+    }
+
+    qsort (s, GLOB_RUNS, sizeof(*s), cmp_double);
+
+    fprintf (stderr, "%-7s %9u %-10s %9u %10.3f %10.3f %12.0f\n",
+             engine, nfiles, pattern, n, 1e3 * sum / GLOB_RUNS,
+             1e3 * s[GLOB_RUNS/2], nfiles / s[GLOB_RUNS/2]);
+
+    printf ("%s\n    {\"engine\": \"%s\", \"files\": %u, \"pattern\": \"%s\", "
+            "\"matches\": %u, \"runs\": %d, \"ms\": {\"mean\": %.3f, "
+            "\"p50\": %.3f, \"max\": %.3f}, \"entries_per_sec\": %.0f}",
+            first ? "" : ",", engine, nfiles, pattern, n, GLOB_RUNS,
+            1e3 * sum / GLOB_RUNS, 1e3 * s[GLOB_RUNS/2], 1e3 * s[GLOB_RUNS-1],
+            nfiles / s[GLOB_RUNS/2]);
+
+    first = 0;
+    fflush (stdout);
+
+    return n;
+}
+
+
+static void populate (unsigned int nfiles, int create)
+{
+    char name[64];
+    unsigned int i;
+    int fd;
+
+    for (i=0; i<nfiles; i++) {
+        snprintf (name, sizeof(name), "f%07u.%c", i, i % 4 ? 'c' : 'h');
+        if (!create) {
+            unlink (name);
+        } else if ((fd = open (name, O_WRONLY | O_CREAT | O_CLOEXEC, 0644)) != -1) {
+            close (fd);
+        } else {
+            perror (name);
+            exit (EXIT_FAILURE);
+        }
+    }
+
+    for (i=0; i<GLOB_SUBDIRS; i++) {
+        snprintf (name, sizeof(name), "d%02u/x.c", i);
+        if (!create) {
+            unlink (name);
+            name[3] = '\0';
+            rmdir (name);
+            continue;
+        }
+        name[3] = '\0';
+        mkdir (name, 0755);
+        name[3] = '/';
+        if ((fd = open (name, O_WRONLY | O_CREAT | O_CLOEXEC, 0644)) != -1)
+            close (fd);
+    }
+}
+
+
+int main (int argc, char** argv)
+{
+    const char* patterns[] = { "*", "*.h", "f00001*", "*[13]7.c", "d*/*.c" };
+    char dir[] = "/tmp/pssh-glob-XXXXXX";
+    unsigned int sizes[16], nsizes = 0;
+    unsigned int i, p, n;
+    int failed = 0;
+
+    for (i=1; i<(unsigned int)argc && nsizes < 16; i++)
+        sizes[nsizes++] = strtoul (argv[i], NULL, 10);
+    if (!nsizes) {
+        sizes[nsizes++] = 10000;
+        sizes[nsizes++] = 1000000;
+    }
+
+    if (!mkdtemp (dir) || chdir (dir) == -1) {
+        perror (dir);
+        return EXIT_FAILURE;
+    }
+
+    fprintf (stderr, "%-7s %9s %-10s %9s %10s %10s %12s\n", "engine", "files",
+             "pattern", "matches", "mean ms", "p50 ms", "entries/s");
+
+    printf ("{\"glob\": [");
+
+    for (i=0; i<nsizes; i++) {
+        populate (sizes[i], 1);
+
+        for (p=0; p<sizeof(patterns)/sizeof(*patterns); p++) {
+            n = run ("pssh", run_ours, patterns[p], sizes[i]);
+            if (run ("glob(3)", run_libc, patterns[p], sizes[i]) != n) {
+                fprintf (stderr, "bench: %s: match counts differ\n", patterns[p]);
+                failed = 1;
+            }
+        }
+        run ("pssh", run_ours, "**/*.c", sizes[i]);
+
+        populate (sizes[i], 0);
+    }
+
+    printf ("\n]}\n");
+
+    if (chdir ("/") == 0)
+        rmdir (dir);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,274 @@
+/* Server mode benchmark: `pssh --serve` vs. a fresh shell per command
+ *
+ * Every workload runs `/bin/true` over and over and reports requests
+ * per second along with the per-request latency.  It is the external
+ * command, not the builtin, so each request forks and execs one:
+ *
+ *   serve           one connection, one request after another
+ *   serve_connect   a new connection per request
+ *   serve_xN        N clients at once, each with its own connection
+ *   fresh_<shell>   fork+exec of `<shell> -c /bin/true`, the way an
+ *                   orchestrator without a server would do it
+ *
+ * stdin, stdout and stderr of every command are /dev/null.  Shells that
+ * aren't installed are skipped.  A human readable table goes to stderr
+ * and a JSON document to stdout.
+ *
+ * Build and run with:  make bench-serve
+ **********************************************************************/
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "request.h"
+
+#define SERVE_RUNS    5000
+#define FRESH_RUNS    500
+#define CLIENTS       8
+#define BENCH_CMD     "/bin/true"
+
+static int first = 1;
+static int null_fds[3];
+
+
+static double now ()
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static int cmp_double (const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/* prints one result; s holds the n request latencies, wall the time
+ * the whole workload took */
+static void report (const char* name, double* s, unsigned int n, double wall)
+{
+    double sum = 0, p50, p99;
+    unsigned int i;
+
+    for (i=0; i<n; i++)
+        sum += s[i];
+
+    qsort (s, n, sizeof(*s), cmp_double);
+    p50 = s[n/2];
+    p99 = s[(unsigned int)((n-1) * 0.99 + 0.5)];
+
+    fprintf (stderr, "%-16s %8u %10.3f %10.3f %10.3f %12.1f\n", name, n,
+             1e3 * sum / n, 1e3 * p50, 1e3 * p99, n / wall);
+
+    printf ("%s\n    {\"workload\": \"%s\", \"requests\": %u, "
+            "\"ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, "
+            "\"max\": %.3f}, \"requests_per_sec\": %.1f}",
+            first ? "" : ",", name, n, 1e3 * sum / n, 1e3 * p50,
+            1e3 * p99, 1e3 * s[n-1], n / wall);
+
+    first = 0;
+    fflush (stdout);
+}
+
+
+/* runs n requests, on one connection (or a new one each time if
+ * reconnect), storing their latencies in s; -1 on failure */
+static int client (const char* sock_path, unsigned int n, int reconnect, double* s)
+{
+    unsigned int i;
+    double start;
+    int sock = -1;
+
+    for (i=0; i<n; i++) {
+        start = now ();
+        if (sock == -1 && (sock = serve_connect (sock_path)) == -1)
+            return -1;
+        if (serve_request (sock, BENCH_CMD, null_fds, 3) != 0)
+            return -1;
+        if (reconnect) {
+            close (sock);
+            sock = -1;
+        }
+        s[i] = now () - start;
+    }
+
+    if (sock != -1)
+        close (sock);
+
+    return 0;
+}
+
+
+static void bench_serve (const char* name, const char* sock_path, int reconnect)
+{
+    double* s = malloc (SERVE_RUNS * sizeof(*s));
+    double start = now ();
+
+    if (client (sock_path, SERVE_RUNS, reconnect, s) == -1)
+        fprintf (stderr, "%-16s failed\n", name);
+    else
+        report (name, s, SERVE_RUNS, now () - start);
+
+    free (s);
+}
+
+
+/* CLIENTS processes hammering the server at once; their latencies
+ * come back through a pipe */
+static void bench_concurrent (const char* sock_path)
+{
+    unsigned int per = SERVE_RUNS / CLIENTS, n = per * CLIENTS;
+    double* s = malloc (n * sizeof(*s));
+    double start = now ();
+    char name[32];
+    int i, p[2], status, failed = 0;
+    size_t got = 0;
+    ssize_t r;
+
+    if (pipe (p) == -1) {
+        perror ("pipe");
+        exit (EXIT_FAILURE);
+    }
+
+    for (i=0; i<CLIENTS; i++) {
+        if (fork () == 0) {
+            close (p[0]);
+            if (client (sock_path, per, 0, s) == -1)
+                _exit (1);
+            if (write (p[1], s, per * sizeof(*s)) != per * sizeof(*s))
+                _exit (1);
+            _exit (0);
+        }
+    }
+
+    close (p[1]);
+    while ((r = read (p[0], (char*)s + got, n * sizeof(*s) - got)) > 0)
+        got += r;
+    close (p[0]);
+
+    for (i=0; i<CLIENTS; i++)
+        if (wait (&status) == -1 || !WIFEXITED (status) || WEXITSTATUS (status))
+            failed = 1;
+
+    snprintf (name, sizeof(name), "serve_x%d", CLIENTS);
+    if (failed || got != n * sizeof(*s))
+        fprintf (stderr, "%-16s failed\n", name);
+    else
+        report (name, s, n, now () - start);
+
+    free (s);
+}
+
+
+static void bench_fresh (const char* shell, const char* path)
+{
+    double* s = malloc (FRESH_RUNS * sizeof(*s));
+    double start = now (), t;
+    char name[32];
+    unsigned int i;
+    pid_t pid;
+    int status, fd;
+
+    snprintf (name, sizeof(name), "fresh_%s", shell);
+
+    for (i=0; i<FRESH_RUNS; i++) {
+        t = now ();
+        if ((pid = fork ()) == 0) {
+            for (fd=0; fd<3; fd++)
+                dup2 (null_fds[fd], fd);
+            execl (path, shell, "-c", BENCH_CMD, (char*)NULL);
+            _exit (127);
+        }
+        waitpid (pid, &status, 0);
+        if (!WIFEXITED (status) || WEXITSTATUS (status)) {
+            fprintf (stderr, "%-16s failed\n", name);
+            free (s);
+            return;
+        }
+        s[i] = now () - t;
+    }
+
+    report (name, s, FRESH_RUNS, now () - start);
+    free (s);
+}
+
+
+/* starts `pssh --serve sock_path` and waits until it answers */
+static pid_t start_server (const char* pssh, const char* sock_path)
+{
+    pid_t pid;
+    int i, sock;
+
+    if ((pid = fork ()) == 0) {
+        dup2 (null_fds[0], 0);
+        dup2 (null_fds[1], 1);
+        execl (pssh, "pssh", "--serve", sock_path, (char*)NULL);
+        _exit (127);
+    }
+
+    for (i=0; i<200; i++) {
+        if ((sock = serve_connect (sock_path)) != -1) {
+            close (sock);
+            return pid;
+        }
+        usleep (10000);
+    }
+
+    fprintf (stderr, "%s --serve did not come up\n", pssh);
+    kill (pid, SIGKILL);
+    exit (EXIT_FAILURE);
+}
+
+
+int main (int argc, char** argv)
+{
+    const char* pssh = argc > 1 ? argv[1] : "./pssh";
+    const char* shells[][2] = {
+        { "pssh", pssh },
+        { "bash", "/bin/bash" },
+        { "dash", "/bin/dash" },
+    };
+    char sock_path[64];
+    unsigned int i;
+    pid_t server;
+
+    for (i=0; i<3; i++)
+        null_fds[i] = open ("/dev/null", O_RDWR | O_CLOEXEC);
+
+    snprintf (sock_path, sizeof(sock_path), "/tmp/pssh-serve-%d.sock", getpid ());
+    server = start_server (pssh, sock_path);
+
+    fprintf (stderr, "%-16s %8s %10s %10s %10s %12s\n", "workload", "requests",
+             "mean ms", "p50 ms", "p99 ms", "requests/s");
+
+    printf ("{\"serve\": [");
+
+    bench_serve ("serve", sock_path, 0);
+    bench_serve ("serve_connect", sock_path, 1);
+    bench_concurrent (sock_path);
+
+    kill (server, SIGTERM);
+    waitpid (server, NULL, 0);
+    unlink (sock_path);
+
+    for (i=0; i<sizeof(shells)/sizeof(*shells); i++)
+        if (access (shells[i][1], X_OK) == 0)
+            bench_fresh (shells[i][0], shells[i][1]);
+
+    printf ("\n]}\n");
+
+    return 0;
+}
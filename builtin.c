@@ -1,161 +1,1330 @@
-#include <sys/types.h>
-#include <sys/wait.h>
-#include <stdlib.h>
-#include <stdio.h>
-#include <string.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <errno.h>
-
-#include "builtin.h"
-#include "parse.h"
-
-static char* builtin[] = {
-    "exit",   /* exits the shell */
-    "which",  /* displays full path to command */
-    "kill",   /* send signals to specific processes*/
-    "fg",     /* foreground process group*/
-    "bg",     /* background process group*/
-    "jobs",   /* prints all active jobs to stdout*/
-    NULL
-};
-
-Job* new_jobs()
-{
-    Job* jobs = malloc(100*sizeof(Job));
-    int i;
-    for (i=0; i<100; i++) {
-        jobs[i].name = NULL;
-        jobs[i].pids = NULL;
-        jobs[i].npids = 0;
-        jobs[i].pgid = 0;
-        jobs[i].nfinishedtasks = 0;
-        jobs[i].status = TERM;
-    }
-
-    return jobs;
-}
-
-const char *sigabbrev(unsigned int sig)
-{
-    const char *sigs[31] = { "HUP", "INT", "QUIT", "ILL", "TRAP", "ABRT",
-        "BUS", "FPE", "KILL", "USR1", "SEGV", "USR2", "PIPE", "ALRM",
-        "TERM", "STKFLT", "CHLD", "CONT", "STOP", "TSTP", "TTIN",
-        "TTOU", "URG", "XCPU", "XFSZ", "VTALRM", "PROF", "WINCH", "IO",
-        "PWR", "SYS" };
-  
-    if (sig == 0 || sig > 31)
-        return NULL;
-    
-    return sigs[sig-1];
-}
-
-int is_builtin (char* cmd)
-{
-    int i;
-
-    for (i=0; builtin[i]; i++) {
-        if (!strcmp (cmd, builtin[i]))
-            return 1;
-    }
-
-    return 0;
-}
-
-void infile_redirect (char *infile)
-{
-    int in_fd;
-    in_fd = open(infile, O_RDONLY);
-    if (in_fd == -1) {
-        perror("could not read input file\n");
-        exit(EXIT_FAILURE);
-    }
-    if (dup2(in_fd, STDIN_FILENO) == -1) {
-        perror("dup2() for infile redirection failed\n");
-        exit(EXIT_FAILURE);
-    }
-    
-    close(in_fd);
-}
-
-void outfile_redirect (char *outfile)
-{
-    int out_fd;
-    out_fd = open(outfile, O_RDWR | O_CREAT | O_TRUNC, 0644);
-    if (out_fd == -1) {
-        perror("could not read output file\n");
-        exit(EXIT_FAILURE);
-    }
-    if (dup2(out_fd, STDOUT_FILENO) == -1) {
-        perror("dup2() for outfile redirection failed\n");
-        exit(EXIT_FAILURE);
-    }
-
-    close(out_fd);
-}
-
-
-void builtin_which (Task T, char *infile, char *outfile)
-{
-    char* PATH;
-    char* dir;
-    char* tmp;
-    char* state;
-    char probe[PATH_MAX];
-        
-    switch (fork()) {
-    case -1:
-        perror("error -- failed to vfork()\n");
-        exit(EXIT_FAILURE);
-        
-    case 0:
-        if (infile) {
-            infile_redirect(infile);
-        }  
-
-        if (outfile) {
-            outfile_redirect(outfile);
-        }
-        
-        if (is_builtin (T.argv[1])) {
-            printf("%s: shell built-in command\n", T.argv[1]);
-            exit(EXIT_SUCCESS);
-        }
-        
-        PATH = strdup (getenv("PATH"));
-        for (tmp=PATH; ; tmp=NULL) {
-            dir = strtok_r (tmp, ":", &state);
-            if (!dir)
-                break;
-            
-            strncpy (probe, dir, PATH_MAX-1);
-            strncat (probe, "/", PATH_MAX-1);
-            strncat (probe, T.argv[1], PATH_MAX-1);
-    
-            if (access (probe, X_OK) == 0) {
-                printf("%s\n", probe);
-                exit(EXIT_SUCCESS);
-            }
-        }
-    free(PATH);
-       
-    default:
-        break;
-    }
-    wait(NULL);
-}
-
-void builtin_execute (Task T, char* infile, char *outfile)
-{
-    if (!strcmp (T.cmd, "exit")) {
-        exit (EXIT_SUCCESS);
-    }
-    else if (!strcmp (T.cmd, "which")) {
-        builtin_which(T, infile, outfile);
-    }
-    else {
-        printf ("pssh: builtin command: %s (not implemented!)\n", T.cmd);
-    }
-}
-
-
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
+
+#include "builtin.h"
+#include "parse.h"
+#include "hash.h"
+#include "launch.h"
+#include "pcache.h"
+#include "trace.h"
+#include "stats.h"
+#include "admit.h"
+#include "affinity.h"
+#include "prio.h"
+#include "cgroup.h"
+#include "watchdog.h"
+#include "vars.h"
+
+extern int last_status;
+extern pid_t shell_pid;
+
+static char* builtin[] = {
+    "echo",   /* prints its arguments */
+    "printf", /* formatted output */
+    "test",   /* evaluates a conditional expression */
+    "[",      /* same as test, with a closing ] */
+    "true",   /* does nothing, successfully */
+    "false",  /* does nothing, unsuccessfully */
+    "cd",     /* changes the working directory */
+    "pwd",    /* prints the working directory */
+    "exit",   /* exits the shell (or subshell) */
+    "which",  /* displays full path to command */
+    "kill",   /* send signals to specific processes*/
+    "fg",     /* foreground process group*/
+    "bg",     /* background process group*/
+    "jobs",   /* prints all active jobs to stdout*/
+    "hash",   /* lists/clears remembered command paths */
+    "launch", /* selects fork or posix_spawn process launching */
+    "pcache", /* shows/clears the parsed-command cache */
+    "trace",  /* writes a Chrome trace of what the shell does */
+    "stats",  /* shows/resets the shell's counters and histograms */
+    "parallel", /* runs a command over many arguments, N at a time */
+    "admit",  /* limits how many background jobs run at once */
+    "pin",    /* sets the CPUs new (or running) jobs may use */
+    "renice", /* sets the nice value of jobs */
+    "ionice", /* sets the I/O priority of jobs */
+    "sched",  /* sets the scheduling policy of jobs */
+    "bgnice", /* lowers the priority of background jobs */
+    "cgroup", /* gives every job a cgroup of its own */
+    "freeze", /* freezes every process of a job */
+    "thaw",   /* thaws a frozen job */
+    "deadline", /* kills jobs that run for too long */
+    ":",      /* does nothing, successfully (like true) */
+    "break",  /* leaves the innermost (or nth) loop */
+    "continue", /* starts the next iteration of a loop */
+    "return", /* returns from a function */
+    "shift",  /* drops positional parameters */
+    "read",   /* reads a line of stdin into variables */
+    "export", /* puts variables in the environment of commands */
+    "unset",  /* removes variables */
+    "env",    /* prints the environment (with arguments: env(1)) */
+    NULL
+};
+
+const char *sigabbrev(unsigned int sig)
+{
+    const char *sigs[31] = { "HUP", "INT", "QUIT", "ILL", "TRAP", "ABRT",
+        "BUS", "FPE", "KILL", "USR1", "SEGV", "USR2", "PIPE", "ALRM",
+        "TERM", "STKFLT", "CHLD", "CONT", "STOP", "TSTP", "TTIN",
+        "TTOU", "URG", "XCPU", "XFSZ", "VTALRM", "PROF", "WINCH", "IO",
+        "PWR", "SYS" };
+  
+    if (sig == 0 || sig > 31)
+        return NULL;
+    
+    return sigs[sig-1];
+}
+
+int is_builtin (char* cmd)
+{
+    int i;
+
+    for (i=0; builtin[i]; i++) {
+        if (!strcmp (cmd, builtin[i]))
+            return 1;
+    }
+
+    return 0;
+}
+
+/* these two run in a forked child (see launch_fork()), hence _exit() */
+void infile_redirect (char *infile)
+{
+    int in_fd;
+    in_fd = open(infile, O_RDONLY);
+    if (in_fd == -1) {
+        perror("could not read input file\n");
+        _exit(EXIT_FAILURE);
+    }
+    if (dup2(in_fd, STDIN_FILENO) == -1) {
+        perror("dup2() for infile redirection failed\n");
+        _exit(EXIT_FAILURE);
+    }
+    
+    close(in_fd);
+}
+
+void outfile_redirect (char *outfile)
+{
+    int out_fd;
+    out_fd = open(outfile, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (out_fd == -1) {
+        perror("could not read output file\n");
+        _exit(EXIT_FAILURE);
+    }
+    if (dup2(out_fd, STDOUT_FILENO) == -1) {
+        perror("dup2() for outfile redirection failed\n");
+        _exit(EXIT_FAILURE);
+    }
+
+    close(out_fd);
+}
+
+
+/* points fd (stdin or stdout) at file, keeping the old one in R */
+static int redirect_fd (Redir* R, int fd, const char* file, int flags)
+{
+    int new_fd = open(file, flags | O_CLOEXEC, 0644);
+
+    if (new_fd == -1) {
+        printf("pssh: %s: %s\n", file, strerror(errno));
+        return -1;
+    }
+
+    R->fd[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    dup2(new_fd, fd);
+    close(new_fd);
+
+    return 0;
+}
+
+/* Applies '< infile' and '> outfile' to the shell itself so a builtin
+ * can run in-process.  The fds they replace are saved (close-on-exec,
+ * so nothing launched meanwhile inherits them) and put back by
+ * redirect_restore().  Without redirections it costs nothing. */
+int redirect_save (Redir* R, char* infile, char* outfile)
+{
+    R->fd[STDIN_FILENO] = R->fd[STDOUT_FILENO] = -1;
+
+    if (infile && redirect_fd(R, STDIN_FILENO, infile, O_RDONLY) == -1)
+        return -1;
+
+    if (outfile) {
+        fflush(stdout);
+        if (redirect_fd(R, STDOUT_FILENO, outfile, O_RDWR | O_CREAT | O_TRUNC) == -1) {
+            redirect_restore(R);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void redirect_restore (Redir* R)
+{
+    int fd;
+
+    for (fd=STDIN_FILENO; fd<=STDOUT_FILENO; fd++) {
+        if (R->fd[fd] == -1)
+            continue;
+        if (fd == STDOUT_FILENO)
+            fflush(stdout);
+        dup2(R->fd[fd], fd);
+        close(R->fd[fd]);
+        R->fd[fd] = -1;
+    }
+}
+
+
+int builtin_which (Task T)
+{
+    const char* path;
+
+    if (!T.argv[1]) {
+        printf("Usage: which <command>\n");
+        return 1;
+    }
+
+    if (is_builtin (T.argv[1])) {
+        printf("%s: shell built-in command\n", T.argv[1]);
+        return 0;
+    }
+
+    if ((path = hash_lookup (T.argv[1]))) {
+        printf("%s\n", path);
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Prints one backslash escape starting at s (just past the '\') and
+ * returns how many characters it used, or -1 for \c (stop printing).
+ * echo -e writes octal as \0nnn, printf (and %b) as \nnn. */
+static int put_escape (const char* s, int echo)
+{
+    const char* p = s;
+    int c = 0, n;
+
+    switch (*p) {
+    case 'a':  putchar('\a'); return 1;
+    case 'b':  putchar('\b'); return 1;
+    case 'e':  putchar(033);  return 1;
+    case 'f':  putchar('\f'); return 1;
+    case 'n':  putchar('\n'); return 1;
+    case 'r':  putchar('\r'); return 1;
+    case 't':  putchar('\t'); return 1;
+    case 'v':  putchar('\v'); return 1;
+    case '\\': putchar('\\'); return 1;
+    case 'c':  return -1;
+    case '\0':
+        putchar('\\');
+        return 0;
+    }
+
+    if (*p >= '0' && *p <= '7') {
+        if (echo && *p == '0')
+            p++;
+        for (n=0; n<3 && *p >= '0' && *p <= '7'; n++)
+            c = c*8 + (*p++ - '0');
+        putchar(c);
+        return p - s;
+    }
+
+    putchar('\\');
+    putchar(*p);
+    return 1;
+}
+
+/* prints s with its escapes; -1 if it ended in \c */
+static int put_escaped (const char* s, int echo)
+{
+    int n;
+
+    for (; *s; s++) {
+        if (*s != '\\') {
+            putchar(*s);
+            continue;
+        }
+        if ((n = put_escape(s+1, echo)) == -1)
+            return -1;
+        s += n;
+    }
+
+    return 0;
+}
+
+/* echo [-neE] [arg ...] */
+int builtin_echo (Task T)
+{
+    int newline = 1, escapes = 0;
+    char** w = T.argv + 1;
+    char* s;
+
+    for (; *w && (*w)[0] == '-' && (*w)[1] &&
+           strspn(*w + 1, "neE") == strlen(*w + 1); w++) {
+        for (s = *w + 1; *s; s++) {
+            if (*s == 'n')
+                newline = 0;
+            else
+                escapes = (*s == 'e');
+        }
+    }
+
+    for (s = *w; *w; w++) {
+        if (*w != s)
+            putchar(' ');
+        if (!escapes)
+            fputs(*w, stdout);
+        else if (put_escaped(*w, 1) == -1)
+            return 0;
+    }
+
+    if (newline)
+        putchar('\n');
+
+    return 0;
+}
+
+static int printf_number (const char* arg, long long* v, unsigned long long* u)
+{
+    char* end;
+
+    if (!arg || !*arg) {
+        *v = 0;
+        *u = 0;
+        return 0;
+    }
+
+    if ((arg[0] == '\'' || arg[0] == '\"') && arg[1]) {
+        *v = *u = (unsigned char)arg[1];
+        return 0;
+    }
+
+    errno = 0;
+    *v = strtoll(arg, &end, 0);
+    *u = (*arg == '-') ? (unsigned long long)*v : strtoull(arg, &end, 0);
+    if (*end || errno) {
+        printf("pssh: printf: %s: invalid number\n", arg);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* printf format [arg ...]: the format is reused until every argument
+ * has been consumed */
+int builtin_printf (Task T)
+{
+    char spec[32];
+    char** args;
+    const char* p;
+    const char* arg;
+    long long v;
+    unsigned long long u;
+    size_t n;
+    int e, used, status = 0;
+
+    if (!T.argv[1]) {
+        printf("Usage: printf <format> [arguments ...]\n");
+        return 2;
+    }
+
+    args = T.argv + 2;
+
+    do {
+        used = 0;
+        for (p = T.argv[1]; *p; p++) {
+            if (*p == '\\') {
+                if ((e = put_escape(p+1, 0)) == -1)
+                    return status;
+                p += e;
+                continue;
+            }
+
+            if (*p != '%') {
+                putchar(*p);
+                continue;
+            }
+
+            if (p[1] == '%') {
+                putchar('%');
+                p++;
+                continue;
+            }
+
+            // %[flags][width][.precision]conversion
+            n = 1 + strspn(p+1, "-+ #0");
+            n += strspn(p+n, "0123456789");
+            if (p[n] == '.')
+                n += 1 + strspn(p+n+1, "0123456789");
+            if (n + 4 > sizeof(spec) || !p[n]) {
+                printf("pssh: printf: bad format: %s\n", p);
+                return 1;
+            }
+            memcpy(spec, p, n);
+
+            arg = *args ? *args++ : NULL;
+            used = 1;
+
+            switch (p[n]) {
+            case 's':
+                strcpy(spec+n, "s");
+                printf(spec, arg ? arg : "");
+                break;
+            case 'b':
+                if (arg && put_escaped(arg, 0) == -1)
+                    return status;
+                break;
+            case 'c':
+                strcpy(spec+n, "c");
+                if (arg && *arg)
+                    printf(spec, *arg);
+                break;
+            case 'd': case 'i':
+                if (printf_number(arg, &v, &u) == -1)
+                    status = 1;
+                strcpy(spec+n, "lld");
+                printf(spec, v);
+                break;
+            case 'u': case 'o': case 'x': case 'X':
+                if (printf_number(arg, &v, &u) == -1)
+                    status = 1;
+                sprintf(spec+n, "ll%c", p[n]);
+                printf(spec, u);
+                break;
+            case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+                spec[n] = p[n];
+                spec[n+1] = '\0';
+                printf(spec, arg ? strtod(arg, NULL) : 0.0);
+                break;
+            default:
+                printf("pssh: printf: %%%c: invalid directive\n", p[n]);
+                return 1;
+            }
+
+            p += n;
+        }
+    } while (*args && used);
+
+    return status;
+}
+
+typedef struct {
+    char** argv;
+    int i, n;
+    int err;
+} TestExpr;
+
+static int test_or (TestExpr* E);
+
+static int test_int (TestExpr* E, const char* s, long long* v)
+{
+    char* end;
+
+    *v = strtoll(s, &end, 10);
+    if (end == s || *end) {
+        printf("pssh: test: %s: integer expression expected\n", s);
+        E->err = 1;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_binary (TestExpr* E, const char* a, const char* op, const char* b)
+{
+    long long x, y;
+
+    if (!strcmp(op, "=") || !strcmp(op, "=="))
+        return !strcmp(a, b);
+    if (!strcmp(op, "!="))
+        return strcmp(a, b) != 0;
+
+    if (test_int(E, a, &x) == -1 || test_int(E, b, &y) == -1)
+        return 0;
+
+    if (!strcmp(op, "-eq")) return x == y;
+    if (!strcmp(op, "-ne")) return x != y;
+    if (!strcmp(op, "-lt")) return x < y;
+    if (!strcmp(op, "-le")) return x <= y;
+    if (!strcmp(op, "-gt")) return x > y;
+    return x >= y;
+}
+
+static int is_binary (const char* op)
+{
+    static const char* ops[] = { "=", "==", "!=", "-eq", "-ne", "-lt",
+                                 "-le", "-gt", "-ge", NULL };
+    int i;
+
+    for (i=0; ops[i]; i++)
+        if (!strcmp(op, ops[i]))
+            return 1;
+
+    return 0;
+}
+
+static int test_unary (char op, const char* a)
+{
+    struct stat st;
+
+    switch (op) {
+    case 'n': return *a != '\0';
+    case 'z': return *a == '\0';
+    case 't': return isatty(atoi(a));
+    case 'r': return access(a, R_OK) == 0;
+    case 'w': return access(a, W_OK) == 0;
+    case 'x': return access(a, X_OK) == 0;
+    case 'h': case 'L':
+        return lstat(a, &st) == 0 && S_ISLNK(st.st_mode);
+    }
+
+    if (stat(a, &st) == -1)
+        return 0;
+
+    switch (op) {
+    case 'e': return 1;
+    case 'f': return S_ISREG(st.st_mode);
+    case 'd': return S_ISDIR(st.st_mode);
+    case 's': return st.st_size > 0;
+    case 'b': return S_ISBLK(st.st_mode);
+    case 'c': return S_ISCHR(st.st_mode);
+    case 'p': return S_ISFIFO(st.st_mode);
+    case 'S': return S_ISSOCK(st.st_mode);
+    }
+
+    return 0;
+}
+
+static int test_primary (TestExpr* E)
+{
+    char* a;
+    int r;
+
+    if (E->i >= E->n) {
+        E->err = 1;
+        return 0;
+    }
+
+    a = E->argv[E->i];
+
+    if (E->i + 2 < E->n && is_binary(E->argv[E->i+1])) {
+        E->i += 3;
+        return test_binary(E, a, E->argv[E->i-2], E->argv[E->i-1]);
+    }
+
+    if (!strcmp(a, "!")) {
+        E->i++;
+        return !test_primary(E);
+    }
+
+    if (!strcmp(a, "(") && E->i + 1 < E->n) {
+        E->i++;
+        r = test_or(E);
+        if (E->i >= E->n || strcmp(E->argv[E->i], ")"))
+            E->err = 1;
+        E->i++;
+        return r;
+    }
+
+    if (a[0] == '-' && a[1] && !a[2] && strchr("nztrwxhLefdsbcpS", a[1]) &&
+        E->i + 1 < E->n) {
+        E->i += 2;
+        return test_unary(a[1], E->argv[E->i-1]);
+    }
+
+    E->i++;
+    return *a != '\0';
+}
+
+static int test_and (TestExpr* E)
+{
+    int r = test_primary(E);
+
+    while (E->i < E->n && !strcmp(E->argv[E->i], "-a")) {
+        E->i++;
+        r = test_primary(E) && r;
+    }
+
+    return r;
+}
+
+static int test_or (TestExpr* E)
+{
+    int r = test_and(E);
+
+    while (E->i < E->n && !strcmp(E->argv[E->i], "-o")) {
+        E->i++;
+        r = test_and(E) || r;
+    }
+
+    return r;
+}
+
+/* test expr, or [ expr ]: 0 if true, 1 if false, 2 on error */
+int builtin_test (Task T)
+{
+    TestExpr E;
+    int n, r;
+
+    for (n=0; T.argv[n]; n++);
+
+    if (!strcmp(T.cmd, "[")) {
+        if (strcmp(T.argv[n-1], "]")) {
+            printf("pssh: [: missing ]\n");
+            return 2;
+        }
+        n--;
+    }
+
+    E.argv = T.argv + 1;
+    E.n = n - 1;
+    E.i = 0;
+    E.err = 0;
+
+    if (!E.n)
+        return 1;
+
+    r = test_or(&E);
+    if (E.i != E.n) {
+        printf("pssh: %s: syntax error\n", T.cmd);
+        return 2;
+    }
+
+    return E.err ? 2 : !r;
+}
+
+int builtin_pwd (Task T)
+{
+    char cwd[PATH_MAX];
+
+    if (!getcwd(cwd, sizeof(cwd))) {
+        printf("pssh: pwd: %s\n", strerror(errno));
+        return 1;
+    }
+
+    printf("%s\n", cwd);
+    return 0;
+}
+
+/* cd [dir | -]: HOME by default, - for the previous directory */
+int builtin_cd (Task T)
+{
+    char old[PATH_MAX], cwd[PATH_MAX];
+    const char* dir = T.argv[1];
+    int back = 0;
+
+    if (!dir && !(dir = var_get("HOME"))) {
+        printf("pssh: cd: HOME not set\n");
+        return 1;
+    }
+
+    if (!strcmp(dir, "-")) {
+        if (!(dir = var_get("OLDPWD"))) {
+            printf("pssh: cd: OLDPWD not set\n");
+            return 1;
+        }
+        back = 1;
+    }
+
+    if (!getcwd(old, sizeof(old)))
+        old[0] = '\0';
+
+    if (chdir(dir) == -1) {
+        printf("pssh: cd: %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+
+    var_set("OLDPWD", old);
+    var_export("OLDPWD");
+    if (getcwd(cwd, sizeof(cwd))) {
+        var_set("PWD", cwd);
+        var_export("PWD");
+        if (back)
+            printf("%s\n", cwd);
+    }
+
+    return 0;
+}
+
+static int by_name (const void* a, const void* b)
+{
+    return strcmp(*(char**)a, *(char**)b);
+}
+
+/* export [-p] [name[=value] ...]: without names, lists the exported
+ * variables in a form that can be read back in */
+int builtin_export (Task T)
+{
+    char** env = var_environ();
+    char** sorted;
+    unsigned int i, n, len;
+    int status = 0;
+    char* s;
+
+    if (T.argv[1] && !strcmp(T.argv[1], "-p"))
+        T.argv++;
+
+    if (!T.argv[1]) {
+        for (n=0; env[n]; n++);
+        sorted = malloc((n+1) * sizeof(*sorted));
+        memcpy(sorted, env, (n+1) * sizeof(*sorted));
+        qsort(sorted, n, sizeof(*sorted), by_name);
+
+        for (i=0; i<n; i++) {
+            len = var_name_len(sorted[i]);
+            printf("export %.*s=\"", len, sorted[i]);
+            for (s=sorted[i]+len+1; *s; s++) {
+                if (strchr("\"\\$`", *s))
+                    putchar('\\');
+                putchar(*s);
+            }
+            printf("\"\n");
+        }
+
+        free(sorted);
+        return 0;
+    }
+
+    for (i=1; T.argv[i]; i++) {
+        n = var_name_len(T.argv[i]);
+        if (!n || (T.argv[i][n] && T.argv[i][n] != '=')) {
+            printf("pssh: export: `%s': not a valid identifier\n", T.argv[i]);
+            status = 1;
+            continue;
+        }
+        if (T.argv[i][n] == '=')
+            var_assign(T.argv[i]);
+        s = strndup(T.argv[i], n);
+        var_export(s);
+        free(s);
+    }
+
+    return status;
+}
+
+/* unset [-v] name ... */
+int builtin_unset (Task T)
+{
+    int i, status = 0;
+
+    if (T.argv[1] && !strcmp(T.argv[1], "-v"))
+        T.argv++;
+
+    for (i=1; T.argv[i]; i++) {
+        if (var_name_len(T.argv[i]) != strlen(T.argv[i])) {
+            printf("pssh: unset: `%s': not a valid identifier\n", T.argv[i]);
+            status = 1;
+            continue;
+        }
+        var_unset(T.argv[i]);
+    }
+
+    return status;
+}
+
+/* env: the environment the commands we run get (with arguments it is
+ * not this builtin but env(1); see builtin_task() in pssh.c) */
+int builtin_env (Task T)
+{
+    char** env;
+
+    for (env=var_environ(); *env; env++)
+        printf("%s\n", *env);
+
+    return 0;
+}
+
+/* shift [n] */
+int builtin_shift (Task T)
+{
+    int n = T.argv[1] ? atoi(T.argv[1]) : 1;
+
+    if (n < 0 || var_shift(n) == -1) {
+        printf("pssh: shift: shift count out of range\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+/* read [-r] [name ...]: a line of stdin split at IFS into the names
+ * (REPLY without any), the last one getting the rest of it.  The line
+ * is read a byte at a time, so whatever follows it is left for the
+ * next reader (ex: the rest of a `while read l; do ...; done < file`).
+ * Without -r a backslash escapes the next character. */
+int builtin_read (Task T)
+{
+    static char* reply[] = { "REPLY", NULL };
+    char** names = T.argv + 1;
+    const char* ifs = var_get("IFS");
+    char *line = NULL, *s, *e;
+    size_t len = 0, size = 0;
+    int raw = 0, esc = 0, eof = 0;
+    ssize_t n;
+    char c;
+    int i;
+
+    if (*names && !strcmp(*names, "-r")) {
+        raw = 1;
+        names++;
+    }
+    if (!*names)
+        names = reply;
+
+    for (i=0; names[i]; i++) {
+        if (var_name_len(names[i]) != strlen(names[i])) {
+            printf("pssh: read: `%s': not a valid identifier\n", names[i]);
+            return 2;
+        }
+    }
+
+    if (!ifs)
+        ifs = " \t\n";
+
+    while (1) {
+        n = read(STDIN_FILENO, &c, 1);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            eof = 1;
+            break;
+        }
+        if (esc) {
+            esc = 0;
+            if (c == '\n')
+                continue;
+        }
+        else if (c == '\\' && !raw) {
+            esc = 1;
+            continue;
+        }
+        else if (c == '\n') {
+            break;
+        }
+        if (len + 2 > size) {
+            size = size ? 2*size : 128;
+            line = realloc(line, size);
+        }
+        line[len++] = c;
+    }
+
+    if (!line)
+        line = calloc(1, 1);
+    line[len] = '\0';
+
+    for (s=line, i=0; names[i]; i++) {
+        while (*s && strchr(ifs, *s))
+            s++;
+
+        if (names[i+1]) {
+            for (e=s; *e && !strchr(ifs, *e); e++);
+            if (*e)
+                *e++ = '\0';
+            var_set(names[i], s);
+            s = e;
+        } else {
+            for (e=s+strlen(s); e > s && strchr(ifs, e[-1]); e--);
+            *e = '\0';
+            var_set(names[i], s);
+        }
+    }
+
+    free(line);
+    return eof;
+}
+
+void builtin_hash (Task T)
+{
+    int i;
+
+    if (!T.argv[1]) {
+        hash_print();
+        return;
+    }
+
+    if (!strcmp(T.argv[1], "-r")) {
+        hash_clear();
+        return;
+    }
+
+    if (!strcmp(T.argv[1], "-d")) {
+        for (i=2; T.argv[i]; i++)
+            hash_forget(T.argv[i]);
+        return;
+    }
+
+    for (i=1; T.argv[i]; i++) {
+        if (!is_builtin(T.argv[i]) && !hash_lookup(T.argv[i]))
+            printf("pssh: hash: %s: not found\n", T.argv[i]);
+    }
+}
+
+void builtin_launch (Task T)
+{
+    if (!T.argv[1]) {
+        launch_print_stats();
+    }
+    else if (!strcmp(T.argv[1], "fork")) {
+        launch_set_mode(LAUNCH_FORK);
+    }
+    else if (!strcmp(T.argv[1], "spawn")) {
+        launch_set_mode(LAUNCH_SPAWN);
+    }
+    else {
+        printf("Usage: launch [fork | spawn]\n");
+    }
+}
+
+void builtin_pcache (Task T)
+{
+    if (!T.argv[1]) {
+        pcache_print();
+    }
+    else if (!strcmp(T.argv[1], "-r")) {
+        pcache_clear();
+    }
+    else {
+        printf("Usage: pcache [-r]\n");
+    }
+}
+
+void builtin_trace (Task T)
+{
+    if (!T.argv[1]) {
+        printf("trace: %s\n", trace_enabled() ? "on" : "off");
+    }
+    else if (!strcmp(T.argv[1], "on") && T.argv[2]) {
+        trace_start(T.argv[2]);
+    }
+    else if (!strcmp(T.argv[1], "off")) {
+        trace_stop();
+    }
+    else {
+        printf("Usage: trace [on <file> | off]\n");
+    }
+}
+
+void builtin_stats (Task T)
+{
+    if (!T.argv[1]) {
+        stats_print(stdout);
+    }
+    else if (!strcmp(T.argv[1], "-p")) {
+        stats_prometheus(stdout);
+    }
+    else if (!strcmp(T.argv[1], "-r")) {
+        stats_reset();
+    }
+    else {
+        printf("Usage: stats [-p | -r]\n");
+    }
+}
+
+void builtin_admit (Task T)
+{
+    double cpu = 0, mem = 0;
+    int i;
+
+    if (!T.argv[1]) {
+        admit_print();
+        return;
+    }
+
+    if (!strcmp(T.argv[1], "off") && !T.argv[2]) {
+        admit_set_max(0);
+        admit_set_per_cpu(0);
+        admit_set_pressure(0, 0);
+        return;
+    }
+
+    for (i=1; T.argv[i]; i++) {
+        if (!strcmp(T.argv[i], "-n") && T.argv[i+1]) {
+            admit_set_max(atoi(T.argv[++i]));
+        }
+        else if (!strcmp(T.argv[i], "-c") && T.argv[i+1]) {
+            admit_set_per_cpu(atoi(T.argv[++i]));
+        }
+        else if (!strcmp(T.argv[i], "-p") && T.argv[i+1]) {
+            for (i++; T.argv[i] && T.argv[i][0] != '-'; i++) {
+                if (!sscanf(T.argv[i], "cpu=%lf", &cpu) &&
+                    !sscanf(T.argv[i], "mem=%lf", &mem))
+                    goto usage;
+            }
+            i--;
+            admit_set_pressure(cpu, mem);
+        }
+        else {
+            goto usage;
+        }
+    }
+    return;
+
+usage:
+    printf("Usage: admit [-n <max jobs>] [-c <jobs per cpu>] "
+           "[-p [cpu=<avg10>] [mem=<avg10>]] | off\n");
+}
+
+void builtin_pin (Task T)
+{
+    cpu_set_t set;
+    unsigned int i;
+    int k;
+
+    if (!T.argv[1]) {
+        affinity_print();
+    }
+    else if (!strcmp(T.argv[1], "auto")) {
+        affinity_set_auto(1);
+    }
+    else if (!strcmp(T.argv[1], "off")) {
+        affinity_set_auto(0);
+        affinity_set_default(NULL);
+    }
+    else if (T.argv[1][0] == '%') {
+        k = atoi(T.argv[1] + 1);
+        if (!job_valid(k)) {
+            printf("pssh: invalid job number: [%d]\n", k);
+        }
+        else if (!T.argv[2] || affinity_parse(T.argv[2], &set) == -1) {
+            printf("Usage: pin %%<job> <cpu list>\n");
+        }
+        else {
+            for (i=0; i<J[k].npids; i++)
+                if (!J[k].usage[i].done && affinity_pin_pid(J[k].pids[i], &set) == -1)
+                    printf("pssh: pin: could not move pid %d\n", J[k].pids[i]);
+        }
+    }
+    else if (affinity_set_default(T.argv[1]) == -1) {
+        printf("Usage: pin [<cpu list> | %%<job> <cpu list> | auto | off]\n");
+    }
+}
+
+typedef enum {
+    PRIO_SHOW,
+    PRIO_NICE,
+    PRIO_IO,
+    PRIO_SCHED,
+} PrioOp;
+
+static void prio_apply_pid (const char* cmd, pid_t pid, PrioOp op, int a, int b)
+{
+    int ret = 0;
+
+    switch (op) {
+    case PRIO_SHOW:  prio_print(pid); break;
+    case PRIO_NICE:  ret = prio_nice(pid, a); break;
+    case PRIO_IO:    ret = prio_io(pid, a, b); break;
+    case PRIO_SCHED: ret = prio_policy(pid, a); break;
+    }
+
+    if (ret == -1)
+        printf("pssh: %s: pid %d: %s\n", cmd, pid, strerror(errno));
+}
+
+/* applies op to every live process of each %job (or pid) in targets */
+static void prio_apply (const char* cmd, char** targets, PrioOp op, int a, int b)
+{
+    unsigned int i;
+    pid_t pid;
+    int k;
+
+    for (; *targets; targets++) {
+        if ((*targets)[0] == '%') {
+            k = atoi(*targets + 1);
+            if (!job_valid(k) || J[k].status == QUEUED) {
+                printf("pssh: invalid job number: [%d]\n", k);
+                continue;
+            }
+            for (i=0; i<J[k].npids; i++)
+                if (!J[k].usage[i].done)
+                    prio_apply_pid(cmd, J[k].pids[i], op, a, b);
+        }
+        else if ((pid = atoi(*targets)) > 0) {
+            prio_apply_pid(cmd, pid, op, a, b);
+        }
+        else {
+            printf("pssh: %s: invalid pid: [%s]\n", cmd, *targets);
+        }
+    }
+}
+
+void builtin_renice (Task T)
+{
+    char** w = T.argv + 1;
+    int nice = PRIO_BG_NICE;
+
+    if (*w && !strcmp(*w, "-n"))
+        w++;
+
+    if (*w && (*w)[0] != '%')
+        nice = atoi(*w++);
+
+    if (!*w) {
+        printf("Usage: renice [[-n] <nice>] %%<job> | <pid> ...\n");
+        return;
+    }
+
+    prio_apply(T.cmd, w, PRIO_NICE, nice, 0);
+}
+
+void builtin_ionice (Task T)
+{
+    char** w = T.argv + 1;
+    int class = -1, level = -1;
+    const char* v;
+    char flag;
+
+    for (; *w && (*w)[0] == '-'; w++) {
+        flag = (*w)[1];
+        if ((flag != 'c' && flag != 'n') || !(v = (*w)[2] ? *w + 2 : *++w))
+            goto usage;
+        if (flag == 'c')
+            class = atoi(v);
+        else
+            level = atoi(v);
+    }
+
+    if (!*w || class > IOPRIO_CLASS_IDLE || level > 7)
+        goto usage;
+
+    if (class == -1 && level == -1)
+        prio_apply(T.cmd, w, PRIO_SHOW, 0, 0);
+    else
+        prio_apply(T.cmd, w, PRIO_IO, class == -1 ? IOPRIO_CLASS_BE : class,
+                   level == -1 ? 4 : level);
+    return;
+
+usage:
+    printf("Usage: ionice [-c <class 0-3>] [-n <level 0-7>] %%<job> | <pid> ...\n");
+}
+
+void builtin_sched (Task T)
+{
+    char** w = T.argv + 1;
+    int policy = -1;
+
+    if (*w && (*w)[0] != '%' && (policy = prio_policy_parse(*w)) != -1)
+        w++;
+
+    if (!*w) {
+        printf("Usage: sched [other | batch | idle] %%<job> | <pid> ...\n");
+        return;
+    }
+
+    if (policy == -1)
+        prio_apply(T.cmd, w, PRIO_SHOW, 0, 0);
+    else
+        prio_apply(T.cmd, w, PRIO_SCHED, policy, 0);
+}
+
+void builtin_bgnice (Task T)
+{
+    if (!T.argv[1])
+        printf("bgnice: %s\n", prio_get_bg() ? "on" : "off");
+    else if (!strcmp(T.argv[1], "on"))
+        prio_set_bg(1);
+    else if (!strcmp(T.argv[1], "off"))
+        prio_set_bg(0);
+    else
+        printf("Usage: bgnice [on | off]\n");
+}
+
+void builtin_cgroup (Task T)
+{
+    if (!T.argv[1])
+        cgroup_print();
+    else if (!strcmp(T.argv[1], "on"))
+        cgroup_set_enabled(1);
+    else if (!strcmp(T.argv[1], "off"))
+        cgroup_set_enabled(0);
+    else
+        printf("Usage: cgroup [on | off]\n");
+}
+
+/* freeze/thaw %job: through cgroup.freeze if the job has a leaf, which
+ * also catches whatever it forked, or else SIGSTOP/SIGCONT to its
+ * process group */
+void builtin_freeze (Task T)
+{
+    int on = !strcmp(T.cmd, "freeze");
+    int i, k;
+
+    if (!T.argv[1]) {
+        printf("Usage: %s %%<job> ...\n", T.cmd);
+        return;
+    }
+
+    for (i=1; T.argv[i]; i++) {
+        k = atoi(T.argv[i] + (T.argv[i][0] == '%'));
+        if (!job_valid(k) || !J[k].pgid) {
+            printf("pssh: invalid job number: [%d]\n", k);
+        }
+        else if (cgroup_job_freeze(k, on) == 0) {
+            J[k].frozen = on;
+        }
+        else if (kill(-J[k].pgid, on ? SIGSTOP : SIGCONT) == -1) {
+            printf("pssh: %s: job [%d]: %s\n", T.cmd, k, strerror(errno));
+        }
+    }
+}
+
+void builtin_deadline (Task T)
+{
+    long ms = 0;
+    int k;
+
+    if (!T.argv[1]) {
+        watchdog_print();
+    }
+    else if (!strcmp(T.argv[1], "-g") && T.argv[2] &&
+             (ms = watchdog_parse(T.argv[2])) != -1) {
+        watchdog_set_grace(ms);
+    }
+    else if (T.argv[1][0] == '%' && T.argv[2]) {
+        k = atoi(T.argv[1] + 1);
+        if (!job_valid(k) || !J[k].npids)
+            printf("pssh: invalid job number: [%d]\n", k);
+        else if (!strcmp(T.argv[2], "off"))
+            watchdog_disarm(k);
+        else if ((ms = watchdog_parse(T.argv[2])) > 0)
+            watchdog_arm(k, ms);
+        else
+            goto usage;
+    }
+    else if (!strcmp(T.argv[1], "off")) {
+        watchdog_set_default(0);
+    }
+    else if ((ms = watchdog_parse(T.argv[1])) != -1) {
+        watchdog_set_default(ms);
+    }
+    else {
+        goto usage;
+    }
+    return;
+
+usage:
+    printf("Usage: deadline [<duration> | off | %%<job> <duration> | "
+           "%%<job> off | -g <grace>]\n");
+}
+
+/* Runs one of the builtins that don't need the job table and returns
+ * its exit status.  The commonest ones are looked at first. */
+int builtin_execute (Task T)
+{
+    int status;
+
+    if (!strcmp (T.cmd, "echo")) {
+        return builtin_echo(T);
+    }
+    else if (!strcmp (T.cmd, "test") || !strcmp (T.cmd, "[")) {
+        return builtin_test(T);
+    }
+    else if (!strcmp (T.cmd, "true")) {
+        return 0;
+    }
+    else if (!strcmp (T.cmd, "false")) {
+        return 1;
+    }
+    else if (!strcmp (T.cmd, ":")) {
+        return 0;
+    }
+    else if (!strcmp (T.cmd, "read")) {
+        return builtin_read(T);
+    }
+    else if (!strcmp (T.cmd, "shift")) {
+        return builtin_shift(T);
+    }
+    else if (!strcmp (T.cmd, "printf")) {
+        return builtin_printf(T);
+    }
+    else if (!strcmp (T.cmd, "cd")) {
+        return builtin_cd(T);
+    }
+    else if (!strcmp (T.cmd, "export")) {
+        return builtin_export(T);
+    }
+    else if (!strcmp (T.cmd, "unset")) {
+        return builtin_unset(T);
+    }
+    else if (!strcmp (T.cmd, "env")) {
+        return builtin_env(T);
+    }
+    else if (!strcmp (T.cmd, "pwd")) {
+        return builtin_pwd(T);
+    }
+    else if (!strcmp (T.cmd, "exit")) {
+        status = T.argv[1] ? atoi (T.argv[1]) & 0xff : last_status;
+        if (getpid () == shell_pid)
+            exit (status);
+
+        // a subshell or pipeline stage: the atexit work (trace, stats,
+        // cgroups) belongs to the shell
+        fflush (stdout);
+        fflush (stderr);
+        _exit (status);
+    }
+    else if (!strcmp (T.cmd, "which")) {
+        return builtin_which(T);
+    }
+    else if (!strcmp (T.cmd, "hash")) {
+        builtin_hash(T);
+    }
+    else if (!strcmp (T.cmd, "launch")) {
+        builtin_launch(T);
+    }
+    else if (!strcmp (T.cmd, "pcache")) {
+        builtin_pcache(T);
+    }
+    else if (!strcmp (T.cmd, "trace")) {
+        builtin_trace(T);
+    }
+    else if (!strcmp (T.cmd, "stats")) {
+        builtin_stats(T);
+    }
+    else if (!strcmp (T.cmd, "admit")) {
+        builtin_admit(T);
+    }
+    else if (!strcmp (T.cmd, "pin")) {
+        builtin_pin(T);
+    }
+    else if (!strcmp (T.cmd, "renice")) {
+        builtin_renice(T);
+    }
+    else if (!strcmp (T.cmd, "ionice")) {
+        builtin_ionice(T);
+    }
+    else if (!strcmp (T.cmd, "sched")) {
+        builtin_sched(T);
+    }
+    else if (!strcmp (T.cmd, "bgnice")) {
+        builtin_bgnice(T);
+    }
+    else if (!strcmp (T.cmd, "cgroup")) {
+        builtin_cgroup(T);
+    }
+    else if (!strcmp (T.cmd, "freeze") || !strcmp (T.cmd, "thaw")) {
+        builtin_freeze(T);
+    }
+    else if (!strcmp (T.cmd, "deadline")) {
+        builtin_deadline(T);
+    }
+    else {
+        printf ("pssh: builtin command: %s (not implemented!)\n", T.cmd);
+        return 1;
+    }
+
+    return 0;
+}
+
+
@@ -1,31 +1,47 @@
-#ifndef _builtin_h_
-#define _builtin_h_
-
-#include "parse.h"
-
-typedef enum {
-    STOPPED,
-    TERM,
-    BG,
-    FG,
-} JobStatus;
-
-typedef struct {
-    char* name;
-    pid_t* pids;
-    unsigned int npids;
-    pid_t pgid;
-    unsigned int nfinishedtasks;
-    JobStatus status;
-} Job;
-
-Job* new_jobs();
-int is_builtin (char* cmd);
-const char *sigabbrev(unsigned int sig);
-void infile_redirect (char *infile);
-void outfile_redirect (char *outfile);
-void builtin_execute (Task T, char* infile, char* outfile);
-void builtin_which (Task T, char* infile, char* outfile);
-//void builtin_kill (Task T);
-
-#endif /* _builtin_h_ */
+#ifndef _builtin_h_
+#define _builtin_h_
+
+#include "parse.h"
+#include "jobs.h"
+
+
+int is_builtin (char* cmd);
+const char *sigabbrev(unsigned int sig);
+void infile_redirect (char *infile);
+void outfile_redirect (char *outfile);
+/* stdin and stdout saved by redirect_save() (-1: not redirected) */
+typedef struct {
+    int fd[2];
+} Redir;
+
+int redirect_save (Redir* R, char* infile, char* outfile);
+void redirect_restore (Redir* R);
+int builtin_execute (Task T);
+int builtin_which (Task T);
+int builtin_echo (Task T);
+int builtin_printf (Task T);
+int builtin_test (Task T);
+int builtin_pwd (Task T);
+int builtin_cd (Task T);
+int builtin_export (Task T);
+int builtin_unset (Task T);
+int builtin_env (Task T);
+int builtin_shift (Task T);
+int builtin_read (Task T);
+void builtin_hash (Task T);
+void builtin_launch (Task T);
+void builtin_pcache (Task T);
+void builtin_trace (Task T);
+void builtin_stats (Task T);
+void builtin_admit (Task T);
+void builtin_pin (Task T);
+void builtin_renice (Task T);
+void builtin_ionice (Task T);
+void builtin_sched (Task T);
+void builtin_bgnice (Task T);
+void builtin_cgroup (Task T);
+void builtin_freeze (Task T);
+void builtin_deadline (Task T);
+//void builtin_kill (Task T);
+
+#endif /* _builtin_h_ */
@@ -0,0 +1,570 @@
+/* Per-job cgroup v2 leaves
+ *
+ * Nothing is touched until the first job asks for a leaf.  The shell's
+ * own directory is found from the "0::" line of /proc/self/cgroup and
+ * the cgroup2 mount in /proc/self/mountinfo (which need not be
+ * /sys/fs/cgroup on hybrid systems).  pssh.<pid> holds no processes,
+ * only leaves, so the "no internal processes" rule never gets in the
+ * way of enabling controllers on it.  Its parent is another matter
+ * when that is the shell's own cgroup: a non-root cgroup that holds a
+ * process can't hand controllers down, so the shell first moves itself
+ * into a `shell` leaf of pssh.<pid> next to the jobs', and moves back
+ * at exit so the whole tree can be removed.  That is enough for a
+ * delegated cgroup the shell has to itself (ex: a systemd scope with
+ * Delegate=yes); one shared with other processes needs $PSSH_CGROUP.
+ *
+ * A job's leaf is kept open as a directory fd in its Job and every
+ * file is reached with openat() from there.
+ **********************************************************************/
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "cgroup.h"
+#include "jobs.h"
+
+#define CG_CPU    1
+#define CG_MEMORY 2
+#define CG_PIDS   4
+
+static int enabled = 0;         /* `cgroup on`: every job gets a leaf */
+static int ready = 0;           /* 0: not tried yet, 1: usable, -1: not */
+static int root_fd = -1;        /* our pssh.<pid> directory */
+static pid_t root_pid = 0;      /* the <pid> */
+static char root_path[PATH_MAX + 32];
+static int controllers = 0;     /* CG_* enabled for the leaves */
+static int home_fd = -1;        /* the cgroup the shell left, if it moved */
+static int home_added = 0;      /* CG_* we enabled on it */
+static int available = 0;       /* CG_* the parent of pssh.<pid> has */
+
+
+static int cg_write (int dir, const char* file, const char* fmt, ...)
+{
+    char buf[64];
+    va_list ap;
+    int fd, len, ret;
+
+    va_start (ap, fmt);
+    len = vsnprintf (buf, sizeof(buf), fmt, ap);
+    va_end (ap);
+
+    if ((fd = openat (dir, file, O_WRONLY | O_CLOEXEC)) == -1)
+        return -1;
+
+    ret = write (fd, buf, len) == len ? 0 : -1;
+    close (fd);
+
+    return ret;
+}
+
+
+static int cg_read (int dir, const char* file, char* buf, size_t size)
+{
+    ssize_t n;
+    int fd;
+
+    if ((fd = openat (dir, file, O_RDONLY | O_CLOEXEC)) == -1)
+        return -1;
+
+    n = read (fd, buf, size-1);
+    close (fd);
+
+    if (n < 0)
+        return -1;
+
+    buf[n] = '\0';
+    return 0;
+}
+
+
+/* where the cgroup2 hierarchy is mounted, or -1 */
+static int cgroup2_mount (char* mnt, size_t size)
+{
+    char line[4096], path[PATH_MAX];
+    char* s;
+    FILE* fp;
+    int found = -1;
+
+    if (!(fp = fopen ("/proc/self/mountinfo", "r")))
+        return -1;
+
+    /* ID PARENT MAJ:MIN ROOT MOUNTPOINT OPTIONS [OPTIONAL...] - TYPE ... */
+    while (fgets (line, sizeof(line), fp)) {
+        if (!(s = strstr (line, " - ")) || strncmp (s + 3, "cgroup2 ", 8))
+            continue;
+        if (sscanf (line, "%*s %*s %*s %*s %4095s", path) == 1) {
+            snprintf (mnt, size, "%s", path);
+            found = 0;
+            break;
+        }
+    }
+
+    fclose (fp);
+    return found;
+}
+
+
+/* the cgroup2 directory the shell is in: 0, or 1 if that is the root
+ * one; -1 if there is none */
+static int own_dir (char* dir, size_t size)
+{
+    char mnt[PATH_MAX], line[4096];
+    FILE* fp;
+    int found = -1;
+
+    if (cgroup2_mount (mnt, sizeof(mnt)) == -1)
+        return -1;
+
+    if (!(fp = fopen ("/proc/self/cgroup", "r")))
+        return -1;
+
+    while (fgets (line, sizeof(line), fp)) {
+        if (!strncmp (line, "0::", 3)) {
+            line[strcspn (line, "\n")] = '\0';
+            snprintf (dir, size, "%s%s", mnt, strcmp (line + 3, "/") ? line + 3 : "");
+            found = strcmp (line + 3, "/") ? 0 : 1;
+            break;
+        }
+    }
+
+    fclose (fp);
+    return found;
+}
+
+
+/* the cgroup2 directory we hang pssh.<pid> off of, or -1; 1 if that
+ * is the shell's own cgroup and not the root one, so the shell has to
+ * leave it before it can hand controllers down */
+static int base_dir (char* base, size_t size)
+{
+    char own[PATH_MAX];
+    char* env = getenv ("PSSH_CGROUP");
+    int ret = own_dir (own, sizeof(own));
+
+    if (env && *env) {
+        snprintf (base, size, "%s", env);
+        return ret == 0 && !strcmp (own, env);
+    }
+
+    if (ret == -1)
+        return -1;
+
+    snprintf (base, size, "%s", own);
+    return ret == 0;
+}
+
+
+static const char* names[] = { "cpu", "memory", "pids" };   /* CG_* order */
+
+
+/* the CG_* bits of the controllers listed in dir's file */
+static int listed (int dir, const char* file)
+{
+    char buf[256], *s;
+    int i, bits = 0;
+
+    if (cg_read (dir, file, buf, sizeof(buf)) == -1)
+        return 0;
+
+    for (s=strtok (buf, " \n"); s; s=strtok (NULL, " \n"))
+        for (i=0; i<3; i++)
+            if (!strcmp (s, names[i]))
+                bits |= 1 << i;
+
+    return bits;
+}
+
+
+/* asks dir to hand the cpu, memory and pids controllers down to its
+ * children, and returns the CG_* bits of those it now does */
+static int delegate (int dir)
+{
+    int i;
+
+    for (i=0; i<3; i++)
+        cg_write (dir, "cgroup.subtree_control", "+%s", names[i]);
+
+    return listed (dir, "cgroup.subtree_control");
+}
+
+
+static void undelegate (int dir, int bits)
+{
+    int i;
+
+    for (i=0; i<3; i++)
+        if (bits & (1 << i))
+            cg_write (dir, "cgroup.subtree_control", "-%s", names[i]);
+}
+
+
+/* atexit: only in the shell itself, since a forked child that exit()s
+ * has a copy of the job table whose leaves aren't its to remove */
+static void cgroup_cleanup ()
+{
+    unsigned int k;
+
+    if (getpid () != root_pid)
+        return;
+
+    for (k=0; k<njobs; k++)
+        cgroup_job_destroy (k);
+
+    /* back where we came from, which has to give up the controllers
+     * we enabled on it (and so pssh.<pid> first) to take us in */
+    if (home_fd != -1) {
+        undelegate (root_fd, controllers);
+        undelegate (home_fd, home_added);
+        if (cg_write (home_fd, "cgroup.procs", "0") == 0)
+            unlinkat (root_fd, "shell", AT_REMOVEDIR);
+    }
+
+    rmdir (root_path);
+}
+
+
+
+
+/* creates pssh.<pid> the first time a leaf is needed */
+static int setup ()
+{
+    char base[PATH_MAX], procs[PATH_MAX + 16];
+    int fd, own, before, shell;
+
+    if (ready)
+        return ready;
+
+    ready = -1;
+
+    if ((own = base_dir (base, sizeof(base))) == -1)
+        return ready;
+
+    /* moving our children between cgroups needs write access to the
+     * cgroup.procs of their common ancestor */
+    snprintf (procs, sizeof(procs), "%s/cgroup.procs", base);
+    if (access (procs, W_OK) == -1)
+        return ready;
+
+    if ((fd = open (base, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return ready;
+
+    snprintf (root_path, sizeof(root_path), "%s/pssh.%d", base, getpid());
+    if ((mkdir (root_path, 0755) == -1 && errno != EEXIST) ||
+        (root_fd = open (root_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+        close (fd);
+        return ready;
+    }
+    root_pid = getpid();
+    atexit (cgroup_cleanup);
+
+    if (own) {
+        mkdirat (root_fd, "shell", 0755);
+        shell = openat (root_fd, "shell", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (shell != -1 && cg_write (shell, "cgroup.procs", "0") == 0)
+            home_fd = fd;
+        else
+            unlinkat (root_fd, "shell", AT_REMOVEDIR);
+        if (shell != -1)
+            close (shell);
+    }
+
+    available = listed (fd, "cgroup.controllers");
+    before = listed (fd, "cgroup.subtree_control");
+    home_added = delegate (fd) & ~before;
+    if (home_fd == -1)
+        close (fd);
+
+    controllers = delegate (root_fd);
+
+    return ready = 1;
+}
+
+
+void limits_init (Limits* L)
+{
+    L->mem_max = -1;
+    L->mem_high = -1;
+    L->pids_max = -1;
+    L->cpu_quota = -1;
+    L->cpu_period = CGROUP_CPU_PERIOD;
+}
+
+
+/* 512, 64K, 512M, 2G (powers of 1024), or -1 */
+static long long parse_size (const char* s)
+{
+    char* end;
+    long long n = strtoll (s, &end, 10);
+
+    if (end == s || n < 0)
+        return -1;
+
+    switch (*end) {
+    case 'k': case 'K': n <<= 10; end++; break;
+    case 'm': case 'M': n <<= 20; end++; break;
+    case 'g': case 'G': n <<= 30; end++; break;
+    case 't': case 'T': n <<= 40; end++; break;
+    }
+
+    return *end ? -1 : n;
+}
+
+
+/* one `key=value` of a `limit` prefix: mem=, high=, pids= or cpu=
+ * (N% of one CPU, or QUOTA/PERIOD in µs) */
+int limits_parse (Limits* L, const char* kv)
+{
+    const char* v = strchr (kv, '=');
+    long long a, b;
+    char* end;
+
+    if (!v++)
+        return -1;
+
+    if (!strncmp (kv, "mem=", 4))
+        return (L->mem_max = parse_size (v)) == -1 ? -1 : 0;
+
+    if (!strncmp (kv, "high=", 5))
+        return (L->mem_high = parse_size (v)) == -1 ? -1 : 0;
+
+    if (!strncmp (kv, "pids=", 5)) {
+        L->pids_max = strtoll (v, &end, 10);
+        return (end == v || *end || L->pids_max < 1) ? -1 : 0;
+    }
+
+    if (!strncmp (kv, "cpu=", 4)) {
+        a = strtoll (v, &end, 10);
+        if (end == v || a < 1)
+            return -1;
+        if (!strcmp (end, "%")) {
+            L->cpu_period = CGROUP_CPU_PERIOD;
+            L->cpu_quota = a * CGROUP_CPU_PERIOD / 100;
+            return 0;
+        }
+        if (*end == '/') {
+            b = strtoll (end + 1, &end, 10);
+            if (*end || b < 1)
+                return -1;
+            L->cpu_quota = a;
+            L->cpu_period = b;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+
+/* is any limit set? */
+int limits_set (const Limits* L)
+{
+    return L->mem_max != -1 || L->mem_high != -1 ||
+           L->pids_max != -1 || L->cpu_quota != -1;
+}
+
+
+/* applies the rlimit stand-in for L to pid (0: ourselves) */
+void limits_rlimit (pid_t pid, const Limits* L)
+{
+    struct rlimit rl;
+
+    if (L->mem_max != -1) {
+        rl.rlim_cur = rl.rlim_max = L->mem_max;
+        if (prlimit (pid, RLIMIT_AS, &rl, NULL) == -1)
+            perror("pssh: prlimit(RLIMIT_AS) failed\n");
+    }
+}
+
+
+/* A subshell is a fork of ours with a job table of its own, but it
+ * shares pssh.<pid>, so its leaves are named after it as well. */
+static void leaf_name (char* name, size_t size, int k)
+{
+    if (getpid () == root_pid)
+        snprintf (name, size, "job%d", k);
+    else
+        snprintf (name, size, "job%d.%d", k, getpid ());
+}
+
+
+/* Makes the leaf for job k, if it should have one, and returns its
+ * directory fd (-1: none).  The limits the leaf enforces are cleared
+ * from L; what is left is for limits_rlimit() (mem=, as RLIMIT_AS),
+ * and the settings that have no rlimit are dropped here with a
+ * warning. */
+int cgroup_job_create (int k, Limits* L)
+{
+    char name[32];
+    int dir = -1;
+
+    if ((enabled || limits_set (L)) && setup () == 1) {
+        leaf_name (name, sizeof(name), k);
+        /* a stale leaf is replaced; one that something escaped into
+         * can't be removed, and the job goes without rather than
+         * joining what is in there */
+        if (mkdirat (root_fd, name, 0755) == 0 ||
+            (errno == EEXIST && unlinkat (root_fd, name, AT_REMOVEDIR) == 0 &&
+             mkdirat (root_fd, name, 0755) == 0))
+            dir = openat (root_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+
+    if (dir != -1) {
+        if (L->mem_max != -1 && (controllers & CG_MEMORY) &&
+            cg_write (dir, "memory.max", "%lld", L->mem_max) == 0)
+            L->mem_max = -1;
+        if (L->mem_high != -1 && (controllers & CG_MEMORY) &&
+            cg_write (dir, "memory.high", "%lld", L->mem_high) == 0)
+            L->mem_high = -1;
+        if (L->pids_max != -1 && (controllers & CG_PIDS) &&
+            cg_write (dir, "pids.max", "%lld", L->pids_max) == 0)
+            L->pids_max = -1;
+        if (L->cpu_quota != -1 && (controllers & CG_CPU) &&
+            cg_write (dir, "cpu.max", "%lld %lld", L->cpu_quota, L->cpu_period) == 0)
+            L->cpu_quota = -1;
+    }
+
+    if (L->mem_max != -1)
+        printf("pssh: limit: mem= without the cgroup memory controller only caps"
+               " each process's address space (RLIMIT_AS), not the job's memory\n");
+
+    if (L->pids_max != -1) {
+        printf("pssh: limit: pids= needs the cgroup pids controller, ignored\n");
+        L->pids_max = -1;
+    }
+
+    if (L->mem_high != -1) {
+        printf("pssh: limit: high= needs the cgroup memory controller, ignored\n");
+        L->mem_high = -1;
+    }
+
+    if (L->cpu_quota != -1) {
+        printf("pssh: limit: cpu= needs the cgroup cpu controller, ignored\n");
+        L->cpu_quota = -1;
+    }
+
+    return dir;
+}
+
+
+/* moves pid (0: ourselves) into the leaf open as dir */
+void cgroup_attach (int dir, pid_t pid)
+{
+    if (cg_write (dir, "cgroup.procs", "%d", pid) == -1)
+        perror("pssh: could not move process into its cgroup\n");
+}
+
+
+/* SIGKILLs everything in job k's leaf (-1: no leaf, or no cgroup.kill) */
+int cgroup_job_kill (int k)
+{
+    if (J[k].cgroup == -1)
+        return -1;
+
+    return cg_write (J[k].cgroup, "cgroup.kill", "1");
+}
+
+
+int cgroup_job_freeze (int k, int on)
+{
+    if (J[k].cgroup == -1)
+        return -1;
+
+    return cg_write (J[k].cgroup, "cgroup.freeze", "%d", on ? 1 : 0);
+}
+
+
+static const char* field (const char* buf, const char* key, long long* v)
+{
+    const char* s = strstr (buf, key);
+
+    if (s && sscanf (s + strlen (key), " %lld", v) == 1)
+        return s;
+
+    return NULL;
+}
+
+
+/* CPU time charged to job k's leaf and its memory high-water mark */
+void cgroup_job_report (int k, FILE* fp)
+{
+    char buf[1024];
+    long long usage = 0, user = 0, sys = 0, peak;
+
+    if (J[k].cgroup == -1)
+        return;
+
+    if (cg_read (J[k].cgroup, "cpu.stat", buf, sizeof(buf)) == 0) {
+        field (buf, "usage_usec", &usage);
+        field (buf, "user_usec", &user);
+        field (buf, "system_usec", &sys);
+    }
+
+    fprintf (fp, "  cgroup   cpu %.3fs (user %.3fs, sys %.3fs)", usage / 1e6,
+             user / 1e6, sys / 1e6);
+
+    if (cg_read (J[k].cgroup, "memory.peak", buf, sizeof(buf)) == 0 &&
+        sscanf (buf, "%lld", &peak) == 1)
+        fprintf (fp, ", memory peak %.1fM", peak / (1024.0*1024.0));
+
+    fprintf (fp, "\n");
+}
+
+
+/* closes and removes job k's leaf.  A leaf something escaped into
+ * (a daemon, say) can't be removed and is left behind. */
+void cgroup_job_destroy (int k)
+{
+    char name[32];
+
+    if (!job_valid (k) || J[k].cgroup == -1)
+        return;
+
+    close (J[k].cgroup);
+    J[k].cgroup = -1;
+
+    leaf_name (name, sizeof(name), k);
+    unlinkat (root_fd, name, AT_REMOVEDIR);
+}
+
+
+void cgroup_set_enabled (int on)
+{
+    enabled = on;
+}
+
+
+int cgroup_enabled ()
+{
+    return enabled;
+}
+
+
+void cgroup_print ()
+{
+    setup ();
+
+    printf("cgroup:      %s\n", enabled ? "on" : "off");
+    if (ready == 1) {
+        printf("directory:   %s\n", root_path);
+        printf("controllers:%s%s%s%s\n", controllers & CG_CPU ? " cpu" : "",
+               controllers & CG_MEMORY ? " memory" : "",
+               controllers & CG_PIDS ? " pids" : "",
+               controllers ? "" : " (none: limits fall back to rlimits)");
+        if (available & ~controllers)
+            printf("             (%s holds other processes, so it can't hand"
+                   " controllers down:\n              point PSSH_CGROUP at an"
+                   " empty delegated cgroup)\n", home_fd != -1 ?
+                   "the cgroup we started in" : "its parent");
+    } else {
+        printf("directory:   (unavailable: limits fall back to rlimits)\n");
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef _cgroup_h_
+#define _cgroup_h_
+
+#include <sys/types.h>
+#include <stdio.h>
+
+/* Per-job cgroup v2 leaves
+ *
+ * The shell makes itself a `pssh.<pid>` cgroup under $PSSH_CGROUP (a
+ * delegated cgroup2 directory), or else under its own cgroup, and
+ * enables whichever of the cpu, memory and pids controllers it is
+ * allowed to.  A cgroup that holds processes can't hand controllers
+ * down, so the shell moves out of its own into a leaf of pssh.<pid>
+ * first; if others are left in it, $PSSH_CGROUP has to name an empty
+ * one instead.  A job run with `cgroup on`, or with a `limit` prefix,
+ * gets a `job<n>` leaf of its own:
+ *
+ *   ~$ limit mem=512M high=400M pids=64 cpu=150% make -j8
+ *
+ * sets memory.max, memory.high, pids.max and cpu.max (a percentage of
+ * one CPU, or QUOTA/PERIOD in µs) on the leaf before the job's
+ * processes join it.  Killing a job with SIGKILL then goes through
+ * cgroup.kill and `freeze`/`thaw` through cgroup.freeze, which catch
+ * everything the job forked, not just the pids the shell knows about.
+ *
+ * Limits the leaf can't enforce (no cgroup at all, or the controller
+ * isn't delegated to us) are dropped with a warning, except memory.max:
+ * it falls back to RLIMIT_AS on each process, which caps that one
+ * process's address space rather than the job's memory, and says so.
+ * RLIMIT_NPROC is no stand-in for pids.max, since it counts every
+ * process of the user. */
+
+typedef struct {
+    long long mem_max;    /* memory.max, bytes (-1: unset) */
+    long long mem_high;   /* memory.high, bytes (-1: unset) */
+    long long pids_max;   /* pids.max (-1: unset) */
+    long long cpu_quota;  /* cpu.max, µs per period (-1: unset) */
+    long long cpu_period;
+} Limits;
+
+#define CGROUP_CPU_PERIOD 100000
+
+void limits_init (Limits* L);
+int limits_parse (Limits* L, const char* kv);
+int limits_set (const Limits* L);
+void limits_rlimit (pid_t pid, const Limits* L);
+
+int cgroup_job_create (int k, Limits* L);
+void cgroup_attach (int dir, pid_t pid);
+int cgroup_job_kill (int k);
+int cgroup_job_freeze (int k, int on);
+void cgroup_job_report (int k, FILE* fp);
+void cgroup_job_destroy (int k);
+void cgroup_set_enabled (int on);
+int cgroup_enabled ();
+void cgroup_print ();
+
+#endif /* _cgroup_h_ */
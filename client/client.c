@@ -0,0 +1,38 @@
+/* pssh-client: runs one command line on a `pssh --serve` server
+ *
+ *   pssh-client <socket> <command line>
+ *
+ * The command runs in our cwd and environment, reads our stdin and
+ * writes our stdout and stderr directly, and its exit status becomes
+ * ours.
+ **********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "request.h"
+
+
+int main (int argc, char** argv)
+{
+    int fds[] = { 0, 1, 2 };
+    int sock, status;
+
+    if (argc != 3) {
+        fprintf (stderr, "Usage: pssh-client <socket> <command line>\n");
+        return 2;
+    }
+
+    if ((sock = serve_connect (argv[1])) == -1) {
+        fprintf (stderr, "pssh-client: %s: %s\n", argv[1], strerror (errno));
+        return 127;
+    }
+
+    if ((status = serve_request (sock, argv[2], fds, 3)) == -1) {
+        fprintf (stderr, "pssh-client: no reply from %s\n", argv[1]);
+        return 127;
+    }
+
+    return status;
+}
@@ -0,0 +1,111 @@
+/* Client side of `pssh --serve`
+ *
+ * A request is built in one buffer (cwd, command line, environ) and
+ * sent with the caller's fds in a single sendmsg(); the reply is the
+ * job's exit status.
+ **********************************************************************/
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "request.h"
+#include "serve.h"
+
+extern char** environ;
+
+static char buf[SERVE_MAX_REQUEST];
+
+
+/* a connected socket to the server at path, or -1 */
+int serve_connect (const char* path)
+{
+    struct sockaddr_un addr;
+    int sock;
+
+    memset (&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen (path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy (addr.sun_path, path);
+
+    if ((sock = socket (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) == -1)
+        return -1;
+
+    if (connect (sock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        close (sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+
+static char* append (char* p, const char* s)
+{
+    size_t n = strlen (s) + 1;
+
+    if (!p || p + n > buf + sizeof(buf))
+        return NULL;
+
+    return (char*)memcpy (p, s, n) + n;
+}
+
+
+/* Runs cmdline on the server with fds (up to 3) as its stdin, stdout
+ * and stderr, and returns its exit status, or -1 if the request could
+ * not be made. */
+int serve_request (int sock, const char* cmdline, const int* fds, int nfds)
+{
+    union {
+        char buf[CMSG_SPACE (SERVE_MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    char cwd[PATH_MAX];
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr* cm;
+    char** e;
+    char* p = buf;
+    int status;
+
+    if (!getcwd (cwd, sizeof(cwd)) || nfds > SERVE_MAX_FDS)
+        return -1;
+
+    p = append (p, cwd);
+    p = append (p, cmdline);
+    for (e=environ; *e && p; e++)
+        p = append (p, *e);
+    if (!p)
+        return -1;
+
+    iov.iov_base = buf;
+    iov.iov_len = p - buf;
+
+    memset (&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (nfds) {
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE (nfds * sizeof(int));
+        cm = CMSG_FIRSTHDR (&msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN (nfds * sizeof(int));
+        memcpy (CMSG_DATA (cm), fds, nfds * sizeof(int));
+    }
+
+    if (sendmsg (sock, &msg, MSG_NOSIGNAL) == -1)
+        return -1;
+
+    if (recv (sock, &status, sizeof(status), 0) != sizeof(status))
+        return -1;
+
+    return status;
+}
@@ -0,0 +1,9 @@
+#ifndef _request_h_
+#define _request_h_
+
+/* Client side of `pssh --serve` (see serve.h for the protocol) */
+
+int serve_connect (const char* path);
+int serve_request (int sock, const char* cmdline, const int* fds, int nfds);
+
+#endif /* _request_h_ */
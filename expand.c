@@ -0,0 +1,364 @@
+/* Word expansion
+ *
+ * Fields are built in one growing buffer that is reused from call to
+ * call; only the finished fields are copied into the caller's Arena,
+ * so expanding the same words over and over (a loop body) allocates
+ * nothing but its results.  A word that may glob is also built as a
+ * pattern, in a second buffer, in which what came from quotes is
+ * escaped; a field whose pattern has a wildcard left is replaced by
+ * the pathnames it matches, if there are any.
+ **********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "expand.h"
+#include "parse.h"
+#include "arena.h"
+#include "arith.h"
+#include "vars.h"
+#include "wildcard.h"
+
+typedef struct {
+    Arena* A;
+    char* buf;            /* the field being built */
+    size_t len;
+    size_t size;
+    int have;             /* is there a field, even an empty one? */
+    int globbing;         /* the word may glob: build pat too */
+    int magic;            /* pat has an unquoted wildcard */
+    size_t pat_len;
+    char** fields;        /* the finished ones */
+    unsigned int n;
+    unsigned int nfields;
+} Fields;
+
+static char* buf = NULL;  /* Fields.buf, kept between calls */
+static size_t buf_size = 0;
+static char* pat = NULL;  /* the field as a pattern */
+static size_t pat_size = 0;
+
+
+static void put (Fields* F, const char* s, size_t n)
+{
+    if (F->len + n + 1 > F->size) {
+        F->size = 2 * (F->len + n + 1);
+        F->buf = buf = realloc (F->buf, F->size);
+        buf_size = F->size;
+    }
+
+    memcpy (F->buf + F->len, s, n);
+    F->len += n;
+    F->have = 1;
+}
+
+
+/* n bytes of s onto the pattern: escaped if they were quoted, as they
+ * are (a \ escaping the next byte) otherwise */
+static void put_pat (Fields* F, const char* s, size_t n, int quoted)
+{
+    char* p;
+
+    if (!F->globbing)
+        return;
+
+    if (F->pat_len + 2*n + 1 > pat_size) {
+        pat_size = 2 * (F->pat_len + 2*n + 1);
+        pat = realloc (pat, pat_size);
+    }
+
+    for (p=pat+F->pat_len; n--; s++) {
+        if (quoted && strchr ("*?[]\\", *s)) {
+            *p++ = '\\';
+        }
+        else if (*s == '\\' && n) {
+            *p++ = *s++;
+            n--;
+        }
+        else if (*s == '*' || *s == '?' || *s == '[') {
+            F->magic = 1;
+        }
+        *p++ = *s;
+    }
+    F->pat_len = p - pat;
+}
+
+
+/* A PART_TEXT: it is already a pattern, and the field gets it without
+ * the backslashes. */
+static void put_text (Fields* F, const char* s)
+{
+    const char* e;
+
+    put_pat (F, s, strlen (s), 0);
+
+    for (; *s; s=e) {
+        if (*s == '\\' && s[1])
+            s++;
+        for (e=s+1; *e && *e != '\\'; e++);
+        put (F, s, e - s);
+    }
+}
+
+
+static void push (Fields* F, char* field)
+{
+    char** old = F->fields;
+
+    if (F->n == F->nfields) {
+        F->nfields = F->nfields ? 2*F->nfields : 8;
+        F->fields = arena_alloc (F->A, F->nfields * sizeof(*F->fields));
+        if (old)
+            memcpy (F->fields, old, F->n * sizeof(*F->fields));
+    }
+
+    F->fields[F->n++] = field;
+}
+
+
+/* the field is done: it is a word, or the pathnames its pattern
+ * matches */
+static void finish (Fields* F)
+{
+    char** m;
+    unsigned int i, n = 0;
+
+    if (F->magic) {
+        pat[F->pat_len] = '\0';
+        n = wildcard_expand (pat, &m);
+        for (i=0; i<n; i++)
+            push (F, arena_strdup (F->A, m[i]));
+    }
+
+    if (!n)
+        push (F, arena_strndup (F->A, F->buf, F->len));
+
+    F->len = 0;
+    F->pat_len = 0;
+    F->have = 0;
+    F->magic = 0;
+}
+
+
+static int is_blank (char c)
+{
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+
+/* an unquoted expansion: every run of blanks ends a field */
+static void put_split (Fields* F, const char* s)
+{
+    const char* e;
+
+    while (*s) {
+        if (is_blank (*s)) {
+            if (F->have)
+                finish (F);
+            s++;
+            continue;
+        }
+        for (e=s; *e && !is_blank (*e); e++);
+        put (F, s, e - s);
+        put_pat (F, s, e - s, 0);
+        s = e;
+    }
+}
+
+
+/* The value of part p.  Returns -1 (having said why) if its $(( ))
+ * fails, 0 otherwise; *value is NULL for "$@", which is the caller's
+ * business. */
+static int part_value (WordPart* p, const char** value, char* num)
+{
+    long n;
+
+    if (p->type == PART_TEXT) {
+        *value = p->text;
+    }
+    else if (p->type == PART_ARITH) {
+        if (arith_eval (p->arith, &n) == -1)
+            return -1;
+        sprintf (num, "%ld", n);
+        *value = num;
+    }
+    else if (p->quoted && !strcmp (p->text, "@")) {
+        *value = NULL;
+    }
+    else if (!(*value = var_value (p->text))) {
+        *value = "";
+    }
+
+    return 0;
+}
+
+
+static int expand_word (Fields* F, Word* W)
+{
+    const char* value;
+    char num[24];
+    char** params;
+    unsigned int i, j;
+    int empty = 0;
+
+    F->globbing = W->glob;
+
+    for (i=0; i<W->nparts; i++) {
+        if (part_value (&W->parts[i], &value, num) == -1)
+            return -1;
+
+        if (!value) {
+            /* "$@": a field per parameter, none if there aren't any */
+            params = var_args ();
+            for (j=0; params[j]; j++) {
+                if (j)
+                    finish (F);
+                put (F, params[j], strlen (params[j]));
+                put_pat (F, params[j], strlen (params[j]), 1);
+            }
+            empty = !j;
+        }
+        else if (W->parts[i].type == PART_TEXT) {
+            put_text (F, value);
+        }
+        else if (W->parts[i].type == PART_VAR && !W->parts[i].quoted) {
+            put_split (F, value);
+        }
+        else {
+            put (F, value, strlen (value));
+            put_pat (F, value, strlen (value), 1);
+        }
+    }
+
+    /* "" and "$x" are a word even when empty; $x is none */
+    if (F->have || (W->quoted && !empty))
+        finish (F);
+
+    return 0;
+}
+
+
+static void fields_init (Fields* F, Arena* A)
+{
+    F->A = A;
+    F->buf = buf;
+    F->size = buf_size;
+    F->len = 0;
+    F->have = 0;
+    F->globbing = 0;
+    F->magic = 0;
+    F->pat_len = 0;
+    F->fields = NULL;
+    F->n = 0;
+    F->nfields = 0;
+}
+
+
+/* Expands argv (whose compiled words are in words, NULL for a static
+ * one) into *out, NULL terminated.  Returns the number of fields, or
+ * -1 if an expansion failed. */
+int expand_words (Arena* A, char** argv, Word** words, char*** out)
+{
+    Fields F;
+    unsigned int i;
+
+    fields_init (&F, A);
+
+    for (i=0; argv[i]; i++) {
+        if (words && words[i]) {
+            if (expand_word (&F, words[i]) == -1)
+                return -1;
+        } else {
+            push (&F, argv[i]);
+        }
+    }
+
+    /* room for the NULL */
+    push (&F, NULL);
+    F.n--;
+
+    *out = F.fields;
+    return F.n;
+}
+
+
+/* A word that is never split (an assignment, a redirection): the
+ * parts are just joined, "$@" by spaces.  NULL if an expansion failed. */
+char* expand_string (Arena* A, const char* text, Word* W)
+{
+    Fields F;
+    const char* value;
+    char num[24];
+    unsigned int i;
+
+    if (!W)
+        return (char*) text;
+
+    fields_init (&F, A);
+
+    for (i=0; i<W->nparts; i++) {
+        if (part_value (&W->parts[i], &value, num) == -1)
+            return NULL;
+        if (!value)
+            value = var_value ("@");
+        if (W->parts[i].type == PART_TEXT)
+            put_text (&F, value);
+        else
+            put (&F, value, strlen (value));
+    }
+
+    finish (&F);
+    return F.fields[0];
+}
+
+
+/* The pipeline P with its words expanded: a copy in A, unless nothing
+ * in it needs expanding.  A task whose command name came out of an
+ * expansion has a NULL cmd if there is no word left at all.  NULL if
+ * an expansion failed. */
+Parse* expand_parse (Arena* A, Parse* P)
+{
+    Parse* E;
+    Task* T;
+    unsigned int t, i, n;
+
+    if (!P->expand)
+        return P;
+
+    E = arena_alloc (A, sizeof(*E));
+    *E = *P;
+    E->tasks = arena_alloc (A, P->ntasks * sizeof(*E->tasks));
+    memcpy (E->tasks, P->tasks, P->ntasks * sizeof(*E->tasks));
+
+    if (!(E->infile = expand_string (A, P->infile, P->in_word)) && P->infile)
+        return NULL;
+    if (!(E->outfile = expand_string (A, P->outfile, P->out_word)) && P->outfile)
+        return NULL;
+
+    for (t=0; t<E->ntasks; t++) {
+        T = &E->tasks[t];
+
+        if (T->assign_words) {
+            for (n=0; T->assign[n]; n++);
+            T->assign = arena_alloc (A, (n+1) * sizeof(*T->assign));
+            for (i=0; i<n; i++)
+                if (!(T->assign[i] = expand_string (A, P->tasks[t].assign[i],
+                                                   T->assign_words[i])))
+                    return NULL;
+            T->assign[n] = NULL;
+            T->assign_words = NULL;
+        }
+
+        if (!T->words)
+            continue;
+
+        if (expand_words (A, P->tasks[t].argv, T->words, &T->argv) == -1)
+            return NULL;
+
+        if (T->words[0])
+            T->cmd = T->argv[0];
+        T->words = NULL;
+    }
+
+    return E;
+}
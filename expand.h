@@ -0,0 +1,23 @@
+#ifndef _expand_h_
+#define _expand_h_
+
+#include "parse.h"
+#include "arena.h"
+
+/* Word expansion
+ *
+ * Turns the compiled words of a pipeline (see Word in parse.h) into
+ * the strings it runs with: parameters and $(( )) are substituted,
+ * and whatever came out of an unquoted expansion is split into fields
+ * at blanks (so `for f in $list` sees one word per entry, and an
+ * empty unquoted $x is no word at all).  "$@" is one field per
+ * positional parameter.  Assignments and redirections are never split.
+ *
+ * Everything is allocated from the caller's Arena; a pipeline whose
+ * words are all static never gets here. */
+
+Parse* expand_parse (Arena* A, Parse* P);
+int expand_words (Arena* A, char** argv, Word** words, char*** out);
+char* expand_string (Arena* A, const char* text, Word* W);
+
+#endif /* _expand_h_ */
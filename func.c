@@ -0,0 +1,52 @@
+/* Shell functions
+ **********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+
+#include "func.h"
+#include "pcache.h"
+#include "hash.h"
+
+static Func* buckets[FUNC_BUCKETS];
+static unsigned int nfuncs = 0;
+
+
+Func* func_lookup (const char* name)
+{
+    Func* f;
+
+    /* most command lines run no function at all */
+    if (!nfuncs)
+        return NULL;
+
+    for (f=buckets[hash_string (name) % FUNC_BUCKETS]; f; f=f->next)
+        if (!strcmp (f->name, name))
+            return f;
+
+    return NULL;
+}
+
+
+/* (Re)defines name.  The old body's Script is let go of; a call that
+ * is running it holds it on its own (see call_function() in pssh.c). */
+void func_define (const char* name, Node* body, Script* owner)
+{
+    Func* f = func_lookup (name);
+    Func** head;
+
+    pcache_hold (owner);
+
+    if (f) {
+        pcache_put (f->owner);
+    } else {
+        head = &buckets[hash_string (name) % FUNC_BUCKETS];
+        f = malloc (sizeof(*f));
+        f->name = strdup (name);
+        f->next = *head;
+        *head = f;
+        nfuncs++;
+    }
+
+    f->body = body;
+    f->owner = owner;
+}
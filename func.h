@@ -0,0 +1,26 @@
+#ifndef _func_h_
+#define _func_h_
+
+#include "parse.h"
+
+/* Shell functions
+ *
+ * A function is the body of its `name () { ... }` as it was compiled,
+ * not its text: calling it walks that tree like any other command
+ * line.  The Script the definition came from is held in the parse
+ * cache (see pcache.h) for as long as the function refers to it. */
+
+#define FUNC_BUCKETS 64
+#define FUNC_MAX_DEPTH 1000    /* calls inside calls */
+
+typedef struct Func {
+    char* name;
+    Node* body;
+    Script* owner;       /* where body lives */
+    struct Func* next;
+} Func;
+
+Func* func_lookup (const char* name);
+void func_define (const char* name, Node* body, Script* owner);
+
+#endif /* _func_h_ */
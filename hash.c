@@ -0,0 +1,361 @@
+/* Command hash table
+ *
+ * Maps a command name to the full path of the executable found by
+ * searching PATH.  Lookups that hit the table cost one string hash
+ * and a strcmp() instead of an access() per PATH directory, and the
+ * child can execve() the remembered path directly instead of having
+ * execvp() walk PATH a second time.
+ *
+ * There is one table per PATH value, the HASH_PATHS most recently
+ * used ones, so a `PATH=... cmd` prefix or a --serve client with a
+ * PATH of its own gets a table of its own instead of flushing ours.
+ *
+ * Entries found in a relative PATH directory (ex: ".") are never
+ * remembered, since their meaning changes with the cwd.
+ **********************************************************************/
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+
+#include "hash.h"
+#include "vars.h"
+
+
+typedef struct HashEntry {
+    char* name;
+    char* path;
+    unsigned int hits;
+    struct HashEntry* next;
+} HashEntry;
+
+typedef struct {
+    char* name;
+    struct timespec mtime;
+} PathDir;
+
+typedef struct {
+    char* path;              /* the PATH it was built against (NULL: free) */
+    PathDir* dirs;
+    unsigned int ndirs;
+    time_t last_stat;
+    HashEntry** table;
+    unsigned int nbuckets;
+    unsigned int nentries;
+    unsigned long used;      /* tick of its last lookup */
+} PathTable;
+
+static PathTable tables[HASH_PATHS];
+static unsigned long tick = 0;
+
+static unsigned long generation = 0;
+static unsigned long nhits = 0;     /* lookups answered by the table */
+static unsigned long nmisses = 0;   /* lookups that searched PATH */
+
+
+unsigned long hash_string (const char* s)
+{
+    unsigned long h = 5381;
+
+    while (*s)
+        h = (h << 5) + h + (unsigned char)*s++;
+
+    return h;
+}
+
+
+static void table_free (PathTable* T)
+{
+    unsigned int i;
+    HashEntry *e, *next;
+
+    for (i=0; i<T->nbuckets; i++) {
+        for (e=T->table[i]; e; e=next) {
+            next = e->next;
+            free (e->name);
+            free (e->path);
+            free (e);
+        }
+        T->table[i] = NULL;
+    }
+
+    T->nentries = 0;
+    generation++;
+}
+
+
+static void table_grow (PathTable* T)
+{
+    unsigned int i, n, slot;
+    HashEntry **new, *e, *next;
+
+    n = T->nbuckets ? 2*T->nbuckets : 64;
+    new = calloc (n, sizeof(*new));
+
+    for (i=0; i<T->nbuckets; i++) {
+        for (e=T->table[i]; e; e=next) {
+            next = e->next;
+            slot = hash_string (e->name) & (n-1);
+            e->next = new[slot];
+            new[slot] = e;
+        }
+    }
+
+    free (T->table);
+    T->table = new;
+    T->nbuckets = n;
+}
+
+
+static void dir_mtime (PathDir* d)
+{
+    struct stat st;
+
+    if (stat (d->name, &st) == 0)
+        d->mtime = st.st_mtim;
+    else
+        d->mtime.tv_sec = d->mtime.tv_nsec = 0;
+}
+
+
+/* (re)split PATH into T's directories */
+static void dirs_load (PathTable* T, const char* PATH)
+{
+    char *tmp, *dir, *state;
+    unsigned int i;
+
+    for (i=0; i<T->ndirs; i++)
+        free (T->dirs[i].name);
+    free (T->dirs);
+    free (T->path);
+
+    T->path = strdup (PATH);
+    T->dirs = malloc ((strlen(PATH)/2 + 1) * sizeof(*T->dirs));
+    T->ndirs = 0;
+
+    tmp = strdup (PATH);
+    for (dir=strtok_r (tmp, ":", &state); dir; dir=strtok_r (NULL, ":", &state)) {
+        T->dirs[T->ndirs].name = strdup (dir);
+        dir_mtime (&T->dirs[T->ndirs]);
+        T->ndirs++;
+    }
+    free (tmp);
+
+    T->last_stat = time (NULL);
+}
+
+
+/* the PATH commands are looked up in when none is given */
+static const char* search_path ()
+{
+    const char* PATH = var_get ("PATH");
+
+    return PATH ? PATH : "";
+}
+
+
+/* the table for PATH, made (in place of the least recently used one)
+ * if need be, and flushed if any of its directories changed under us */
+static PathTable* table_for (const char* PATH)
+{
+    PathTable *T, *lru = &tables[0];
+    struct timespec old;
+    time_t now;
+    unsigned int i;
+    int stale = 0;
+
+    for (T=tables; T<tables+HASH_PATHS; T++) {
+        if (T->path && !strcmp (T->path, PATH))
+            break;
+        if (T->used < lru->used)
+            lru = T;
+    }
+
+    if (T == tables+HASH_PATHS) {
+        T = lru;
+        table_free (T);
+        dirs_load (T, PATH);
+        T->used = ++tick;
+        return T;
+    }
+
+    T->used = ++tick;
+
+    now = time (NULL);
+    if (now - T->last_stat < HASH_STAT_INTERVAL)
+        return T;
+
+    T->last_stat = now;
+    for (i=0; i<T->ndirs; i++) {
+        old = T->dirs[i].mtime;
+        dir_mtime (&T->dirs[i]);
+
+        if (old.tv_sec != T->dirs[i].mtime.tv_sec ||
+            old.tv_nsec != T->dirs[i].mtime.tv_nsec)
+            stale = 1;
+    }
+
+    if (stale)
+        table_free (T);
+
+    return T;
+}
+
+
+static HashEntry* table_find (PathTable* T, const char* cmd, unsigned long h)
+{
+    HashEntry* e;
+
+    if (!T->nbuckets)
+        return NULL;
+
+    for (e=T->table[h & (T->nbuckets-1)]; e; e=e->next)
+        if (!strcmp (e->name, cmd))
+            return e;
+
+    return NULL;
+}
+
+
+static HashEntry* table_insert (PathTable* T, const char* cmd, const char* path)
+{
+    HashEntry* e;
+    unsigned int slot;
+
+    if (T->nentries >= T->nbuckets)
+        table_grow (T);
+
+    e = malloc (sizeof(*e));
+    e->name = strdup (cmd);
+    e->path = strdup (path);
+    e->hits = 0;
+
+    slot = hash_string (cmd) & (T->nbuckets-1);
+    e->next = T->table[slot];
+    T->table[slot] = e;
+    T->nentries++;
+
+    return e;
+}
+
+
+/* returns the path that should be exec'd for cmd, either:
+ *   - cmd itself, if it contains a '/' and names an executable
+ *   - the full path of the executable found in the PATH
+ * NULL is returned otherwise.  The returned string is owned by the
+ * table and is valid until the next call into this module. */
+const char* hash_lookup (const char* cmd)
+{
+    return hash_lookup_in (cmd, NULL);
+}
+
+
+/* hash_lookup() in PATH instead of $PATH (NULL: $PATH), for a command
+ * with a `PATH=...` prefix */
+const char* hash_lookup_in (const char* cmd, const char* PATH)
+{
+    static char probe[PATH_MAX];
+    PathTable* T;
+    HashEntry* e;
+    unsigned long h;
+    unsigned int i;
+
+    if (strchr (cmd, '/'))
+        return access (cmd, X_OK) == 0 ? cmd : NULL;
+
+    T = table_for (PATH ? PATH : search_path ());
+
+    h = hash_string (cmd);
+    if ((e = table_find (T, cmd, h))) {
+        e->hits++;
+        nhits++;
+        return e->path;
+    }
+
+    nmisses++;
+
+    for (i=0; i<T->ndirs; i++) {
+        snprintf (probe, PATH_MAX, "%s/%s", T->dirs[i].name, cmd);
+
+        if (access (probe, X_OK) == 0) {
+            if (T->dirs[i].name[0] != '/')
+                return probe;
+
+            e = table_insert (T, cmd, probe);
+            e->hits++;
+            return e->path;
+        }
+    }
+
+    return NULL;
+}
+
+
+void hash_forget (const char* cmd)
+{
+    PathTable* T = table_for (search_path ());
+    HashEntry **link, *e;
+
+    if (!T->nbuckets)
+        return;
+
+    for (link=&T->table[hash_string (cmd) & (T->nbuckets-1)]; (e = *link); link=&e->next) {
+        if (!strcmp (e->name, cmd)) {
+            *link = e->next;
+            free (e->name);
+            free (e->path);
+            free (e);
+            T->nentries--;
+            generation++;
+            return;
+        }
+    }
+
+    printf ("pssh: hash: %s: not found\n", cmd);
+}
+
+
+void hash_clear ()
+{
+    unsigned int i;
+
+    for (i=0; i<HASH_PATHS; i++)
+        table_free (&tables[i]);
+}
+
+
+void hash_print ()
+{
+    PathTable* T = table_for (search_path ());
+    unsigned int i;
+    HashEntry* e;
+
+    if (!T->nentries) {
+        printf ("pssh: hash table empty\n");
+        return;
+    }
+
+    printf ("hits\tcommand\n");
+    for (i=0; i<T->nbuckets; i++)
+        for (e=T->table[i]; e; e=e->next)
+            printf ("%4u\t%s\n", e->hits, e->path);
+}
+
+
+void hash_counts (unsigned long* hits, unsigned long* misses)
+{
+    *hits = nhits;
+    *misses = nmisses;
+}
+
+
+/* bumped every time entries are dropped from the table, so callers
+ * that remember a resolved path can tell when it may be stale */
+unsigned long hash_generation ()
+{
+    return generation;
+}
@@ -0,0 +1,26 @@
+#ifndef _hash_h_
+#define _hash_h_
+
+/* Command hash table (like bash's `hash`)
+ *
+ * Resolves a command name to the absolute path of an executable in
+ * the PATH once and remembers the answer.  Each of the last HASH_PATHS
+ * values of PATH has a table of its own, so switching between them
+ * costs nothing; a table is flushed when the mtime of one of its
+ * directories changes (checked at most once per HASH_STAT_INTERVAL
+ * seconds so we don't trade one stat storm for another).  `hash`
+ * shows, and `hash -d` edits, the table of the current PATH. */
+
+#define HASH_STAT_INTERVAL 1
+#define HASH_PATHS 4
+
+const char* hash_lookup (const char* cmd);
+const char* hash_lookup_in (const char* cmd, const char* PATH);
+void hash_forget (const char* cmd);
+void hash_clear ();
+void hash_print ();
+unsigned long hash_generation ();
+void hash_counts (unsigned long* hits, unsigned long* misses);
+unsigned long hash_string (const char* s);
+
+#endif /* _hash_h_ */
@@ -0,0 +1,124 @@
+/* Buffered line reader
+ *
+ * Lines are returned in place: the '\n' that ends a line is replaced
+ * with a '\0' and a pointer into the buffer is handed back.  The line
+ * is only valid until the next call to reader_getline().
+ **********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "input.h"
+
+
+Reader* reader_new (int fd)
+{
+    Reader* R = malloc (sizeof(*R));
+
+    R->fd = fd;
+    R->size = INPUT_BUFSIZE;
+    R->buf = malloc (R->size + 1);
+    R->start = 0;
+    R->end = 0;
+    R->eof = 0;
+
+    return R;
+}
+
+
+Reader* reader_from_string (const char* s)
+{
+    Reader* R = malloc (sizeof(*R));
+
+    R->fd = -1;
+    R->size = strlen (s);
+    R->buf = malloc (R->size + 1);
+    memcpy (R->buf, s, R->size);
+    R->start = 0;
+    R->end = R->size;
+    R->eof = 1;
+
+    return R;
+}
+
+
+/* read more data, first sliding any partial line to the front of the
+ * buffer (and growing it if the partial line already fills it) */
+static int reader_fill (Reader* R)
+{
+    ssize_t n;
+
+    if (R->eof)
+        return 0;
+
+    if (R->start) {
+        memmove (R->buf, R->buf + R->start, R->end - R->start);
+        R->end -= R->start;
+        R->start = 0;
+    }
+
+    if (R->end == R->size) {
+        R->size *= 2;
+        R->buf = realloc (R->buf, R->size + 1);
+    }
+
+    do {
+        n = read (R->fd, R->buf + R->end, R->size - R->end);
+    } while (n == -1 && errno == EINTR);
+
+    if (n <= 0) {
+        R->eof = 1;
+        return 0;
+    }
+
+    R->end += n;
+    return 1;
+}
+
+
+/* returns the next line (without its '\n'), or NULL at end of input */
+char* reader_getline (Reader* R)
+{
+    char *line, *nl;
+    size_t scanned = R->start;
+
+    while (1) {
+        nl = memchr (R->buf + scanned, '\n', R->end - scanned);
+        if (nl)
+            break;
+
+        scanned = R->end - R->start;
+        if (!reader_fill (R)) {
+            if (R->start == R->end)
+                return NULL;
+
+            /* last line has no trailing newline */
+            line = R->buf + R->start;
+            R->buf[R->end] = '\0';
+            R->start = R->end;
+            return line;
+        }
+        scanned += R->start;
+    }
+
+    *nl = '\0';
+    line = R->buf + R->start;
+    R->start = nl - R->buf + 1;
+
+    return line;
+}
+
+
+void reader_destroy (Reader** R)
+{
+    if (!*R)
+        return;
+
+    if ((*R)->fd > STDERR_FILENO)
+        close ((*R)->fd);
+
+    free ((*R)->buf);
+    free (*R);
+    *R = NULL;
+}
@@ -0,0 +1,26 @@
+#ifndef _input_h_
+#define _input_h_
+
+/* Buffered line reader for non-interactive input
+ *
+ * Reads large blocks from a file descriptor (or walks an in-memory
+ * string for `pssh -c`) and hands back one line at a time without
+ * going through readline or stdio. */
+
+#define INPUT_BUFSIZE 65536
+
+typedef struct {
+    int fd;          /* -1 when reading from a string */
+    char* buf;
+    size_t size;     /* capacity of buf */
+    size_t start;    /* first unconsumed byte */
+    size_t end;      /* one past the last valid byte */
+    int eof;
+} Reader;
+
+Reader* reader_new (int fd);
+Reader* reader_from_string (const char* s);
+char* reader_getline (Reader* R);
+void reader_destroy (Reader** R);
+
+#endif /* _input_h_ */
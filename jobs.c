@@ -0,0 +1,421 @@
+/* Job table
+ *
+ * Jobs live in a growable array so a job's number never changes while
+ * it is alive.  Slots are handed out from a free-list (the table is
+ * doubled only when the free-list is empty), and every pid that is
+ * launched is entered into an open addressed hash index so the SIGCHLD
+ * path can find the owner of a reaped child without scanning.
+ *
+ * The pid index uses linear probing with backward-shift deletion, so
+ * it never fills up with tombstones no matter how many children come
+ * and go.
+ *
+ * Each stage also carries a TaskUsage: the launch time, and once the
+ * child is reaped its wait4() rusage and exit time.  Stages that are
+ * still running are sampled from /proc when a report asks for them.
+ **********************************************************************/
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "jobs.h"
+
+
+typedef struct {
+    pid_t pid;            /* 0: empty */
+    int job;
+    unsigned int task;
+} PidSlot;
+
+Job* J = NULL;
+unsigned int njobs = 0;
+
+static int* freelist = NULL;
+static unsigned int nfree = 0;
+static unsigned int nlive = 0;
+
+static PidSlot* pidindex = NULL;
+static unsigned int index_size = 0;   /* power of 2 */
+static unsigned int index_used = 0;
+
+
+static unsigned int pid_hash (pid_t pid)
+{
+    return ((unsigned int)pid * 2654435761u) & (index_size - 1);
+}
+
+
+static void index_insert (pid_t pid, int job, unsigned int task)
+{
+    unsigned int i;
+
+    for (i=pid_hash (pid); pidindex[i].pid && pidindex[i].pid != pid; i=(i+1) & (index_size-1));
+
+    if (!pidindex[i].pid)
+        index_used++;
+
+    pidindex[i].pid = pid;
+    pidindex[i].job = job;
+    pidindex[i].task = task;
+}
+
+
+static void index_grow ()
+{
+    PidSlot* old = pidindex;
+    unsigned int i, n = index_size;
+
+    index_size = n ? 2*n : 256;
+    pidindex = calloc (index_size, sizeof(*pidindex));
+    index_used = 0;
+
+    for (i=0; i<n; i++)
+        if (old[i].pid)
+            index_insert (old[i].pid, old[i].job, old[i].task);
+
+    free (old);
+}
+
+
+static PidSlot* index_find (pid_t pid)
+{
+    unsigned int i;
+
+    if (!index_size)
+        return NULL;
+
+    for (i=pid_hash (pid); pidindex[i].pid; i=(i+1) & (index_size-1))
+        if (pidindex[i].pid == pid)
+            return &pidindex[i];
+
+    return NULL;
+}
+
+
+static void index_remove (pid_t pid)
+{
+    unsigned int i, j, home;
+
+    if (!index_size)
+        return;
+
+    for (i=pid_hash (pid); pidindex[i].pid != pid; i=(i+1) & (index_size-1))
+        if (!pidindex[i].pid)
+            return;
+
+    /* shift back any later entries of the cluster that can no longer
+     * be reached once slot i is emptied */
+    for (j=i; ; ) {
+        pidindex[i].pid = 0;
+        do {
+            j = (j+1) & (index_size-1);
+            if (!pidindex[j].pid) {
+                index_used--;
+                return;
+            }
+            home = pid_hash (pidindex[j].pid);
+        } while (i <= j ? (i < home && home <= j) : (i < home || home <= j));
+
+        pidindex[i] = pidindex[j];
+        i = j;
+    }
+}
+
+
+static void job_clear (Job* job)
+{
+    job->name = NULL;
+    job->pids = NULL;
+    job->usage = NULL;
+    job->npids = 0;
+    job->maxpids = 0;
+    job->pgid = 0;
+    job->nfinishedtasks = 0;
+    job->status = TERM;
+    job->timed = 0;
+    job->owner = NULL;
+    job->done = NULL;
+    job->lowered = 0;
+    job->cgroup = -1;
+    job->limited = 0;
+    job->frozen = 0;
+    job->watch = 0;
+    job->timedout = 0;
+}
+
+
+static void table_grow ()
+{
+    unsigned int i, n = njobs ? 2*njobs : 16;
+
+    J = realloc (J, n * sizeof(*J));
+    freelist = realloc (freelist, n * sizeof(*freelist));
+
+    /* push in reverse so the lowest numbers are handed out first */
+    for (i=n; i>njobs; i--) {
+        job_clear (&J[i-1]);
+        freelist[nfree++] = i-1;
+    }
+
+    njobs = n;
+}
+
+
+void new_jobs ()
+{
+    table_grow ();
+    index_grow ();
+}
+
+
+/* claims a free job slot for a pipeline of ntasks stages and returns
+ * its job number */
+int find_availability (const char* name, unsigned int ntasks)
+{
+    int k;
+
+    if (!nfree)
+        table_grow ();
+
+    k = freelist[--nfree];
+    nlive++;
+
+    J[k].name = strdup (name);
+    J[k].pids = malloc ((ntasks ? ntasks : 1) * sizeof(*J[k].pids));
+    J[k].usage = malloc ((ntasks ? ntasks : 1) * sizeof(*J[k].usage));
+    J[k].maxpids = ntasks;
+    J[k].npids = 0;
+    J[k].pgid = 0;
+    J[k].nfinishedtasks = 0;
+    J[k].status = TERM;
+    J[k].timed = 0;
+    J[k].owner = NULL;
+    J[k].done = NULL;
+    J[k].lowered = 0;
+    J[k].cgroup = -1;
+    J[k].limited = 0;
+    J[k].frozen = 0;
+    J[k].watch = 0;
+    J[k].timedout = 0;
+
+    return k;
+}
+
+
+void job_add_pid (int k, pid_t pid, const char* cmd)
+{
+    TaskUsage* u = &J[k].usage[J[k].npids];
+
+    if (2*(index_used+1) > index_size)
+        index_grow ();
+
+    index_insert (pid, k, J[k].npids);
+    J[k].pids[J[k].npids++] = pid;
+
+    memset (u, 0, sizeof(*u));
+    snprintf (u->cmd, sizeof(u->cmd), "%s", cmd);
+    clock_gettime (CLOCK_MONOTONIC, &u->start);
+}
+
+
+/* records the wait4() results for a reaped stage */
+void job_task_done (int k, unsigned int task, int status, const struct rusage* ru)
+{
+    TaskUsage* u = &J[k].usage[task];
+
+    clock_gettime (CLOCK_MONOTONIC, &u->end);
+    u->ru = *ru;
+    u->status = status;
+    u->done = 1;
+}
+
+
+/* best effort rusage for a child that hasn't been reaped yet */
+static void task_sample (pid_t pid, struct rusage* ru)
+{
+    char path[64], buf[1024];
+    unsigned long utime, stime;
+    long hz = sysconf (_SC_CLK_TCK);
+    FILE* fp;
+    char* s;
+
+    memset (ru, 0, sizeof(*ru));
+
+    snprintf (path, sizeof(path), "/proc/%d/stat", pid);
+    if ((fp = fopen (path, "r"))) {
+        /* the fields after the ")" of the (possibly spaced) comm */
+        if (fgets (buf, sizeof(buf), fp) && (s = strrchr (buf, ')')) &&
+            sscanf (s+2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                    &utime, &stime) == 2) {
+            ru->ru_utime.tv_sec = utime / hz;
+            ru->ru_utime.tv_usec = (utime % hz) * 1000000 / hz;
+            ru->ru_stime.tv_sec = stime / hz;
+            ru->ru_stime.tv_usec = (stime % hz) * 1000000 / hz;
+        }
+        fclose (fp);
+    }
+
+    snprintf (path, sizeof(path), "/proc/%d/status", pid);
+    if ((fp = fopen (path, "r"))) {
+        while (fgets (buf, sizeof(buf), fp)) {
+            sscanf (buf, "VmHWM: %ld", &ru->ru_maxrss);
+            sscanf (buf, "voluntary_ctxt_switches: %ld", &ru->ru_nvcsw);
+            sscanf (buf, "nonvoluntary_ctxt_switches: %ld", &ru->ru_nivcsw);
+        }
+        fclose (fp);
+    }
+}
+
+
+static double tv_sec (struct timeval tv)
+{
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+static double ts_sec (struct timespec ts)
+{
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void print_rss (FILE* fp, long kb)
+{
+    if (kb >= 1024*1024)
+        fprintf (fp, " %7.1fG", kb / (1024.0*1024.0));
+    else if (kb >= 1024)
+        fprintf (fp, " %7.1fM", kb / 1024.0);
+    else
+        fprintf (fp, " %7ldK", kb);
+}
+
+
+/* Prints one line per stage of job k (real, user and sys time, max
+ * RSS, voluntary/involuntary context switches) followed by the totals
+ * for the whole pipeline.  Stages still running report their usage so
+ * far. */
+void job_print_usage (int k, FILE* fp)
+{
+    struct timespec now;
+    struct rusage ru;
+    TaskUsage* u;
+    double real, first = 0, last = 0;
+    double user = 0, sys = 0;
+    long maxrss = 0, nvcsw = 0, nivcsw = 0;
+    char state[16];
+    unsigned int t;
+
+    if (!job_valid (k) || !J[k].npids)
+        return;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+
+    fprintf (fp, "  %-8s %-10s %9s %9s %9s %8s %8s %8s  %s\n", "pid", "state",
+             "real", "user", "sys", "maxrss", "vcsw", "ivcsw", "command");
+
+    for (t=0; t<J[k].npids; t++) {
+        u = &J[k].usage[t];
+
+        if (u->done) {
+            ru = u->ru;
+            real = ts_sec (u->end) - ts_sec (u->start);
+            if (WIFEXITED (u->status))
+                snprintf (state, sizeof(state), "exit %d", WEXITSTATUS (u->status));
+            else
+                snprintf (state, sizeof(state), "signal %d", WTERMSIG (u->status));
+        } else {
+            task_sample (J[k].pids[t], &ru);
+            real = ts_sec (now) - ts_sec (u->start);
+            strcpy (state, "running");
+        }
+
+        fprintf (fp, "  %-8d %-10s %8.3fs %8.3fs %8.3fs", J[k].pids[t], state,
+                 real, tv_sec (ru.ru_utime), tv_sec (ru.ru_stime));
+        print_rss (fp, ru.ru_maxrss);
+        fprintf (fp, " %8ld %8ld  %s\n", ru.ru_nvcsw, ru.ru_nivcsw, u->cmd);
+
+        if (!t || ts_sec (u->start) < first)
+            first = ts_sec (u->start);
+        if (ts_sec (u->start) + real > last)
+            last = ts_sec (u->start) + real;
+
+        user += tv_sec (ru.ru_utime);
+        sys += tv_sec (ru.ru_stime);
+        if (ru.ru_maxrss > maxrss)
+            maxrss = ru.ru_maxrss;
+        nvcsw += ru.ru_nvcsw;
+        nivcsw += ru.ru_nivcsw;
+    }
+
+    fprintf (fp, "  %-8s %-10s %8.3fs %8.3fs %8.3fs", "total", "",
+             last - first, user, sys);
+    print_rss (fp, maxrss);
+    fprintf (fp, " %8ld %8ld\n", nvcsw, nivcsw);
+}
+
+
+/* returns the job number owning pid (storing the stage number in
+ * *task), or -1 if pid belongs to no job */
+int find_task (pid_t pid, unsigned int* task)
+{
+    PidSlot* s = index_find (pid);
+
+    if (!s)
+        return -1;
+
+    if (task)
+        *task = s->task;
+
+    return s->job;
+}
+
+
+int find_job (pid_t pid)
+{
+    return find_task (pid, NULL);
+}
+
+
+/* drop a reaped pid from the index so the kernel can recycle it */
+void job_forget_pid (pid_t pid)
+{
+    index_remove (pid);
+}
+
+
+void remove_job (int k)
+{
+    PidSlot* s;
+    unsigned int i;
+
+    if (!job_valid (k))
+        return;
+
+    for (i=0; i<J[k].npids; i++) {
+        s = index_find (J[k].pids[i]);
+        if (s && s->job == k)
+            index_remove (J[k].pids[i]);
+    }
+
+    free (J[k].name);
+    free (J[k].pids);
+    free (J[k].usage);
+    job_clear (&J[k]);
+
+    freelist[nfree++] = k;
+    nlive--;
+}
+
+
+int job_valid (int k)
+{
+    return k >= 0 && k < njobs && J[k].name;
+}
+
+
+unsigned int job_count ()
+{
+    return nlive;
+}
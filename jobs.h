@@ -0,0 +1,69 @@
+#ifndef _jobs_h_
+#define _jobs_h_
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <stdio.h>
+#include <time.h>
+
+typedef enum {
+    STOPPED,
+    TERM,
+    BG,
+    FG,
+    QUEUED,                      /* waiting for admission (admit.h) */
+} JobStatus;
+
+/* called with a job's owner once the job has been reaped and removed,
+ * with the wait status of its last stage (exit 124 if it timed out) */
+typedef void (*JobDoneFn) (void* owner, int k, int status);
+
+/* what one pipeline stage has cost us, filled in by wait4() */
+typedef struct {
+    char cmd[32];                /* argv[0], for reports */
+    struct timespec start;       /* launched */
+    struct timespec end;         /* reaped (if done) */
+    struct rusage ru;
+    int status;                  /* wait status (if done) */
+    int done;
+} TaskUsage;
+
+typedef struct {
+    char* name;
+    pid_t* pids;                 /* one per pipeline stage */
+    TaskUsage* usage;            /* one per pipeline stage */
+    unsigned int npids;          /* # of pids launched so far */
+    unsigned int maxpids;        /* # of stages in the pipeline */
+    pid_t pgid;
+    unsigned int nfinishedtasks;
+    JobStatus status;
+    int timed;                   /* report usage when done (`time`) */
+    void* owner;                 /* parallel Batch or serve client that started it */
+    JobDoneFn done;              /* tells the owner it is gone */
+    int lowered;                 /* deprioritized by `bgnice` (prio.h) */
+    int cgroup;                  /* its cgroup leaf dir fd (cgroup.h), or -1 */
+    int limited;                 /* run with a `limit` prefix */
+    int frozen;                  /* by `freeze` */
+    unsigned long watch;         /* its live deadline (watchdog.h), or 0 */
+    int timedout;                /* 1: sent SIGTERM, 2: SIGKILL at deadline */
+} Job;
+
+/* The job table.  A job's number is its index into J, which grows as
+ * needed; freed slots are recycled through a free-list and a pid hash
+ * index maps any child pid back to its (job, task) in O(1). */
+extern Job* J;
+extern unsigned int njobs;       /* # of slots in J (live or free) */
+
+void new_jobs ();
+int find_availability (const char* name, unsigned int ntasks);
+void job_add_pid (int k, pid_t pid, const char* cmd);
+void job_task_done (int k, unsigned int task, int status, const struct rusage* ru);
+void job_print_usage (int k, FILE* fp);
+int find_job (pid_t pid);
+int find_task (pid_t pid, unsigned int* task);
+void job_forget_pid (pid_t pid);
+void remove_job (int k);
+int job_valid (int k);
+unsigned int job_count ();
+
+#endif /* _jobs_h_ */
@@ -0,0 +1,320 @@
+/* Process launch engines
+ *
+ * LAUNCH_FORK is the classic fork(), redirect, dup2(), execve() dance.
+ * LAUNCH_SPAWN expresses the same redirections as posix_spawn() file
+ * actions so the child never gets its own copy of the shell's address
+ * space.  The engine is picked at runtime with the `launch` builtin
+ * (or PSSH_LAUNCH=fork|spawn in the environment) so the two can be
+ * compared side by side.
+ *
+ * The parent-side cost of starting each stage of the most recent
+ * pipeline is kept so `launch` can report it.
+ **********************************************************************/
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "launch.h"
+#include "builtin.h"
+#include "stats.h"
+#include "vars.h"
+
+static LaunchMode mode = LAUNCH_FORK;
+
+static struct {
+    char cmd[32];
+    pid_t pid;
+    long ns;
+} stats[LAUNCH_MAX_STATS];
+static unsigned int nstats = 0;
+
+
+static long elapsed_ns (struct timespec* start)
+{
+    struct timespec end;
+
+    clock_gettime (CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start->tv_sec) * 1000000000L +
+           (end.tv_nsec - start->tv_nsec);
+}
+
+
+/* signals the shell catches or ignores that the child should see
+ * with their default dispositions */
+static void child_sigset (sigset_t* set)
+{
+    sigemptyset (set);
+    sigaddset (set, SIGINT);
+    sigaddset (set, SIGQUIT);
+    sigaddset (set, SIGTSTP);
+    sigaddset (set, SIGTTIN);
+    sigaddset (set, SIGTTOU);
+    sigaddset (set, SIGCHLD);
+}
+
+
+static pid_t launch_fork (Stage* S)
+{
+    pid_t pid;
+    sigset_t none;
+    int status;
+
+    // a child that returns into our code would flush our buffered
+    // output a second time
+    if (S->fn) {
+        fflush (stdout);
+        fflush (stderr);
+    }
+
+    pid = fork();
+    if (pid == -1) {
+        perror("error -- failed to fork()\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pid > 0) {
+        if (S->pgid != -1)
+            setpgid(pid, S->pgid ? S->pgid : pid);
+        return pid;
+    }
+
+    if (S->pgid != -1)
+        setpgid(0, S->pgid);
+
+    sigemptyset (&none);
+    sigprocmask (SIG_SETMASK, &none, NULL);
+
+    if (S->cpus && sched_setaffinity (0, sizeof(*S->cpus), S->cpus) == -1)
+        perror("pssh: sched_setaffinity() failed\n");
+
+    if (S->cgroup != -1)
+        cgroup_attach (S->cgroup, 0);
+
+    if (S->limits)
+        limits_rlimit (0, S->limits);
+
+    if (S->infile) {
+        infile_redirect(S->infile);
+    }
+
+    if (S->outfile) {
+        outfile_redirect(S->outfile);
+    }
+
+    if (S->in_fd != -1) {
+        if (dup2(S->in_fd, STDIN_FILENO) == -1) {
+            perror("dup2() 1 failed\n");
+            _exit(EXIT_FAILURE);
+        }
+        close(S->in_fd);
+    }
+
+    if (S->out_fd != -1) {
+        if (dup2(S->out_fd, STDOUT_FILENO) == -1) {
+            perror("dup2() 4 failed\n");
+            _exit(EXIT_FAILURE);
+        }
+        close(S->out_fd);
+    }
+
+    if (S->fn) {
+        // close-on-exec does nothing for us here, and a write end
+        // whose reader we keep open never gets EPIPE
+        if (S->next_fd != -1)
+            close(S->next_fd);
+        status = S->fn (S->arg);
+        fflush (stdout);
+        fflush (stderr);
+        _exit (status);
+    }
+
+    // _exit(), and no stdio: the shell's atexit() hooks and whatever
+    // was left in its stdout buffer at fork() time are not ours
+    execve(S->path, S->argv, S->envp ? S->envp : var_environ ());
+    dprintf(STDOUT_FILENO, "pssh: child -- failed to exec!\n");
+    _exit(EXIT_FAILURE);
+}
+
+
+/* posix_spawn() gives one error for the redirections and the exec
+ * alike, so find out which of them it was: a < file we can't read,
+ * or a > file we can't open, else the program.  The > file is only
+ * tried after the < one, as the child does, so nothing is created
+ * that the child wouldn't have. */
+static const char* spawn_culprit (Stage* S)
+{
+    int fd;
+
+    if (S->infile && access (S->infile, R_OK) == -1)
+        return S->infile;
+
+    if (S->outfile) {
+        if ((fd = open (S->outfile, O_WRONLY | O_CREAT | O_CLOEXEC, 0644)) == -1)
+            return S->outfile;
+        close (fd);
+    }
+
+    return S->argv[0];
+}
+
+
+static pid_t launch_spawn (Stage* S)
+{
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t attr;
+    sigset_t set;
+    pid_t pid;
+    int err;
+
+    posix_spawn_file_actions_init (&fa);
+    posix_spawnattr_init (&attr);
+
+    if (S->infile)
+        posix_spawn_file_actions_addopen (&fa, STDIN_FILENO, S->infile,
+                                          O_RDONLY, 0);
+
+    if (S->outfile)
+        posix_spawn_file_actions_addopen (&fa, STDOUT_FILENO, S->outfile,
+                                          O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (S->in_fd != -1) {
+        posix_spawn_file_actions_adddup2 (&fa, S->in_fd, STDIN_FILENO);
+        posix_spawn_file_actions_addclose (&fa, S->in_fd);
+    }
+
+    if (S->out_fd != -1) {
+        posix_spawn_file_actions_adddup2 (&fa, S->out_fd, STDOUT_FILENO);
+        posix_spawn_file_actions_addclose (&fa, S->out_fd);
+    }
+
+    child_sigset (&set);
+    posix_spawnattr_setsigdefault (&attr, &set);
+    sigemptyset (&set);
+    posix_spawnattr_setsigmask (&attr, &set);
+    if (S->pgid != -1)
+        posix_spawnattr_setpgroup (&attr, S->pgid);
+    posix_spawnattr_setflags (&attr, (S->pgid != -1 ? POSIX_SPAWN_SETPGROUP : 0) |
+                                     POSIX_SPAWN_SETSIGDEF |
+                                     POSIX_SPAWN_SETSIGMASK);
+
+    err = posix_spawn (&pid, S->path, &fa, &attr, S->argv,
+                       S->envp ? S->envp : var_environ ());
+
+    posix_spawnattr_destroy (&attr);
+    posix_spawn_file_actions_destroy (&fa);
+
+    if (err) {
+        printf("pssh: %s: %s\n", spawn_culprit (S), strerror(err));
+        return -1;
+    }
+
+    /* posix_spawn() has no affinity attribute, so the child starts out
+     * on our CPUs and is moved as soon as we get it back */
+    if (S->cpus && sched_setaffinity (pid, sizeof(*S->cpus), S->cpus) == -1)
+        perror("pssh: sched_setaffinity() failed\n");
+
+    /* nor a cgroup or rlimit one (CLONE_INTO_CGROUP is clone3() only) */
+    if (S->cgroup != -1)
+        cgroup_attach (S->cgroup, pid);
+
+    if (S->limits)
+        limits_rlimit (pid, S->limits);
+
+    return pid;
+}
+
+
+/* Starts the program described by S and returns its pid in the
+ * parent.  -1 is returned if the stage could not be started (only
+ * possible with LAUNCH_SPAWN; the fork engine reports redirection and
+ * exec failures from the child instead). */
+pid_t launch_stage (Stage* S)
+{
+    struct timespec start;
+    pid_t pid;
+    long ns;
+
+    // don't let the child inherit (or the terminal reorder) our
+    // buffered output
+    fflush(stdout);
+
+    clock_gettime (CLOCK_MONOTONIC, &start);
+
+    if (mode == LAUNCH_SPAWN && !S->fn)
+        pid = launch_spawn (S);
+    else
+        pid = launch_fork (S);
+
+    ns = elapsed_ns (&start);
+
+    if (pid == -1) {
+        stats_inc (STAT_EXEC_FAILURES);
+    } else {
+        stats_inc (STAT_LAUNCHES);
+        stats_observe (HIST_LAUNCH, ns / 1000);
+    }
+
+    if (nstats < LAUNCH_MAX_STATS) {
+        snprintf (stats[nstats].cmd, sizeof(stats[nstats].cmd), "%s", S->argv[0]);
+        stats[nstats].pid = pid;
+        stats[nstats].ns = ns;
+        nstats++;
+    }
+
+    return pid;
+}
+
+
+/* pick the initial engine from PSSH_LAUNCH */
+void launch_init ()
+{
+    char* env = getenv ("PSSH_LAUNCH");
+
+    if (env && !strcmp (env, "spawn"))
+        mode = LAUNCH_SPAWN;
+}
+
+
+void launch_set_mode (LaunchMode m)
+{
+    mode = m;
+}
+
+
+LaunchMode launch_get_mode ()
+{
+    return mode;
+}
+
+
+const char* launch_mode_name (LaunchMode m)
+{
+    return m == LAUNCH_SPAWN ? "spawn" : "fork";
+}
+
+
+/* forget the per-stage timings of the previous pipeline */
+void launch_begin_pipeline ()
+{
+    nstats = 0;
+}
+
+
+void launch_print_stats ()
+{
+    unsigned int i;
+
+    printf("launch engine: %s\n", launch_mode_name (mode));
+
+    for (i=0; i<nstats; i++)
+        printf("  stage %u: %-16s pid %-8d %8.1f us\n", i, stats[i].cmd,
+               stats[i].pid, stats[i].ns / 1000.0);
+}
@@ -0,0 +1,55 @@
+#ifndef _launch_h_
+#define _launch_h_
+
+#include <sys/types.h>
+#include <sched.h>       /* cpu_set_t needs _GNU_SOURCE */
+
+#include "cgroup.h"
+
+/* Process launch engines
+ *
+ * A Stage describes everything a single pipeline stage needs set up
+ * before its program starts running.  launch_stage() can build that
+ * either by fork()ing and doing the plumbing in the child, or by
+ * handing the whole description to posix_spawn() as file actions and
+ * spawn attributes (which glibc implements with CLONE_VM|CLONE_VFORK,
+ * so the shell's page tables are never copied). */
+
+typedef enum {
+    LAUNCH_FORK,
+    LAUNCH_SPAWN,
+} LaunchMode;
+
+typedef int (*StageFn) (void* arg);
+
+typedef struct {
+    const char* path;   /* resolved executable */
+    char** argv;
+    char** envp;        /* its environment (NULL: var_environ ()) */
+    char* infile;       /* '< infile', or NULL */
+    char* outfile;      /* '> outfile', or NULL */
+    int in_fd;          /* becomes stdin  (-1 to inherit) */
+    int out_fd;         /* becomes stdout (-1 to inherit) */
+    pid_t pgid;         /* process group to join (0: new group,
+                         *                     -1: stay in ours) */
+    cpu_set_t* cpus;    /* CPUs to run on (NULL: inherit) */
+    int cgroup;         /* cgroup leaf dir fd to join (-1: stay in ours) */
+    const Limits* limits; /* rlimits to apply (NULL: none) */
+    StageFn fn;         /* run fn(arg) in the child instead of exec'ing
+                         * path (a builtin in a pipeline); always forks */
+    void* arg;
+    int next_fd;        /* the read end of out_fd's pipe, which a child
+                         * that runs fn has to close itself (-1: none) */
+} Stage;
+
+#define LAUNCH_MAX_STATS 64
+
+void launch_init ();
+pid_t launch_stage (Stage* S);
+void launch_set_mode (LaunchMode mode);
+LaunchMode launch_get_mode ();
+const char* launch_mode_name (LaunchMode mode);
+void launch_begin_pipeline ();
+void launch_print_stats ();
+
+#endif /* _launch_h_ */
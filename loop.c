@@ -0,0 +1,132 @@
+/* Central event loop (epoll)
+ *
+ * Sources are indexed by fd.  A source can be suspended without being
+ * forgotten, which is how terminal input is kept away from the shell
+ * while a foreground job owns the terminal.
+ **********************************************************************/
+#include <sys/epoll.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "loop.h"
+
+#define LOOP_MAX_EVENTS 64
+
+typedef struct {
+    LoopFn fn;
+    void* data;
+    unsigned int events;
+} Source;
+
+static int epfd = -1;
+static Source* sources = NULL;
+static int nsources = 0;
+
+
+/* Called again in a forked subshell, which wants a loop of its own:
+ * the old epoll instance is shared with the parent, so it is only
+ * closed (not emptied) and its sources are forgotten. */
+void loop_init ()
+{
+    if (epfd != -1) {
+        close (epfd);
+        memset (sources, 0, nsources * sizeof(*sources));
+    }
+
+    epfd = epoll_create1 (EPOLL_CLOEXEC);
+    if (epfd == -1) {
+        perror("epoll_create1() failed\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+static void loop_ctl (int op, int fd, unsigned int events)
+{
+    struct epoll_event ev;
+
+    memset (&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+
+    if (epoll_ctl (epfd, op, fd, &ev) == -1) {
+        perror("epoll_ctl() failed\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+void loop_add (int fd, unsigned int events, LoopFn fn, void* data)
+{
+    int n;
+
+    if (fd >= nsources) {
+        n = nsources ? nsources : 16;
+        while (n <= fd)
+            n *= 2;
+
+        sources = realloc (sources, n * sizeof(*sources));
+        memset (&sources[nsources], 0, (n - nsources) * sizeof(*sources));
+        nsources = n;
+    }
+
+    sources[fd].fn = fn;
+    sources[fd].data = data;
+    sources[fd].events = events;
+
+    loop_ctl (EPOLL_CTL_ADD, fd, events);
+}
+
+
+void loop_del (int fd)
+{
+    if (fd >= nsources || !sources[fd].fn)
+        return;
+
+    sources[fd].fn = NULL;
+    epoll_ctl (epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+
+/* stop reporting events for fd until loop_resume() */
+void loop_suspend (int fd)
+{
+    loop_ctl (EPOLL_CTL_MOD, fd, 0);
+}
+
+
+void loop_resume (int fd)
+{
+    loop_ctl (EPOLL_CTL_MOD, fd, sources[fd].events);
+}
+
+
+/* waits up to timeout ms (-1: forever) for events and runs their
+ * callbacks.  Returns the number of events handled. */
+int loop_once (int timeout)
+{
+    struct epoll_event ev[LOOP_MAX_EVENTS];
+    int i, n, fd;
+
+    n = epoll_wait (epfd, ev, LOOP_MAX_EVENTS, timeout);
+    if (n == -1) {
+        if (errno == EINTR)
+            return 0;
+
+        perror("epoll_wait() failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i=0; i<n; i++) {
+        fd = ev[i].data.fd;
+
+        /* an earlier callback may have removed this source */
+        if (fd < nsources && sources[fd].fn)
+            sources[fd].fn (fd, ev[i].events, sources[fd].data);
+    }
+
+    return n;
+}
@@ -0,0 +1,20 @@
+#ifndef _loop_h_
+#define _loop_h_
+
+/* Central event loop
+ *
+ * Everything the shell waits on (terminal input, child state changes
+ * delivered through a signalfd, ...) is registered here, and the
+ * callbacks are run synchronously from loop_once(), never from signal
+ * context. */
+
+typedef void (*LoopFn) (int fd, unsigned int events, void* data);
+
+void loop_init ();
+void loop_add (int fd, unsigned int events, LoopFn fn, void* data);
+void loop_del (int fd);
+void loop_suspend (int fd);
+void loop_resume (int fd);
+int loop_once (int timeout);
+
+#endif /* _loop_h_ */
@@ -0,0 +1,420 @@
+/* Bounded parallel fan-out
+ *
+ * A Batch owns the expanded argument list and the set of in-flight
+ * jobs.  Jobs it starts carry the Batch as their owner, and the
+ * SIGCHLD handler calls parallel_reaped() once such a job is gone,
+ * which is what starts the next one.  A foreground `parallel` just
+ * services the event loop until the Batch is idle; a background one
+ * is detached and frees itself when its last job is reaped.
+ **********************************************************************/
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "parallel.h"
+#include "arena.h"
+#include "jobs.h"
+#include "hash.h"
+#include "launch.h"
+#include "input.h"
+
+typedef struct {
+    int job;                 /* -1: free */
+    unsigned int arg;
+} Slot;
+
+struct Batch {
+    Arena* A;                /* template and arguments */
+    char** tmpl;             /* command words, NULL terminated */
+    char** args;
+    unsigned int nargs;
+    unsigned int next;       /* next argument to start */
+    Slot* slots;
+    unsigned int nslots;     /* -j */
+    unsigned int running;
+    unsigned int failed;
+    int keep_order;          /* -k */
+    int* out;                /* -k: memfd per argument (-1: none) */
+    char* done;              /* -k: finished, per argument */
+    unsigned int next_out;   /* -k: next argument to copy out */
+    int null_fd;             /* children's stdin */
+    int new_pgrp;
+    int detached;            /* free when idle */
+};
+
+
+static void usage ()
+{
+    printf("Usage: parallel [-j N] [-k] command [args] [::: arg ...]\n");
+}
+
+
+static unsigned int count_words (char** w)
+{
+    unsigned int n = 0;
+
+    while (w[n])
+        n++;
+
+    return n;
+}
+
+
+/* arguments come from a `<` file or stdin when there's no ::: */
+static void read_args (Batch* b, const char* infile, char*** v, unsigned int* size)
+{
+    Reader* R;
+    char* line;
+    int fd = STDIN_FILENO;
+
+    if (infile && (fd = open(infile, O_RDONLY | O_CLOEXEC)) == -1) {
+        perror("could not read input file\n");
+        return;
+    }
+
+    R = reader_new(fd);
+
+    while ((line = reader_getline(R))) {
+        if (!*line)
+            continue;
+
+        if (b->nargs == *size) {
+            *size = *size ? 2 * *size : 64;
+            *v = realloc(*v, *size * sizeof(**v));
+        }
+        (*v)[b->nargs++] = arena_strdup(b->A, line);
+    }
+
+    if (fd == STDIN_FILENO)
+        R->fd = -1;     // not ours to close
+    reader_destroy(&R);
+}
+
+
+/* substitutes every "{}" in word with arg */
+static char* expand (Arena* A, const char* word, const char* arg)
+{
+    const char* s;
+    char* out;
+    char* w;
+    size_t n = 0, alen = strlen(arg);
+
+    for (s=word; (s = strstr(s, "{}")); s += 2)
+        n++;
+
+    if (!n)
+        return (char*) word;
+
+    out = w = arena_alloc(A, strlen(word) + n * alen + 1);
+
+    for (s=word; *s; ) {
+        if (s[0] == '{' && s[1] == '}') {
+            memcpy(w, arg, alen);
+            w += alen;
+            s += 2;
+        } else {
+            *w++ = *s++;
+        }
+    }
+    *w = '\0';
+
+    return out;
+}
+
+
+/* copies finished -k output to stdout in argument order */
+static void flush_ordered (Batch* b)
+{
+    char buf[65536];
+    ssize_t n;
+    int fd;
+
+    fflush(stdout);
+
+    while (b->next_out < b->nargs && b->done[b->next_out]) {
+        fd = b->out[b->next_out];
+
+        if (fd != -1) {
+            lseek(fd, 0, SEEK_SET);
+            while ((n = read(fd, buf, sizeof(buf))) > 0)
+                if (write(STDOUT_FILENO, buf, n) != n)
+                    break;
+            close(fd);
+            b->out[b->next_out] = -1;
+        }
+
+        b->next_out++;
+    }
+}
+
+
+static void finish (Batch* b, unsigned int arg, int ok)
+{
+    if (!ok)
+        b->failed++;
+
+    if (b->keep_order) {
+        b->done[arg] = 1;
+        flush_ordered(b);
+    }
+}
+
+
+/* starts argument b->next in slot s; returns 0 if it couldn't be */
+static int start (Batch* b, Slot* s)
+{
+    unsigned int i, n = count_words(b->tmpl);
+    unsigned int arg = b->next++;
+    int appended = 1;
+    char** argv;
+    char* name;
+    const char* path;
+    size_t len = 0;
+    Stage S;
+    pid_t pid;
+    int k;
+
+    argv = arena_alloc(b->A, (n+2) * sizeof(*argv));
+
+    for (i=0; i<n; i++) {
+        argv[i] = expand(b->A, b->tmpl[i], b->args[arg]);
+        if (argv[i] != b->tmpl[i])
+            appended = 0;
+    }
+    if (appended)
+        argv[n++] = b->args[arg];
+    argv[n] = NULL;
+
+    for (i=0; i<n; i++)
+        len += strlen(argv[i]) + 1;
+    name = arena_alloc(b->A, len);
+    for (i=0, *name='\0'; i<n; i++) {
+        if (i)
+            strcat(name, " ");
+        strcat(name, argv[i]);
+    }
+
+    if (!(path = hash_lookup(argv[0]))) {
+        printf("pssh: command not found: %s\n", argv[0]);
+        finish(b, arg, 0);
+        return 0;
+    }
+
+    if (b->keep_order) {
+        b->out[arg] = memfd_create("parallel", MFD_CLOEXEC);
+        if (b->out[arg] == -1) {
+            perror("memfd_create() failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    S.path = path;
+    S.argv = argv;
+    S.envp = NULL;
+    S.infile = NULL;
+    S.outfile = NULL;
+    S.in_fd = b->null_fd;
+    S.out_fd = b->keep_order ? b->out[arg] : -1;
+    S.pgid = b->new_pgrp ? 0 : -1;
+    S.cpus = NULL;
+    S.cgroup = -1;
+    S.limits = NULL;
+    S.fn = NULL;
+    S.next_fd = -1;
+
+    pid = launch_stage(&S);
+    if (pid == -1) {
+        finish(b, arg, 0);
+        return 0;
+    }
+
+    k = find_availability(name, 1);
+    job_add_pid(k, pid, argv[0]);
+    J[k].pgid = pid;
+    J[k].status = BG;
+    J[k].owner = b;
+    J[k].done = parallel_reaped;
+
+    s->job = k;
+    s->arg = arg;
+    b->running++;
+
+    return 1;
+}
+
+
+/* fills free slots while there are arguments left */
+static void advance (Batch* b)
+{
+    unsigned int i;
+
+    for (i=0; i<b->nslots && b->next < b->nargs; i++)
+        if (b->slots[i].job == -1)
+            while (b->next < b->nargs && !start(b, &b->slots[i]));
+}
+
+
+/* parses the builtin's words and starts the first N jobs */
+Batch* parallel_new (Task T, const char* infile, int new_pgrp)
+{
+    Batch* b;
+    char** w = T.argv + 1;
+    char** sep;
+    unsigned int i, size = 0;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int keep_order = 0;
+
+    for (; *w && (*w)[0] == '-' && (*w)[1]; w++) {
+        if (!strcmp(*w, "-k")) {
+            keep_order = 1;
+        }
+        else if (!strcmp(*w, "-j") && w[1] && atoi(w[1]) > 0) {
+            jobs = atoi(*++w);
+        }
+        else if (!strncmp(*w, "-j", 2) && atoi(*w + 2) > 0) {
+            jobs = atoi(*w + 2);
+        }
+        else {
+            usage();
+            return NULL;
+        }
+    }
+
+    for (sep=w; *sep && strcmp(*sep, ":::"); sep++);
+
+    if (sep == w) {
+        usage();
+        return NULL;
+    }
+
+    b = calloc(1, sizeof(*b));
+    b->A = arena_new(0);
+    b->keep_order = keep_order;
+    b->new_pgrp = new_pgrp;
+    b->nslots = jobs > 0 ? jobs : 1;
+
+    b->tmpl = arena_alloc(b->A, (sep - w + 1) * sizeof(*b->tmpl));
+    for (i=0; w+i < sep; i++)
+        b->tmpl[i] = arena_strdup(b->A, w[i]);
+    b->tmpl[i] = NULL;
+
+    if (*sep) {
+        b->nargs = count_words(sep + 1);
+        b->args = malloc((b->nargs ? b->nargs : 1) * sizeof(*b->args));
+        for (i=0; i<b->nargs; i++)
+            b->args[i] = arena_strdup(b->A, sep[1+i]);
+    } else {
+        read_args(b, infile, &b->args, &size);
+    }
+
+    b->slots = malloc(b->nslots * sizeof(*b->slots));
+    for (i=0; i<b->nslots; i++)
+        b->slots[i].job = -1;
+
+    if (keep_order) {
+        b->out = malloc((b->nargs ? b->nargs : 1) * sizeof(*b->out));
+        b->done = calloc(b->nargs ? b->nargs : 1, 1);
+        for (i=0; i<b->nargs; i++)
+            b->out[i] = -1;
+    }
+
+    b->null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    advance(b);
+
+    return b;
+}
+
+
+/* job k, started by b, is gone; status is its wait status */
+void parallel_reaped (void* owner, int k, int status)
+{
+    Batch* b = owner;
+    unsigned int i;
+
+    for (i=0; i<b->nslots; i++) {
+        if (b->slots[i].job == k) {
+            b->slots[i].job = -1;
+            b->running--;
+            finish(b, b->slots[i].arg, WIFEXITED(status) && !WEXITSTATUS(status));
+            break;
+        }
+    }
+
+    advance(b);
+
+    if (b->detached && !parallel_busy(b))
+        parallel_free(b);
+}
+
+
+int parallel_busy (Batch* b)
+{
+    return b->running || b->next < b->nargs;
+}
+
+
+int parallel_failed (Batch* b)
+{
+    return b->failed;
+}
+
+
+/* starts nothing more and terminates what is running */
+void parallel_cancel (Batch* b)
+{
+    unsigned int i;
+
+    b->failed += b->nargs - b->next;
+    b->next = b->nargs;
+
+    for (i=0; i<b->nslots; i++)
+        if (b->slots[i].job != -1)
+            kill(J[b->slots[i].job].pids[0], SIGTERM);
+}
+
+
+/* let a background batch free itself once idle */
+void parallel_detach (Batch* b)
+{
+    if (parallel_busy(b))
+        b->detached = 1;
+    else
+        parallel_free(b);
+}
+
+
+void parallel_free (Batch* b)
+{
+    unsigned int i;
+
+    if (b->keep_order) {
+        for (i=0; i<b->nargs; i++)
+            if (b->out[i] != -1)
+                close(b->out[i]);
+        free(b->out);
+        free(b->done);
+    }
+
+    for (i=0; i<b->nslots; i++) {
+        if (b->slots[i].job != -1) {
+            J[b->slots[i].job].owner = NULL;
+            J[b->slots[i].job].done = NULL;
+        }
+    }
+
+    if (b->null_fd != -1)
+        close(b->null_fd);
+
+    free(b->slots);
+    free(b->args);
+    arena_destroy(&b->A);
+    free(b);
+}
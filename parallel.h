@@ -0,0 +1,29 @@
+#ifndef _parallel_h_
+#define _parallel_h_
+
+#include "parse.h"
+
+/* Bounded parallel fan-out (the `parallel` builtin)
+ *
+ *   parallel [-j N] [-k] command [args] [::: arg ...]
+ *
+ * Runs `command` once per argument, with every "{}" in its words
+ * replaced by the argument (or the argument appended if there is no
+ * "{}").  Arguments come after ":::", or one per line from the '<'
+ * infile or stdin.  At most N (default: online CPUs) run at once, and
+ * the next one is started from the SIGCHLD path as soon as one is
+ * reaped.  Every child is an ordinary background job, so jobs, kill
+ * and fg work on them.  With -k, each child's stdout goes to a memfd
+ * and is copied out in argument order. */
+
+typedef struct Batch Batch;
+
+Batch* parallel_new (Task T, const char* infile, int new_pgrp);
+void parallel_reaped (void* owner, int k, int status);
+int parallel_busy (Batch* b);
+int parallel_failed (Batch* b);
+void parallel_cancel (Batch* b);
+void parallel_detach (Batch* b);
+void parallel_free (Batch* b);
+
+#endif /* _parallel_h_ */
@@ -1,462 +1,1171 @@
-/* Author: James A. Shackleford
- *
- * A simple shell command parser.  If you are familiar with
- * using bash, zsh, tcsh, etc. then you already understand
- * what this does.
- *
- * Parses the following syntax:
- *
- *  ~$ command_1 [< infile] [| command_n]* [> outfile] [&]
- *
- * and produces a correspondingly populated Parse structure on the heap
- *
- * Note:
- *  - Items in brackets [ ] are optional
- *  - Items in starred brackets [ ]* are optional but can be repeated
- *  - Non-bracketed items are required
- *
- * Examples of valid syntax:
- *
- *     ~$ echo "foo!!!!!!!!" > foo.txt
- *     ~$ wc -l < somefile.txt > numlines.txt
- *     ~$ ls -lh | grep 8.*K | wc -l
- *     ~$ gvim &
- **********************************************************************/
-#include <ctype.h>
-#include <string.h>
-#include <stdio.h>
-#include <stdlib.h>
-
-#include "parse.h"
-
-
-typedef struct {
-    char* cmd;
-    char** argv;
-    char* input_fn;
-    char* output_fn;
-} Unit;
-
-static char ops[] = {'>', '<', '|', '\0'};
-
-
-static void trim (char* s)
-{
-    size_t start, end;
-
-    if (!s)
-        return;
-
-    end = strlen (s);
-
-    for (start=0; isspace (s[start]); ++start);
-
-    if (s[start]) {
-        while (end > 0 && isspace(s[end-1]))
-            --end;
-
-        memmove(s, &s[start], end-start);
-    }
-    s[end-start] = '\0';
-}
-
-
-static int is_background (char* cmdline)
-{
-    size_t last;
-    int ret = 0;
-
-    trim (cmdline);
-    last = strlen (cmdline) - 1;
-
-    if ('&' == cmdline[last]) {
-        cmdline[last] = '\0';
-        ret = 1;
-    }
-
-    return ret;
-}
-
-
-static int is_empty (char* cmdline)
-{
-    trim (cmdline);
-
-    if (!cmdline || !strlen(cmdline))
-        return 1;
-
-    return 0;
-}
-
-
-static int is_op (char c)
-{
-    int i;
-
-    for (i=0; ops[i]; i++)
-        if (c == ops[i])
-            return 1;
-
-    return 0;
-}
-
-
-static int has_trailing (char needle, char* haystack)
-{
-    trim (haystack);
-
-    if (haystack[0] == needle ||
-        haystack[strlen(haystack)-1] == needle) {
-        return 1;
-    }
-
-    return 0;
-}
-
-
-static unsigned int count_char (char needle, char* haystack)
-{
-    unsigned int c = 0;
-
-    while (*haystack)
-        if (*haystack++ == needle)
-            c++;
-
-    return c;
-}
-
-
-static unsigned int count_args (char* unit)
-{
-    unsigned int n = 0;
-
-    for (; *unit; unit++) {
-        if (isspace((unsigned char)(*unit))) {
-            while (isspace((unsigned char)(*++unit)));
-            if (*unit == '\"') {
-                do {
-                    unit++;
-                } while (*unit != '\"');
-                n++;
-            } else if (*unit == '\'') {
-                do {
-                    unit++;
-                } while (*unit != '\'');
-                n++;
-            } else if (!isspace((unsigned char)(*unit))) {
-                n++;
-            }
-        }
-    }
-
-    return n;
-}
-
-
-static int valid_syntax (Parse* P, Unit* U, int i)
-{
-    if (!U)
-        return 0;
-
-    if (U->input_fn && ((i != 0) || is_empty(U->input_fn)))
-        return 0;
-
-    if (U->output_fn && ((i != P->ntasks-1) || is_empty(U->output_fn)))
-        return 0;
-
-    if (!U->cmd || !*U->cmd)
-        return 0;
-
-
-    return 1;
-}
-
-
-static char* parse_unary (char op, char* unit)
-{
-    char *start, *end, *arg;
-
-    for (start=NULL; *unit; unit++)
-        if (*unit == op) {
-           start = ++unit;
-           break;
-        }
-
-    if (!start)
-        return NULL;
-
-    for (end=start; *end; end++)
-        if (is_op(*end))
-           break;
-
-    arg = strndup (start, end - start);
-    arg[end - start] = '\0';
-    trim (arg);
-
-    start--;
-    memset (start, ' ', end - start);
-
-    return arg;
-}
-
-
-static char* argtok (char* str, char** state)
-{
-    char* ret;
-    char seek_ch;
-
-    if (!str)
-        str = *state;
-
-    if (!*str)
-        return NULL;
-
-    trim(str);
-
-    seek_ch = *str == '\"' ? '\"' :
-              *str == '\'' ? '\'' :
-              ' ';
-
-    ret = seek_ch == ' ' ? str : ++str;
-
-    str = strchr (str, seek_ch);
-
-    if (str)
-        *str = '\0';
-
-    *state = str ? ++str : (ret + strlen(ret));
-
-    return ret;
-}
-
-
-static void parse_command (Unit* U, char* unit)
-{
-    unsigned int argc, n;
-    char *str, *token, *state;
-
-    trim (unit);
-    argc = count_args (unit)+1; /* +1 for command */
-
-    U->argv = malloc ((argc+1) * sizeof(*U->argv));
-    U->argv[argc] = NULL;
-
-    for (n=0, str=unit; ; n++, str=NULL) {
-        token = argtok (str, &state);
-        if (!token)
-            break;
-
-        U->argv[n] = strdup (token);
-    }
-
-    U->cmd = U->argv[0];
-}
-
-
-static Unit* parse_unit (char* unit)
-{
-    Unit* U;
-
-    int infiles = count_char ('<', unit);
-    int outfiles = count_char ('>', unit);
-
-    if (infiles > 1 || outfiles > 1)
-        return NULL;
-
-    if (count_char ('\'', unit) % 2)
-        return NULL;
-
-    if (count_char ('\"', unit) % 2)
-        return NULL;
-
-    U = malloc (sizeof(*U));
-    U->cmd = NULL;
-    U->argv = NULL;
-
-    if (infiles)
-        U->input_fn = parse_unary ('<', unit);
-    else
-        U->input_fn = NULL;
-
-    if (outfiles)
-        U->output_fn = parse_unary ('>', unit);
-    else
-        U->output_fn = NULL;
-
-    parse_command (U, unit);
-
-    return U;
-}
-
-
-static void unit_destroy (Unit** U)
-{
-    int i;
-
-    if (!*U)
-        return;
-
-    if ((*U)->input_fn)
-        free ((*U)->input_fn);
-
-    if ((*U)->output_fn)
-        free ((*U)->output_fn);
-
-    if ((*U)->argv) {
-        for (i=0; (*U)->argv[i]; i++)
-            free ((*U)->argv[i]);
-        free ((*U)->argv);
-    }
-
-    free (*U);
-    *U = NULL;
-}
-
-
-static void parse_add_unit (Parse* P, Unit* U, int i)
-{
-    if (!valid_syntax (P, U, i)) {
-        P->invalid_syntax = 1;
-        goto out;
-    }
-
-    P->tasks[i].cmd = U->cmd;
-
-    if (U->argv) {
-        P->tasks[i].argv = U->argv;
-        U->argv = NULL;
-    }
-
-    if (U->input_fn && (i == 0)) {
-        P->infile = U->input_fn;
-        U->input_fn = NULL;
-    }
-
-    if (U->output_fn && (i == P->ntasks-1)) {
-        P->outfile = U->output_fn;
-        U->output_fn = NULL;
-    }
-
-out:
-    unit_destroy (&U);
-}
-
-
-static Parse* parse_new ()
-{
-    Parse* P = malloc (sizeof(*P));
-
-    P->tasks = NULL;
-    P->ntasks = 0;
-    P->infile = NULL;
-    P->outfile = NULL;
-    P->background = 0;
-    P->invalid_syntax = 0;
-
-    return P;
-}
-
-
-static void parse_init (Parse* P, char* cmdline)
-{
-    P->background = is_background (cmdline);
-
-    if (count_char ('&', cmdline)) {
-        P->invalid_syntax = 1;
-        return;
-    }
-
-    if (has_trailing ('|', cmdline)) {
-        P->invalid_syntax = 1;
-        return;
-    }
-
-    P->ntasks = count_char ('|', cmdline) + 1;
-    P->tasks = malloc (P->ntasks * sizeof (*P->tasks));
-    memset (P->tasks, 0, P->ntasks * sizeof (*P->tasks));
-}
-
-
-void parse_destroy (Parse** P)
-{
-    int i, j;
-
-    if (!*P)
-        return;
-
-    if ((*P)->infile)
-        free ((*P)->infile);
-
-    if ((*P)->outfile)
-        free ((*P)->outfile);
-
-    if ((*P)->tasks) {
-        for (i=0; i<(*P)->ntasks; i++) {
-            if ((*P)->tasks[i].argv) {
-                for (j=0; (*P)->tasks[i].argv[j]; j++)
-                    free ((*P)->tasks[i].argv[j]);
-
-                free ((*P)->tasks[i].argv);
-            }
-        }
-        free ((*P)->tasks);
-    }
-
-    free (*P);
-    *P = NULL;
-}
-
-
-Parse* parse_cmdline (char* cmdline)
-{
-    char *str, *token, *state;
-    int i;
-    Unit* U;
-    Parse* P;
-
-    if (is_empty (cmdline))
-        return NULL;
-
-    P = parse_new ();
-    parse_init (P, cmdline);
-
-    for (i=0, str=cmdline; !P->invalid_syntax; i++, str=NULL) {
-        token = strtok_r (str, "|", &state);
-        if (!token)
-            break;
-
-        U = parse_unit (token);
-
-        parse_add_unit (P, U, i);
-    }
-
-    return P;
-}
-
-
-void parse_debug (Parse* P)
-{
-    int i, j;
-
-    fprintf (stderr, "==[ DEBUG: PARSE ]==================================\n");
-    fprintf (stderr, "Run in Background? %s\n", P->background ? "Yes" : "No");
-
-    if (P->infile)
-        fprintf (stderr, "infile: %s\n", P->infile);
-
-    if (P->outfile)
-        fprintf (stderr, "outfile: %s\n", P->outfile);
-
-    fprintf (stderr, "ntasks: %i\n", P->ntasks);
-
-    for (i=0; i<P->ntasks; i++) {
-        fprintf (stderr, "Task %i\n", i);
-        fprintf (stderr, "  - cmd: [%s]\n", P->tasks[i].cmd);
-
-        if (P->tasks[i].argv)
-            for (j=0; P->tasks[i].argv[j]; j++)
-                fprintf (stderr, "    + arg[%i]: [%s]\n", j, P->tasks[i].argv[j]);
-    }
-
-    fprintf (stderr, "==================================[ DEBUG: PARSE ]==\n");
-}
\ No newline at end of file
+/* Author: James A. Shackleford
+ *
+ * A simple shell command parser.  If you are familiar with
+ * using bash, zsh, tcsh, etc. then you already understand
+ * what this does.
+ *
+ * Parses the following syntax:
+ *
+ *  ~$ pipeline [(; | & | && | || | newline) pipeline]* [; | &]
+ *
+ * where each pipeline is
+ *
+ *  [!] [time] [limit key=value ...] [timeout duration] [@cpus=list] command_1 [< infile] [| [@cpus=list] command_n]* [> outfile] [&]
+ *
+ * and any command may instead be a compound one:
+ *
+ *  ( list )                          run in a subshell
+ *  { list; }                         a group
+ *  if list; then list; [elif list; then list;]* [else list;] fi
+ *  while list; do list; done         (and until)
+ *  for name [in word ...]; do list; done
+ *  name () compound-command          (or function name compound-command)
+ *
+ * Words may hold $name, ${name}, $?, $#, $$, $@, $*, $0-$9 and
+ * $(( arithmetic )).  NAME=value words in front of a command go into
+ * its environment, and on their own set shell variables.  The
+ * result is a Script: a tree of Nodes over the pipelines (see parse.h),
+ * each a correspondingly populated Parse structure, all in an Arena.
+ *
+ * The line is copied once into the caller's Arena and lexed there in a
+ * single pass into a stream of tokens.  Words are unquoted in place,
+ * so every argv entry (and the infile/outfile names) point into that
+ * copy instead of being duplicated one by one.  Everything else is
+ * carved out of the same Arena; the caller's buffer is left alone.  Quoting works the usual
+ * way ('...' is literal, "..." allows \" \\ \$ and $ expansions, and \
+ * escapes any character outside quotes), so operators inside quotes
+ * are just text.  The tokens are then parsed by recursive descent;
+ * the reserved words (if, then, do, {, ...) are only recognized
+ * unquoted and where a command can start.  Expansions are compiled
+ * here, once, and only evaluated when the command runs (see expand.h),
+ * which is what makes running a loop body again cheap.
+ *
+ * Note:
+ *  - Items in brackets [ ] are optional
+ *  - Items in starred brackets [ ]* are optional but can be repeated
+ *  - Non-bracketed items are required
+ *
+ * Examples of valid syntax:
+ *
+ *     ~$ echo "foo!!!!!!!!" > foo.txt
+ *     ~$ wc -l < somefile.txt > numlines.txt
+ *     ~$ ls -lh | grep 8.*K | wc -l
+ *     ~$ gvim &
+ *     ~$ make && ./test || echo failed; make clean
+ *     ~$ (cd /tmp && ls) | wc -l
+ *     ~$ for f in a.log b.log; do gzip $f; done
+ *     ~$ i=0; while [ $i -lt 10 ]; do i=$((i+1)); done
+ **********************************************************************/
+#include <ctype.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "parse.h"
+#include "arena.h"
+#include "arith.h"
+#include "vars.h"
+
+
+typedef enum {
+    TOK_WORD,
+    TOK_PIPE,     /* | */
+    TOK_IN,       /* < */
+    TOK_OUT,      /* > */
+    TOK_AMP,      /* & */
+    TOK_AND,      /* && */
+    TOK_OR,       /* || */
+    TOK_SEMI,     /* ; */
+    TOK_LPAREN,   /* ( */
+    TOK_RPAREN,   /* ) */
+    TOK_NEWLINE,  /* \n */
+} TokenType;
+
+typedef struct {
+    TokenType type;
+    char* word;   /* TOK_WORD: unquoted, '\0' terminated, in place */
+    unsigned int start, end;  /* its bytes in the line */
+    Word* w;      /* TOK_WORD: its $ expansions (NULL: none) */
+    int lit;      /* offset in word of its first quoted byte (-1: none) */
+} Token;
+
+typedef struct {
+    Arena* A;
+    const char* src;     /* the caller's line, for source text */
+    char* copy;          /* ours, lexed in place */
+    Token* toks;
+    unsigned int ntoks;
+    unsigned int size;
+    unsigned int pos;    /* the parser's cursor into toks */
+    Parse** pipes;       /* Script.pipelines */
+    unsigned int npipes;
+    unsigned int pipes_size;
+    int invalid;
+    int incomplete;
+    char* word;          /* the word being lexed */
+    unsigned int* quoted;  /* where its quoted wildcards are, in order */
+    unsigned int nquoted;
+    unsigned int quoted_size;
+} Parser;
+
+/* the $ expansions of the word being lexed */
+typedef struct {
+    WordPart* parts;
+    unsigned int n;
+    unsigned int size;
+} Parts;
+
+
+static void lex_push (Parser* L, TokenType type, char* word,
+                      unsigned int start, unsigned int end)
+{
+    Token* old = L->toks;
+
+    if (L->ntoks == L->size) {
+        L->size = L->size ? 2*L->size : 32;
+        L->toks = arena_alloc (L->A, L->size * sizeof(*L->toks));
+        if (old)
+            memcpy (L->toks, old, L->ntoks * sizeof(*L->toks));
+    }
+
+    L->toks[L->ntoks].type = type;
+    L->toks[L->ntoks].word = word;
+    L->toks[L->ntoks].start = start;
+    L->toks[L->ntoks].end = end;
+    L->toks[L->ntoks].w = NULL;
+    L->toks[L->ntoks].lit = -1;
+    L->ntoks++;
+}
+
+
+static int is_op (char c)
+{
+    return c == '|' || c == '<' || c == '>' || c == '&' ||
+           c == ';' || c == '(' || c == ')';
+}
+
+
+static WordPart* part_push (Parser* L, Parts* W, PartType type, char* text, int quoted)
+{
+    WordPart* old = W->parts;
+
+    if (W->n == W->size) {
+        W->size = W->size ? 2*W->size : 4;
+        W->parts = arena_alloc (L->A, W->size * sizeof(*W->parts));
+        if (old)
+            memcpy (W->parts, old, W->n * sizeof(*W->parts));
+    }
+
+    W->parts[W->n].type = type;
+    W->parts[W->n].text = text;
+    W->parts[W->n].arith = NULL;
+    W->parts[W->n].quoted = quoted;
+
+    return &W->parts[W->n++];
+}
+
+
+/* what has to stay literal in a pattern when it was quoted */
+static const char wild[256] = {
+    ['*'] = 1, ['?'] = 1, ['['] = 1, [']'] = 1, ['\\'] = 1,
+};
+
+
+/* a quoted wildcard (or backslash) is about to be written at w */
+static void lex_quoted (Parser* L, char* w)
+{
+    unsigned int* old = L->quoted;
+
+    if (L->nquoted == L->quoted_size) {
+        L->quoted_size = L->quoted_size ? 2*L->quoted_size : 16;
+        L->quoted = arena_alloc (L->A, L->quoted_size * sizeof(*L->quoted));
+        if (old)
+            memcpy (L->quoted, old, L->nquoted * sizeof(*L->quoted));
+    }
+
+    L->quoted[L->nquoted++] = w - L->word;
+}
+
+
+/* The literal text [lit, w) of the word being lexed as a PART_TEXT,
+ * with a \ in front of each of its quoted wildcards. */
+static void text_part (Parser* L, Parts* W, char* lit, char* w, int quoted)
+{
+    unsigned int i, from = lit - L->word, to = w - L->word;
+    size_t n = w - lit;
+    char *text, *t;
+
+    for (i=0; i<L->nquoted; i++)
+        n += L->quoted[i] >= from && L->quoted[i] < to;
+
+    t = text = arena_alloc (L->A, n + 1);
+    for (i=0; i<L->nquoted; i++) {
+        if (L->quoted[i] < from || L->quoted[i] >= to)
+            continue;
+        memcpy (t, lit, L->word + L->quoted[i] - lit);
+        t += L->word + L->quoted[i] - lit;
+        lit = L->word + L->quoted[i];
+        *t++ = '\\';
+        *t++ = *lit++;
+    }
+    memcpy (t, lit, w - lit);
+    t[w - lit] = '\0';
+
+    part_push (L, W, PART_TEXT, text, quoted);
+}
+
+
+/* the length of the special parameter or digits at s (for ${10}) */
+static unsigned int special_len (const char* s, int braced)
+{
+    unsigned int n = 0;
+
+    if (*s && strchr ("?#$*@", *s))
+        return 1;
+
+    while (isdigit ((unsigned char)s[n]) && (braced || !n))
+        n++;
+
+    return n;
+}
+
+
+/* Recognizes the expansion at s, just past a '$': $name, ${name},
+ * the special parameters, and $(( expression )), which is compiled
+ * right here.  The literal text [lit, w) in front of it becomes a part
+ * of its own first.  Returns how many bytes of s it takes, 0 if the
+ * '$' is just a '$'. */
+static unsigned int lex_dollar (Parser* L, const char* s, Parts* W, int quoted,
+                                char* lit, char* w)
+{
+    const char* e;
+    unsigned int n;
+    int depth = 0;
+    WordPart* p;
+
+    if (s[0] == '(' && s[1] == '(') {
+        for (e=s+2; *e && (*e != ')' || depth); e++) {
+            if (*e == '(')
+                depth++;
+            else if (*e == ')')
+                depth--;
+        }
+        if (*e != ')' || e[1] != ')') {
+            L->incomplete = !*e || !e[1];
+            L->invalid = 1;
+            return 0;
+        }
+        if (w > lit)
+            text_part (L, W, lit, w, quoted);
+        p = part_push (L, W, PART_ARITH, arena_strndup (L->A, s+2, e - s - 2), quoted);
+        if (!(p->arith = arith_compile (L->A, p->text)))
+            L->invalid = 1;
+        return e + 2 - s;
+    }
+
+    if (s[0] == '{') {
+        if (!(n = var_name_len (s+1)))
+            n = special_len (s+1, 1);
+        if (!n || s[n+1] != '}') {
+            L->invalid = 1;
+            return 0;
+        }
+        if (w > lit)
+            text_part (L, W, lit, w, quoted);
+        part_push (L, W, PART_VAR, arena_strndup (L->A, s+1, n), quoted);
+        return n + 2;
+    }
+
+    if (!(n = var_name_len (s)) && !(n = special_len (s, 0)))
+        return 0;
+
+    if (w > lit)
+        text_part (L, W, lit, w, quoted);
+    part_push (L, W, PART_VAR, arena_strndup (L->A, s, n), quoted);
+    return n;
+}
+
+
+/* Scans one word starting at *s, removing quotes and escapes by
+ * compacting it toward its start.  The word's terminator has already
+ * been read by the time the '\0' is written over it, so the lexer never
+ * looks at a byte twice.  A $ expansion stays in the word as typed and
+ * is also recorded, along with the text around it, in a Word (see
+ * parse.h); so is a word with an unquoted *, ? or [...], which is a
+ * pathname pattern.  Returns the delimiter that ended the word. */
+static char lex_word (Parser* L, char** s)
+{
+    char *r = *s, *w = *s, *lit = *s;
+    char quote = 0;
+    char c;
+    int first = -1, glob = 0, bracket = 0;
+    unsigned int n;
+    Parts W = { NULL, 0, 0 };
+    Word* word;
+
+    L->word = *s;
+    L->nquoted = 0;
+
+    for (c=*r; c; c=*r) {
+        if (c == '$' && quote != '\'' &&
+                (n = lex_dollar (L, r+1, &W, quote != 0, lit, w))) {
+            memmove (w, r, n + 1);
+            w += n + 1;
+            r += n + 1;
+            lit = w;
+        }
+        else if (quote) {
+            r++;
+            if (c == quote)
+                quote = 0;
+            else if (c == '\\' && quote == '\"' && (*r == '\"' || *r == '\\' || *r == '$')) {
+                if (wild[(unsigned char)*r])
+                    lex_quoted (L, w);
+                *w++ = *r++;
+            }
+            else {
+                if (wild[(unsigned char)c])
+                    lex_quoted (L, w);
+                *w++ = c;
+            }
+        }
+        else if (c == '\'' || c == '\"') {
+            if (first == -1)
+                first = w - *s;
+            quote = c;
+            r++;
+        }
+        else if (c == '\\' && r[1] == '\n') {
+            r += 2;             /* a line continued */
+        }
+        else if (c == '\\' && r[1]) {
+            if (first == -1)
+                first = w - *s;
+            if (wild[(unsigned char)r[1]])
+                lex_quoted (L, w);
+            *w++ = r[1];
+            r += 2;
+        }
+        else if (c == '\\') {
+            L->incomplete = L->invalid = 1;
+            r++;
+        }
+        else if (isspace ((unsigned char)c) || is_op (c)) {
+            break;
+        }
+        else {
+            if (c == '*' || c == '?' || (c == ']' && bracket))
+                glob = 1;
+            else if (c == '[')
+                bracket = 1;
+            *w++ = c;
+            r++;
+        }
+    }
+
+    if (quote)
+        L->incomplete = L->invalid = 1;
+
+    lex_push (L, TOK_WORD, *s, *s - L->copy, r - L->copy);
+    L->toks[L->ntoks-1].lit = first;
+
+    if (W.n || glob) {
+        if (w > lit)
+            text_part (L, &W, lit, w, 0);
+        word = arena_alloc (L->A, sizeof(*word));
+        word->parts = W.parts;
+        word->nparts = W.n;
+        word->quoted = first != -1;
+
+        /* what an unquoted $x expands to is a pattern too */
+        for (n=0; n<W.n && !glob; n++)
+            glob = W.parts[n].type == PART_VAR && !W.parts[n].quoted;
+        word->glob = glob;
+
+        L->toks[L->ntoks-1].w = word;
+    }
+
+    *w = '\0';
+    *s = r;
+    return c;
+}
+
+
+/* the operator c at s, or its doubled form (`&&`, `||`) if s[1] is
+ * the same character.  Compares with c, since *s may be the '\0' that
+ * ended the word before it.  Returns where the next token starts. */
+static char* lex_op (Parser* L, char* s, char c, TokenType one, TokenType two)
+{
+    unsigned int start = s - L->copy;
+
+    if (two != one && s[1] == c) {
+        lex_push (L, two, NULL, start, start + 2);
+        return s + 2;
+    }
+
+    lex_push (L, one, NULL, start, start + 1);
+    return s + 1;
+}
+
+
+static void lex (Parser* L, char* cmdline)
+{
+    char* s = cmdline;
+    char c = *s;
+
+    while (c && !L->invalid) {
+        if (c == '\n') {
+            /* a run of blank lines is one separator */
+            if (!L->ntoks || L->toks[L->ntoks-1].type != TOK_NEWLINE)
+                lex_op (L, s, c, TOK_NEWLINE, TOK_NEWLINE);
+            c = *++s;
+            continue;
+        }
+
+        if (isspace ((unsigned char)c)) {
+            c = *++s;
+            continue;
+        }
+
+        /* the bytes after s are untouched even when *s was
+         * overwritten by a word's '\0', so peeking at s[1] is fine */
+        switch (c) {
+        case '|': s = lex_op (L, s, c, TOK_PIPE, TOK_OR);        c = *s; break;
+        case '&': s = lex_op (L, s, c, TOK_AMP, TOK_AND);        c = *s; break;
+        case '<': s = lex_op (L, s, c, TOK_IN, TOK_IN);          c = *s; break;
+        case '>': s = lex_op (L, s, c, TOK_OUT, TOK_OUT);        c = *s; break;
+        case ';': s = lex_op (L, s, c, TOK_SEMI, TOK_SEMI);      c = *s; break;
+        case '(': s = lex_op (L, s, c, TOK_LPAREN, TOK_LPAREN);  c = *s; break;
+        case ')': s = lex_op (L, s, c, TOK_RPAREN, TOK_RPAREN);  c = *s; break;
+        case '#':
+            /* a comment runs to the end of the line */
+            while (*s && *s != '\n')
+                s++;
+            c = *s;
+            break;
+        default:
+            /* s is left on the delimiter, which may have been
+             * overwritten by the word's '\0'; c carries its value */
+            c = lex_word (L, &s);
+            break;
+        }
+    }
+}
+
+
+/* the source text of toks[first..last], as it was typed */
+static char* source (Parser* L, unsigned int first, unsigned int last)
+{
+    return arena_strndup (L->A, L->src + L->toks[first].start,
+                          L->toks[last].end - L->toks[first].start);
+}
+
+
+static Token* peek (Parser* L)
+{
+    return L->pos < L->ntoks ? &L->toks[L->pos] : NULL;
+}
+
+
+/* the next token, which the grammar says has to be there: running out
+ * of them means the command goes on (on the next line, if there is one) */
+static Token* need (Parser* L)
+{
+    Token* tok = peek (L);
+
+    if (!tok)
+        L->incomplete = L->invalid = 1;
+
+    return tok;
+}
+
+
+/* is tok the reserved word kw?  Only a plain word can be one. */
+static int is_word (Token* tok, const char* kw)
+{
+    return tok && tok->type == TOK_WORD && tok->word[0] == kw[0]
+               && tok->lit == -1 && !tok->w && !strcmp (tok->word, kw);
+}
+
+
+static int accept (Parser* L, const char* kw)
+{
+    if (!is_word (peek (L), kw))
+        return 0;
+
+    L->pos++;
+    return 1;
+}
+
+
+static int expect (Parser* L, const char* kw)
+{
+    Token* tok = need (L);
+
+    if (tok && is_word (tok, kw)) {
+        L->pos++;
+        return 1;
+    }
+
+    L->invalid = 1;
+    return 0;
+}
+
+
+static void skip_newlines (Parser* L)
+{
+    while (L->pos < L->ntoks && L->toks[L->pos].type == TOK_NEWLINE)
+        L->pos++;
+}
+
+
+/* the words that close a compound command can't start a command */
+static int is_reserved (Token* tok)
+{
+    static const char* reserved[] = {
+        "then", "elif", "else", "fi", "do", "done", "}", NULL
+    };
+    unsigned int i;
+
+    for (i=0; reserved[i]; i++)
+        if (is_word (tok, reserved[i]))
+            return 1;
+
+    return 0;
+}
+
+
+/* can toks[i] start a command? */
+static int is_command (Parser* L, unsigned int i)
+{
+    return i < L->ntoks && (L->toks[i].type == TOK_WORD ||
+                            L->toks[i].type == TOK_LPAREN);
+}
+
+
+/* NAME=value, with nothing in front of the '=' quoted */
+static int is_assignment (Token* tok)
+{
+    unsigned int n = var_name_len (tok->word);
+
+    return n && tok->word[n] == '=' && (tok->lit == -1 || tok->lit > n);
+}
+
+
+static Parse* parse_new (Arena* A)
+{
+    Parse* P = arena_alloc (A, sizeof(*P));
+
+    memset (P, 0, sizeof(*P));
+
+    return P;
+}
+
+
+static Node* node_new (Arena* A, NodeType type, Node* left, Node* right)
+{
+    Node* N = arena_alloc (A, sizeof(*N));
+
+    memset (N, 0, sizeof(*N));
+    N->type = type;
+    N->left = left;
+    N->right = right;
+
+    return N;
+}
+
+
+static const char* then_stops[] = { "then", NULL };
+static const char* if_stops[] = { "elif", "else", "fi", NULL };
+static const char* fi_stops[] = { "fi", NULL };
+static const char* do_stops[] = { "do", NULL };
+static const char* done_stops[] = { "done", NULL };
+static const char* brace_stops[] = { "}", NULL };
+
+
+static Node* parse_list (Parser* L, const char** stop, int paren);
+static Node* parse_compound (Parser* L);
+
+
+/* `< file` or `> file`, for task t of P */
+static int parse_redirect (Parser* L, Parse* P, unsigned int t)
+{
+    TokenType type = L->toks[L->pos++].type;
+    Token* tok = peek (L);
+
+    if (!tok || tok->type != TOK_WORD)
+        goto invalid;
+
+    if (type == TOK_IN) {
+        if (t != 0 || P->infile)
+            goto invalid;
+        P->infile = tok->word;
+        P->in_word = tok->w;
+    }
+    else {
+        if (P->outfile)
+            goto invalid;
+        P->outfile = tok->word;
+        P->out_word = tok->w;
+    }
+
+    if (tok->w)
+        P->expand = 1;
+
+    L->pos++;
+    return 1;
+
+invalid:
+    L->invalid = 1;
+    return 0;
+}
+
+
+/* a word of argv (or of assign) and, if it has a $ in it, its
+ * compiled form in *words, which is only allocated (for n of them)
+ * the first time it is needed */
+static void add_word (Parser* L, Parse* P, Token* tok, char** argv,
+                      Word*** words, unsigned int i, unsigned int n)
+{
+    argv[i] = tok->word;
+
+    if (!tok->w)
+        return;
+
+    if (!*words) {
+        *words = arena_alloc (L->A, (n+1) * sizeof(**words));
+        memset (*words, 0, (n+1) * sizeof(**words));
+    }
+    (*words)[i] = tok->w;
+    P->expand = 1;
+}
+
+
+/* Words and redirections up to the next operator: the NAME=value
+ * words in front go to assign, the rest to argv.  Both are sized
+ * exactly by looking ahead first. */
+static int parse_simple (Parser* L, Parse* P, Task* T, unsigned int t)
+{
+    unsigned int i, n, nwords = 0, nassign = 0;
+    Token* tok;
+
+    for (i=L->pos; i<L->ntoks; i++) {
+        if (L->toks[i].type == TOK_WORD) {
+            if (nwords == nassign && is_assignment (&L->toks[i]))
+                nassign++;
+            nwords++;
+        }
+        else if (L->toks[i].type == TOK_IN || L->toks[i].type == TOK_OUT)
+            i++;
+        else
+            break;
+    }
+
+    if (!nwords || is_reserved (peek (L))) {
+        L->invalid = 1;
+        return 0;
+    }
+
+    nwords -= nassign;
+    T->argv = arena_alloc (L->A, (nwords+1) * sizeof(*T->argv));
+    if (nassign)
+        T->assign = arena_alloc (L->A, (nassign+1) * sizeof(*T->assign));
+
+    for (i=0, n=0; (tok = peek (L)); ) {
+        if (tok->type == TOK_WORD) {
+            if (i < nassign)
+                add_word (L, P, tok, T->assign, &T->assign_words, i++, nassign);
+            else
+                add_word (L, P, tok, T->argv, &T->words, n++, nwords);
+            L->pos++;
+        }
+        else if (tok->type == TOK_IN || tok->type == TOK_OUT) {
+            if (!parse_redirect (L, P, t))
+                return 0;
+        }
+        else {
+            break;
+        }
+    }
+
+    T->argv[n] = NULL;
+    T->cmd = T->argv[0];
+    if (nassign)
+        T->assign[nassign] = NULL;
+
+    return 1;
+}
+
+
+/* One stage of a pipeline: a simple command, a compound one (which is
+ * one argv word, its source text, with its tree in Task.group) or a
+ * function definition. */
+static int parse_command (Parser* L, Parse* P, Task* T, unsigned int t)
+{
+    unsigned int start;
+    Token* tok;
+    Node* body;
+    char* name;
+
+    /* a leading @cpus=<list> pins the stage (see affinity.h) */
+    while ((tok = need (L)) && tok->type == TOK_WORD && !tok->w
+                            && !strncmp (tok->word, "@cpus=", 6)) {
+        T->cpus = tok->word + 6;
+        if (!*T->cpus || strspn (T->cpus, "0123456789,-") != strlen (T->cpus)) {
+            L->invalid = 1;
+            return 0;
+        }
+        L->pos++;
+    }
+
+    if (!tok)
+        return 0;
+
+    start = L->pos;
+
+    if (tok->type == TOK_LPAREN || is_word (tok, "{") || is_word (tok, "if") ||
+        is_word (tok, "while") || is_word (tok, "until") ||
+        is_word (tok, "for") || is_word (tok, "function")) {
+        if (!(T->group = parse_compound (L)))
+            return 0;
+    }
+    else if (tok->type == TOK_WORD && L->pos + 2 < L->ntoks
+                                   && L->toks[L->pos+1].type == TOK_LPAREN
+                                   && L->toks[L->pos+2].type == TOK_RPAREN) {
+        /* name () compound-command */
+        name = tok->word;
+        if (tok->w || tok->lit != -1 || var_name_len (name) != strlen (name)) {
+            L->invalid = 1;
+            return 0;
+        }
+        L->pos += 3;
+        skip_newlines (L);
+        if (!(body = parse_compound (L)))
+            return 0;
+        T->group = node_new (L->A, NODE_FUNCTION, body, NULL);
+        T->group->name = name;
+    }
+    else {
+        return parse_simple (L, P, T, t);
+    }
+
+    T->argv = arena_alloc (L->A, 2 * sizeof(*T->argv));
+    T->argv[0] = source (L, start, L->pos - 1);
+    T->argv[1] = NULL;
+    T->cmd = T->argv[0];
+
+    /* `while ...; done < file` */
+    while ((tok = peek (L)) && (tok->type == TOK_IN || tok->type == TOK_OUT))
+        if (!parse_redirect (L, P, t))
+            return 0;
+
+    return 1;
+}
+
+
+/* for name [in word ...]; do list; done (just past the `for`) */
+static Node* parse_for (Parser* L)
+{
+    Token* tok = need (L);
+    unsigned int i, n, nwords;
+    Node* N;
+
+    if (!tok || tok->type != TOK_WORD || tok->w || tok->lit != -1
+             || var_name_len (tok->word) != strlen (tok->word)) {
+        L->invalid = 1;
+        return NULL;
+    }
+
+    N = node_new (L->A, NODE_FOR, NULL, NULL);
+    N->name = tok->word;
+    L->pos++;
+    skip_newlines (L);
+
+    if (accept (L, "in")) {
+        for (i=L->pos; i<L->ntoks && L->toks[i].type == TOK_WORD; i++);
+        nwords = i - L->pos;
+
+        N->argv = arena_alloc (L->A, (nwords+1) * sizeof(*N->argv));
+        for (n=0; n<nwords; n++, L->pos++) {
+            N->argv[n] = L->toks[L->pos].word;
+            if (L->toks[L->pos].w && !N->words) {
+                N->words = arena_alloc (L->A, (nwords+1) * sizeof(*N->words));
+                memset (N->words, 0, (nwords+1) * sizeof(*N->words));
+            }
+            if (L->toks[L->pos].w)
+                N->words[n] = L->toks[L->pos].w;
+        }
+        N->argv[n] = NULL;
+
+        if (!(tok = need (L)))
+            return NULL;
+        if (tok->type != TOK_SEMI && tok->type != TOK_NEWLINE) {
+            L->invalid = 1;
+            return NULL;
+        }
+        L->pos++;
+    }
+    else if ((tok = peek (L)) && tok->type == TOK_SEMI) {
+        L->pos++;
+    }
+
+    skip_newlines (L);
+    if (!expect (L, "do") || !(N->right = parse_list (L, done_stops, 0))
+                          || !expect (L, "done"))
+        return NULL;
+
+    return N;
+}
+
+
+/* if list; then list; [elif list; then list;]* [else list;] fi
+ * (just past the `if` or an `elif`, which is the `if` of the else part) */
+static Node* parse_if (Parser* L)
+{
+    Node *cond, *body, *N;
+
+    if (!(cond = parse_list (L, then_stops, 0)) || !expect (L, "then"))
+        return NULL;
+    if (!(body = parse_list (L, if_stops, 0)))
+        return NULL;
+
+    N = node_new (L->A, NODE_IF, cond, body);
+
+    if (accept (L, "elif"))
+        return (N->other = parse_if (L)) ? N : NULL;
+
+    if (accept (L, "else") && !(N->other = parse_list (L, fi_stops, 0)))
+        return NULL;
+
+    return expect (L, "fi") ? N : NULL;
+}
+
+
+static Node* parse_compound (Parser* L)
+{
+    Token* tok = need (L);
+    NodeType type;
+    Node *N, *cond;
+
+    if (!tok)
+        return NULL;
+
+    if (tok->type == TOK_LPAREN) {
+        L->pos++;
+        if (!(N = parse_list (L, NULL, 1)) || !(tok = need (L)))
+            return NULL;
+        L->pos++;
+        return node_new (L->A, NODE_SUBSHELL, N, NULL);
+    }
+
+    if (accept (L, "{")) {
+        if (!(N = parse_list (L, brace_stops, 0)) || !expect (L, "}"))
+            return NULL;
+        return node_new (L->A, NODE_BRACE, N, NULL);
+    }
+
+    if (accept (L, "if"))
+        return parse_if (L);
+
+    if (accept (L, "for"))
+        return parse_for (L);
+
+    if (is_word (tok, "while") || is_word (tok, "until")) {
+        type = is_word (tok, "while") ? NODE_WHILE : NODE_UNTIL;
+        L->pos++;
+        if (!(cond = parse_list (L, do_stops, 0)) || !expect (L, "do"))
+            return NULL;
+        if (!(N = parse_list (L, done_stops, 0)) || !expect (L, "done"))
+            return NULL;
+        return node_new (L->A, type, cond, N);
+    }
+
+    if (accept (L, "function")) {
+        /* function name [()] compound-command */
+        tok = need (L);
+        if (!tok || tok->type != TOK_WORD || tok->w || tok->lit != -1 ||
+                var_name_len (tok->word) != strlen (tok->word)) {
+            L->invalid = 1;
+            return NULL;
+        }
+        N = node_new (L->A, NODE_FUNCTION, NULL, NULL);
+        N->name = tok->word;
+        L->pos++;
+        if (L->pos + 1 < L->ntoks && L->toks[L->pos].type == TOK_LPAREN
+                                  && L->toks[L->pos+1].type == TOK_RPAREN)
+            L->pos += 2;
+        skip_newlines (L);
+        return (N->left = parse_compound (L)) ? N : NULL;
+    }
+
+    L->invalid = 1;
+    return NULL;
+}
+
+
+static Node* parse_pipeline (Parser* L)
+{
+    Node* N = node_new (L->A, NODE_PIPELINE, NULL, NULL);
+    Parse* P = parse_new (L->A);
+    Parse** old = L->pipes;
+    Task* tasks = NULL;
+    Task* prev;
+    unsigned int i, t, size = 0, start = L->pos;
+    unsigned int out_task = 0;  /* the task with the '>' */
+    int had_out;
+    Token* tok;
+
+    if (L->npipes == L->pipes_size) {
+        L->pipes_size = L->pipes_size ? 2*L->pipes_size : 8;
+        L->pipes = arena_alloc (L->A, L->pipes_size * sizeof(*L->pipes));
+        if (old)
+            memcpy (L->pipes, old, L->npipes * sizeof(*L->pipes));
+    }
+    L->pipes[L->npipes++] = P;
+    N->pipeline = P;
+
+    if (accept (L, "!"))
+        P->negate = 1;
+
+    /* `time` is a keyword only in front of a command */
+    if (is_word (peek (L), "time") && is_command (L, L->pos + 1)) {
+        P->timed = 1;
+        L->pos++;
+    }
+
+    /* and so is `limit`, whose key=value words are checked when the
+     * job is started (see cgroup.h) */
+    if (is_word (peek (L), "limit") && L->pos + 1 < L->ntoks) {
+        for (i=L->pos+1; i<L->ntoks && L->toks[i].type == TOK_WORD
+                                    && strchr (L->toks[i].word, '='); i++);
+        if (i == L->pos + 1 || !is_command (L, i))
+            goto invalid;
+
+        P->limits = arena_alloc (L->A, (i - L->pos) * sizeof (*P->limits));
+        for (t=L->pos+1; t<i; t++)
+            P->limits[t-L->pos-1] = L->toks[t].word;
+        P->limits[i-L->pos-1] = NULL;
+        L->pos = i;
+    }
+
+    /* `timeout 30s cmd`, checked when the job starts (see watchdog.h);
+     * `timeout` followed by anything but a number is just a command */
+    if (is_word (peek (L), "timeout") && L->pos + 1 < L->ntoks
+            && L->toks[L->pos+1].type == TOK_WORD
+            && isdigit ((unsigned char)L->toks[L->pos+1].word[0])
+            && is_command (L, L->pos + 2)) {
+        P->timeout = L->toks[L->pos+1].word;
+        L->pos += 2;
+    }
+
+    for (t=0; ; t++) {
+        if (t == size) {
+            prev = tasks;
+            size = size ? 2*size : 4;
+            tasks = arena_alloc (L->A, size * sizeof(*tasks));
+            if (prev)
+                memcpy (tasks, prev, t * sizeof(*tasks));
+        }
+        memset (&tasks[t], 0, sizeof(*tasks));
+
+        /* a pipeline nested in this task (ex: `{ a | b > f; }`) has
+         * a '>' of its own, so ours is tracked here and not in L */
+        had_out = P->outfile != NULL;
+        if (!parse_command (L, P, &tasks[t], t))
+            goto invalid;
+        if (!had_out && P->outfile)
+            out_task = t;
+
+        if (!(tok = peek (L)) || tok->type != TOK_PIPE)
+            break;
+        L->pos++;
+        skip_newlines (L);
+    }
+
+    P->tasks = tasks;
+    P->ntasks = t + 1;
+
+    if (P->outfile && out_task != t)
+        goto invalid;
+
+    if (tok && tok->type == TOK_AMP) {
+        P->background = 1;
+        L->pos++;
+    }
+
+    P->text = source (L, start, L->pos - 1);
+    return N;
+
+invalid:
+    L->invalid = 1;
+    P->invalid_syntax = 1;
+    return NULL;
+}
+
+
+static int at_stop (Token* tok, const char** stop, int paren)
+{
+    if (paren && tok->type == TOK_RPAREN)
+        return 1;
+
+    for (; stop && *stop; stop++)
+        if (is_word (tok, *stop))
+            return 1;
+
+    return 0;
+}
+
+
+/* A list of pipelines up to (not including) one of the words in stop,
+ * a ')' when paren is set, or the end of the line; newlines separate
+ * like `;` does.  The tree is folded as it goes: `chain` is the && / ||
+ * run being built, `list` the ;-separated ones before it.  Returns NULL
+ * (with L->invalid set) on a syntax error. */
+static Node* parse_list (Parser* L, const char** stop, int paren)
+{
+    Node *list = NULL, *chain = NULL, *N;
+    NodeType op = NODE_SEQ;
+    Token* tok;
+
+    for (;;) {
+        skip_newlines (L);
+
+        if (!(tok = peek (L)) || at_stop (tok, stop, paren)) {
+            /* `a &&` needs its b, and a compound command its list */
+            if (op != NODE_SEQ || ((stop || paren) && !list)) {
+                L->incomplete = !tok;
+                L->invalid = 1;
+                return NULL;
+            }
+            return list;
+        }
+
+        if (!(N = parse_pipeline (L)))
+            return NULL;
+        chain = chain ? node_new (L->A, op, chain, N) : N;
+
+        tok = peek (L);
+        if (tok && (tok->type == TOK_AND || tok->type == TOK_OR)) {
+            op = tok->type == TOK_AND ? NODE_AND : NODE_OR;
+            L->pos++;
+            continue;
+        }
+
+        list = list ? node_new (L->A, NODE_SEQ, list, chain) : chain;
+        chain = NULL;
+        op = NODE_SEQ;
+
+        if (tok && (tok->type == TOK_SEMI || tok->type == TOK_NEWLINE))
+            L->pos++;
+        else if (tok && !N->pipeline->background && !at_stop (tok, stop, paren))
+            break;
+    }
+
+    L->invalid = 1;
+    return NULL;
+}
+
+
+/* Everything the Script refers to is allocated from A and lives until
+ * A is reset; there is nothing to free one by one.  A line that ends
+ * in the middle of a command (an open quote, `if` without its `fi`,
+ * a trailing `&&`) is invalid and incomplete: the same line with the
+ * next one appended may parse. */
+Script* parse_cmdline (Arena* A, const char* cmdline)
+{
+    Parser L;
+    Script* S;
+    Node* root = NULL;
+
+    memset (&L, 0, sizeof(L));
+    L.A = A;
+    L.src = cmdline;
+    L.copy = arena_strdup (A, cmdline);
+    lex (&L, L.copy);
+
+    skip_newlines (&L);
+    if (L.pos == L.ntoks && !L.invalid)
+        return NULL;
+
+    if (!L.invalid)
+        root = parse_list (&L, NULL, 0);
+
+    S = arena_alloc (A, sizeof(*S));
+    S->root = L.invalid ? NULL : root;
+    S->pipelines = L.pipes;
+    S->npipelines = L.npipes;
+    S->invalid_syntax = L.invalid;
+    S->incomplete = L.incomplete;
+
+    return S;
+}
+
+
+/* a one stage pipeline that runs N in a subshell, like `( N )` */
+Parse* parse_group (Arena* A, Node* N, char* text)
+{
+    Parse* P = parse_new (A);
+
+    P->ntasks = 1;
+    P->tasks = arena_alloc (A, sizeof (*P->tasks));
+    memset (P->tasks, 0, sizeof (*P->tasks));
+    P->tasks[0].argv = arena_alloc (A, 2 * sizeof (*P->tasks[0].argv));
+    P->tasks[0].argv[0] = text;
+    P->tasks[0].argv[1] = NULL;
+    P->tasks[0].cmd = text;
+    P->tasks[0].group = node_new (A, NODE_SUBSHELL, N, NULL);
+    P->text = text;
+
+    return P;
+}
+
+
+void parse_debug (Parse* P)
+{
+    static const char* compound[] = {
+        [NODE_SUBSHELL] = "subshell", [NODE_BRACE] = "{ }", [NODE_IF] = "if",
+        [NODE_WHILE] = "while", [NODE_UNTIL] = "until", [NODE_FOR] = "for",
+        [NODE_FUNCTION] = "function definition",
+    };
+    int i, j;
+
+    fprintf (stderr, "==[ DEBUG: PARSE ]==================================\n");
+    fprintf (stderr, "Pipeline: %s\n", P->text);
+    fprintf (stderr, "Run in Background? %s\n", P->background ? "Yes" : "No");
+    fprintf (stderr, "Timed? %s\n", P->timed ? "Yes" : "No");
+    fprintf (stderr, "Negated? %s\n", P->negate ? "Yes" : "No");
+
+    if (P->limits)
+        for (i=0; P->limits[i]; i++)
+            fprintf (stderr, "limit: %s\n", P->limits[i]);
+
+    if (P->timeout)
+        fprintf (stderr, "timeout: %s\n", P->timeout);
+
+    if (P->infile)
+        fprintf (stderr, "infile: %s\n", P->infile);
+
+    if (P->outfile)
+        fprintf (stderr, "outfile: %s\n", P->outfile);
+
+    fprintf (stderr, "ntasks: %i\n", P->ntasks);
+
+    for (i=0; i<P->ntasks; i++) {
+        fprintf (stderr, "Task %i\n", i);
+        fprintf (stderr, "  - cmd: [%s]\n", P->tasks[i].cmd ? P->tasks[i].cmd : "");
+        if (P->tasks[i].group)
+            fprintf (stderr, "  - %s\n", compound[P->tasks[i].group->type]);
+        if (P->tasks[i].assign)
+            for (j=0; P->tasks[i].assign[j]; j++)
+                fprintf (stderr, "    + assign: [%s]\n", P->tasks[i].assign[j]);
+        if (P->tasks[i].cpus)
+            fprintf (stderr, "  - cpus: [%s]\n", P->tasks[i].cpus);
+
+        if (P->tasks[i].argv)
+            for (j=0; P->tasks[i].argv[j]; j++)
+                fprintf (stderr, "    + arg[%i]: [%s]%s\n", j, P->tasks[i].argv[j],
+                         P->tasks[i].words && P->tasks[i].words[j] ? " (expands)" : "");
+    }
+
+    fprintf (stderr, "==================================[ DEBUG: PARSE ]==\n");
+}
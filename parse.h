@@ -1,27 +1,114 @@
-#ifndef _parse_h_
-#define _parse_h_
-
-#include <limits.h>
-
-typedef struct {
-    char* cmd;
-    char** argv;   /* NULL terminated array of strings */
-} Task;
-
-typedef struct {
-    Task* tasks;         /* ordered list of tasks to pipe */
-    int   ntasks;        /* # of tasks in the parse */
-
-    char* infile;        /* filename of 'infile'  */
-    char* outfile;       /* filename of 'outfile' */
-
-    int background;      /* run process in background? */
-    int invalid_syntax;  /* parse failed */
-} Parse;
-
-
-Parse* parse_cmdline (char* cmdline);
-void parse_destroy (Parse** P);
-void parse_debug (Parse* P);
-
-#endif /* _parse_h_ */
+#ifndef _parse_h_
+#define _parse_h_
+
+#include <limits.h>
+
+#include "arena.h"
+#include "arith.h"
+
+typedef struct Node Node;
+
+/* A word with $ expansions or unquoted wildcards in it is compiled
+ * into parts, so running it again (ex: in a loop) is a matter of
+ * filling in the values and matching the pathnames. */
+typedef enum {
+    PART_TEXT,           /* literal text, with its quoted wildcards and
+                          * backslashes escaped by a \ (a pattern) */
+    PART_VAR,            /* $name, ${name} or $?, $#, $$, $@, $*, $0 .. $9 */
+    PART_ARITH,          /* $(( expression )) */
+} PartType;
+
+typedef struct {
+    PartType type;
+    char* text;          /* the text, the name, or the expression */
+    Arith* arith;        /* PART_ARITH: compiled */
+    int quoted;          /* inside "...": not split into fields */
+} WordPart;
+
+typedef struct {
+    WordPart* parts;
+    unsigned int nparts;
+    int quoted;          /* had quotes: always expands to a word */
+    int glob;            /* has an unquoted wildcard or $ expansion:
+                          * may need pathname expansion */
+} Word;
+
+typedef struct {
+    char* cmd;
+    char** argv;   /* NULL terminated array of strings */
+    const char* cpus;  /* `@cpus=` cpu list (NULL: none) */
+    Node* group;   /* a compound command (NULL: a simple one) */
+    Word** words;  /* argv's compiled words, NULL for a static one
+                    * (NULL: none of them needs expanding) */
+    char** assign; /* NAME=value words in front of it (NULL: none);
+                    * on their own (cmd is NULL) they set variables */
+    Word** assign_words;  /* their compiled words, as with words */
+} Task;
+
+typedef struct {
+    Task* tasks;         /* ordered list of tasks to pipe */
+    int   ntasks;        /* # of tasks in the parse */
+
+    char* infile;        /* filename of 'infile'  */
+    char* outfile;       /* filename of 'outfile' */
+
+    int background;      /* run process in background? */
+    int timed;           /* prefixed with the `time` keyword? */
+    char** limits;       /* `limit` key=value words (NULL: none) */
+    char* timeout;       /* `timeout` duration (NULL: none) */
+    int invalid_syntax;  /* parse failed */
+    char* text;          /* its own source text (the job's name) */
+    int negate;          /* `!` in front: invert its status */
+    int expand;          /* some word of it needs expanding */
+    Word* in_word;       /* infile, compiled (NULL: static) */
+    Word* out_word;      /* outfile, compiled (NULL: static) */
+} Parse;
+
+/* A command line compiles to a tree of these.  `&&` and `||` bind
+ * tighter than `;` and `&`, and all of them associate to the left:
+ *
+ *   a && b || c ; d   is   SEQ (OR (AND (a, b), c), d)
+ *
+ * A `&` belongs to the pipeline in front of it; `( a && b ) &` puts a
+ * whole list in the background.  A compound command is a stage of a
+ * pipeline (Task.group), so it can be piped and redirected; on its
+ * own, everything but a ( subshell ) runs inside the shell. */
+typedef enum {
+    NODE_PIPELINE,
+    NODE_SEQ,            /* left ; right */
+    NODE_AND,            /* left && right */
+    NODE_OR,             /* left || right */
+    NODE_SUBSHELL,       /* ( left ) */
+    NODE_BRACE,          /* { left; } */
+    NODE_IF,             /* if left; then right; [else other;] fi */
+    NODE_WHILE,          /* while left; do right; done */
+    NODE_UNTIL,          /* until left; do right; done */
+    NODE_FOR,            /* for name [in argv]; do right; done */
+    NODE_FUNCTION,       /* name () left */
+} NodeType;
+
+struct Node {
+    NodeType type;
+    Parse* pipeline;     /* NODE_PIPELINE */
+    Node* left;          /* see NodeType */
+    Node* right;
+    Node* other;         /* NODE_IF: the elif or else part (NULL: none) */
+    char* name;          /* NODE_FOR: the variable, NODE_FUNCTION: its name */
+    char** argv;         /* NODE_FOR: the words after `in` (NULL: "$@") */
+    Word** words;        /* and their compiled forms, as in Task */
+};
+
+typedef struct {
+    Node* root;
+    Parse** pipelines;   /* every pipeline, nested ones too, in order */
+    unsigned int npipelines;
+    int invalid_syntax;  /* parse failed (root is NULL) */
+    int incomplete;      /* ... because the line ended too early */
+} Script;
+
+
+Script* parse_cmdline (Arena* A, const char* cmdline);
+Parse* parse_group (Arena* A, Node* N, char* text);
+void parse_debug (Parse* P);
+
+#endif /* _parse_h_ */
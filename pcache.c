@@ -0,0 +1,221 @@
+/* Parsed-command cache
+ *
+ * Each entry owns a small Arena holding its key and the Script.
+ * Entries sit both in a chained hash table (for the lookup) and on a
+ * doubly linked LRU list (for eviction).  An entry in use by the
+ * caller is pinned and is never evicted or freed out from under it: a
+ * pinned entry that is cleared is detached from the table instead, and
+ * freed when its last user puts it back.
+ **********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pcache.h"
+#include "parse.h"
+#include "arena.h"
+#include "hash.h"
+#include "trace.h"
+
+#define PCACHE_BUCKETS (2*PCACHE_SIZE)
+
+typedef struct PCacheEntry {
+    Script S;                 /* must be first: see pcache_put() */
+    Arena* A;
+    char* line;
+    unsigned long hash;
+    unsigned int refs;
+    int detached;
+    struct PCacheEntry* chain;
+    struct PCacheEntry* prev; /* LRU list, most recent first */
+    struct PCacheEntry* next;
+} PCacheEntry;
+
+static PCacheEntry* buckets[PCACHE_BUCKETS];
+static PCacheEntry* lru_head = NULL;
+static PCacheEntry* lru_tail = NULL;
+static unsigned int nentries = 0;
+
+static unsigned long hits = 0;
+static unsigned long misses = 0;
+static unsigned long evictions = 0;
+
+
+static void lru_unlink (PCacheEntry* E)
+{
+    if (E->prev)
+        E->prev->next = E->next;
+    else
+        lru_head = E->next;
+
+    if (E->next)
+        E->next->prev = E->prev;
+    else
+        lru_tail = E->prev;
+
+    E->prev = E->next = NULL;
+}
+
+
+static void lru_push (PCacheEntry* E)
+{
+    E->prev = NULL;
+    E->next = lru_head;
+
+    if (lru_head)
+        lru_head->prev = E;
+    else
+        lru_tail = E;
+
+    lru_head = E;
+}
+
+
+static void entry_free (PCacheEntry* E)
+{
+    arena_destroy (&E->A);
+    free (E);
+}
+
+
+/* take E out of the table; it is freed now, or by its last user */
+static void entry_detach (PCacheEntry* E)
+{
+    PCacheEntry** link;
+
+    for (link=&buckets[E->hash % PCACHE_BUCKETS]; *link != E; link=&(*link)->chain);
+    *link = E->chain;
+
+    lru_unlink (E);
+    nentries--;
+
+    if (E->refs)
+        E->detached = 1;
+    else
+        entry_free (E);
+}
+
+
+static void evict ()
+{
+    PCacheEntry* E;
+
+    for (E=lru_tail; E && nentries >= PCACHE_SIZE; E=E->prev) {
+        if (!E->refs) {
+            entry_detach (E);
+            evictions++;
+            return;
+        }
+    }
+}
+
+
+static PCacheEntry* entry_new (const char* cmdline, unsigned long h)
+{
+    PCacheEntry* E;
+    Script* S;
+    size_t len = strlen (cmdline);
+    Arena* A = arena_new (2*len + 1024);
+    long t0 = trace_now ();
+
+    S = parse_cmdline (A, cmdline);
+    trace_span ("parse", "parse_cmdline", t0, trace_now (), 0, NULL);
+    if (!S) {
+        arena_destroy (&A);
+        return NULL;
+    }
+
+    E = malloc (sizeof(*E));
+    E->S = *S;
+    E->A = A;
+    E->line = arena_strndup (A, cmdline, len);
+    E->hash = h;
+    E->refs = 0;
+    E->detached = 0;
+
+    /* the first lines of a command that goes on are seen only once:
+     * the caller hangs on to them and tries again with the next line */
+    if (E->S.incomplete) {
+        E->detached = 1;
+        return E;
+    }
+
+    if (nentries >= PCACHE_SIZE)
+        evict ();
+
+    E->chain = buckets[h % PCACHE_BUCKETS];
+    buckets[h % PCACHE_BUCKETS] = E;
+    lru_push (E);
+    nentries++;
+
+    return E;
+}
+
+
+/* Returns the (shared, read-only) Script for cmdline, or NULL if the
+ * line is empty.  Every non-NULL result must be given back with
+ * pcache_put() once the caller is done with it. */
+Script* pcache_get (const char* cmdline)
+{
+    PCacheEntry* E;
+    unsigned long h = hash_string (cmdline);
+
+    for (E=buckets[h % PCACHE_BUCKETS]; E; E=E->chain)
+        if (E->hash == h && !strcmp (E->line, cmdline))
+            break;
+
+    if (E) {
+        hits++;
+        lru_unlink (E);
+        lru_push (E);
+        E->refs++;
+        return &E->S;
+    }
+
+    misses++;
+    E = entry_new (cmdline, h);
+    if (!E)
+        return NULL;
+
+    E->refs++;
+    return &E->S;
+}
+
+
+/* one more reference to S (from pcache_get()), for a user that keeps
+ * it past the command line it came with: ex, a function definition */
+void pcache_hold (Script* S)
+{
+    ((PCacheEntry*) S)->refs++;
+}
+
+
+void pcache_put (Script* S)
+{
+    PCacheEntry* E = (PCacheEntry*) S;
+
+    if (!E)
+        return;
+
+    if (--E->refs == 0 && E->detached)
+        entry_free (E);
+}
+
+
+void pcache_clear ()
+{
+    while (lru_head)
+        entry_detach (lru_head);
+}
+
+
+void pcache_print ()
+{
+    unsigned long lookups = hits + misses;
+
+    printf("entries:       %u/%u\n", nentries, PCACHE_SIZE);
+    printf("hits:          %lu (%.1f%%)\n", hits,
+           lookups ? 100.0 * hits / lookups : 0.0);
+    printf("misses:        %lu\n", misses);
+    printf("evictions:     %lu\n", evictions);
+}
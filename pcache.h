@@ -0,0 +1,25 @@
+#ifndef _pcache_h_
+#define _pcache_h_
+
+#include "parse.h"
+
+/* Parsed-command cache
+ *
+ * An LRU cache in front of parse_cmdline() keyed on the raw command
+ * line.  A hit hands back the Script built the first time.  Commands
+ * are looked up in the hash table (see hash.h) each time they run,
+ * so an entry never goes stale: a change of PATH, or a `hash -r`,
+ * takes effect on the next run of a cached line.
+ *
+ * A Script obtained from pcache_get() is shared and must be treated as
+ * read-only; it stays valid until it is handed back to pcache_put(). */
+
+#define PCACHE_SIZE 256
+
+Script* pcache_get (const char* cmdline);
+void pcache_hold (Script* S);
+void pcache_put (Script* S);
+void pcache_clear ();
+void pcache_print ();
+
+#endif /* _pcache_h_ */
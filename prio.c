@@ -0,0 +1,162 @@
+/* Scheduling priority of jobs
+ *
+ * glibc has no wrapper for ioprio_set/ioprio_get, so those go through
+ * syscall().  Everything here works on single pids; the job level
+ * loops skip stages that have already been reaped.
+ **********************************************************************/
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "prio.h"
+#include "jobs.h"
+
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_VALUE(class, level) (((class) << IOPRIO_CLASS_SHIFT) | (level))
+
+static int bg_policy = 0;
+
+
+int prio_nice (pid_t pid, int nice)
+{
+    return setpriority (PRIO_PROCESS, pid, nice);
+}
+
+
+/* level is 0 (highest) to 7, and ignored for the idle class */
+int prio_io (pid_t pid, int class, int level)
+{
+    if (class == IOPRIO_CLASS_IDLE || class == IOPRIO_CLASS_NONE)
+        level = 0;
+
+    return syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, pid,
+                    IOPRIO_VALUE(class, level));
+}
+
+
+/* policy is one of SCHED_OTHER, SCHED_BATCH or SCHED_IDLE */
+int prio_policy (pid_t pid, int policy)
+{
+    struct sched_param sp;
+
+    memset (&sp, 0, sizeof(sp));
+
+    return sched_setscheduler (pid, policy, &sp);
+}
+
+
+/* "other", "batch" or "idle" to a SCHED_* policy, or -1 */
+int prio_policy_parse (const char* name)
+{
+    if (!strcmp (name, "other") || !strcmp (name, "normal"))
+        return SCHED_OTHER;
+    if (!strcmp (name, "batch"))
+        return SCHED_BATCH;
+    if (!strcmp (name, "idle"))
+        return SCHED_IDLE;
+
+    return -1;
+}
+
+
+static const char* policy_name (int policy)
+{
+    switch (policy) {
+    case SCHED_OTHER: return "other";
+    case SCHED_BATCH: return "batch";
+    case SCHED_IDLE:  return "idle";
+    case SCHED_FIFO:  return "fifo";
+    case SCHED_RR:    return "rr";
+    default:          return "?";
+    }
+}
+
+
+void prio_print (pid_t pid)
+{
+    static const char* classes[] = { "none", "realtime", "best-effort", "idle" };
+    int nice, io, policy;
+
+    errno = 0;
+    nice = getpriority (PRIO_PROCESS, pid);
+    if (nice == -1 && errno) {
+        printf("pssh: pid %d: %s\n", pid, strerror(errno));
+        return;
+    }
+
+    io = syscall (SYS_ioprio_get, IOPRIO_WHO_PROCESS, pid);
+    policy = sched_getscheduler (pid);
+
+    printf("%-8d nice %3d  io %s", pid, nice,
+           io == -1 ? "?" : classes[(io >> IOPRIO_CLASS_SHIFT) & 3]);
+    if (io != -1 && (io >> IOPRIO_CLASS_SHIFT) != IOPRIO_CLASS_NONE &&
+                    (io >> IOPRIO_CLASS_SHIFT) != IOPRIO_CLASS_IDLE)
+        printf(":%d", io & 0xff);
+    printf("  sched %s\n", policy_name (policy));
+}
+
+
+/* lowers job k, if the bgnice policy is on and it isn't already */
+void prio_background (int k)
+{
+    unsigned int i;
+    int nice = getpriority (PRIO_PROCESS, 0) + PRIO_BG_NICE;
+
+    if (!bg_policy || J[k].lowered)
+        return;
+
+    for (i=0; i<J[k].npids; i++) {
+        if (J[k].usage[i].done)
+            continue;
+        prio_policy (J[k].pids[i], SCHED_BATCH);
+        prio_nice (J[k].pids[i], nice);
+        prio_io (J[k].pids[i], IOPRIO_CLASS_BE, 7);
+    }
+
+    J[k].lowered = 1;
+}
+
+
+/* undoes prio_background() (whether or not the policy is still on) */
+void prio_foreground (int k)
+{
+    unsigned int i;
+    int nice = getpriority (PRIO_PROCESS, 0);
+    int failed = 0;
+
+    if (!J[k].lowered)
+        return;
+
+    for (i=0; i<J[k].npids; i++) {
+        if (J[k].usage[i].done)
+            continue;
+        prio_policy (J[k].pids[i], SCHED_OTHER);
+        if (prio_nice (J[k].pids[i], nice) == -1)
+            failed = 1;
+        prio_io (J[k].pids[i], IOPRIO_CLASS_NONE, 0);
+    }
+
+    if (failed)
+        printf("pssh: fg: could not restore the nice value of job [%d]\n", k);
+
+    J[k].lowered = 0;
+}
+
+
+void prio_set_bg (int on)
+{
+    bg_policy = on;
+}
+
+
+int prio_get_bg ()
+{
+    return bg_policy;
+}
@@ -0,0 +1,37 @@
+#ifndef _prio_h_
+#define _prio_h_
+
+#include <sys/types.h>
+
+/* Scheduling priority of jobs
+ *
+ * The nice value (setpriority), I/O priority (ioprio_set) and
+ * scheduling policy (sched_setscheduler) of every live process of a
+ * job can be changed by job number.
+ *
+ * With `bgnice on`, a job that goes to the background (a trailing `&`
+ * or `bg`) is lowered to SCHED_BATCH, PRIO_BG_NICE above the shell's
+ * nice value and the lowest best-effort I/O level, and put back the way
+ * it was when it is brought to the foreground with `fg`.  Raising the
+ * nice value back needs CAP_SYS_NICE (or a high enough RLIMIT_NICE);
+ * without it the job keeps its higher nice value. */
+
+#define PRIO_BG_NICE 10
+
+/* I/O scheduling classes, as in linux/ioprio.h */
+#define IOPRIO_CLASS_NONE 0
+#define IOPRIO_CLASS_RT   1
+#define IOPRIO_CLASS_BE   2
+#define IOPRIO_CLASS_IDLE 3
+
+int prio_nice (pid_t pid, int nice);
+int prio_io (pid_t pid, int class, int level);
+int prio_policy (pid_t pid, int policy);
+int prio_policy_parse (const char* name);
+void prio_print (pid_t pid);
+void prio_background (int k);
+void prio_foreground (int k);
+void prio_set_bg (int on);
+int prio_get_bg ();
+
+#endif /* _prio_h_ */
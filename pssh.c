@@ -1,529 +1,1381 @@
-#include <sys/types.h>
-#include <sys/wait.h>
-#include <fcntl.h>
-#include <stdlib.h>
-#include <stdio.h>
-#include <string.h>
-#include <unistd.h>
-#include <readline/readline.h>
-#include <errno.h>
-
-#include "builtin.h"
-#include "parse.h"
-
-/*******************************************
- * Set to 1 to view the command line parse *
- *******************************************/
-#define DEBUG_PARSE 0
-
-Job* J;
-int job_num = 0;
-int our_tty;
-
-
-void print_banner ()
-{
-    printf ("                    ________   \n");
-    printf ("_________________________  /_  \n");
-    printf ("___  __ \\_  ___/_  ___/_  __ \\ \n");
-    printf ("__  /_/ /(__  )_(__  )_  / / / \n");
-    printf ("_  .___//____/ /____/ /_/ /_/  \n");
-    printf ("/_/ Type 'exit' or ctrl+c to quit\n\n");
-}
-
-
-/* **returns** a string used to build the prompt
- * (DO NOT JUST printf() IN HERE!)
- *
- * Note:
- *   If you modify this function to return a string on the heap,
- *   be sure to free() it later when appropirate!  */
-static char* build_prompt ()
-{
-    char *cwd = malloc(sizeof(char) * PATH_MAX);
-    if (getcwd(cwd, PATH_MAX) == NULL) {
-      perror("could not return cwd\n");
-      exit(EXIT_FAILURE);
-    }
-    
-    strcat(cwd, "$ ");
-    
-    return cwd;
-}
-
-
-/* return true if command is found, either:
- *   - a valid fully qualified path was supplied to an existing file
- *   - the executable file was found in the system's PATH
- * false is returned otherwise */
-static int command_found (const char* cmd)
-{
-    char* dir;
-    char* tmp;
-    char* PATH;
-    char* state;
-    char probe[PATH_MAX];
-
-    int ret = 0;
-
-    if (access (cmd, X_OK) == 0)
-        return 1;
-
-    PATH = strdup (getenv("PATH"));
-
-    for (tmp=PATH; ; tmp=NULL) {
-        dir = strtok_r (tmp, ":", &state);
-        if (!dir)
-            break;
-
-        strncpy (probe, dir, PATH_MAX-1);
-        strncat (probe, "/", PATH_MAX-1);
-        strncat (probe, cmd, PATH_MAX-1);
-
-        if (access (probe, X_OK) == 0) {
-            ret = 1;
-            break;
-        }
-    }
-
-    free (PATH);
-    return ret;
-}
-
-void set_fg_pgrp(int pgrp)
-{
-    void (*sav)(int sig);
-
-    if (pgrp == 0)
-        pgrp = getpgrp();
-
-    sav = signal(SIGTTOU, SIG_IGN);
-    tcsetpgrp(our_tty, pgrp);
-    signal(SIGTTOU, sav);
-}
-
-int find_availability() 
-{
-    int i;
-    for (i=0; i<job_num; i++) {
-        if (J[i].name == NULL && J[i].npids == 0)
-            return i;
-    }
-
-    return job_num - 1;
-}
-
-int find_job(pid_t chld)
-{
-    int i, j, index = -1;
-    for (i=0; i<job_num; i++) {
-        for (j=0; j<J[i].npids; j++) {
-            if (J[i].pids[j] == chld) {
-                index = i;
-                break;
-            }
-        }
-        if (index != -1) {
-            break;
-        }
-    }
-
-    return index;
-}
-
-void print_jobs() 
-{
-    if (getpgrp() != tcgetpgrp(STDOUT_FILENO)) {
-        // ensure shell is the fg group
-        set_fg_pgrp(0);
-    }
-
-    int i;
-    for (i=0; i<job_num; i++) {
-        if (J[i].name && J[i].pgid) {
-            char state[15];
-            if (J[i].status == FG || J[i].status == BG) {
-                strcpy(state, "running");
-            }
-            else if (J[i].status == STOPPED) {
-                strcpy(state, "stopped");
-            }
-            printf("[%d] + %s\t%s\n", i, state, J[i].name);
-        }
-    }
-}
-
-void remove_job(int k)
-{
-    // if (J[k].name == NULL && J[k].pgid == 0) {
-    //     printf("Job %d not found.\n", k);
-    //     return;
-    // }
-
-    free(J[k].name);
-    free(J[k].pids);
-
-    J[k].name = NULL;
-    J[k].pids = NULL;
-    J[k].pgid = 0;
-    J[k].npids = 0;
-    J[k].nfinishedtasks = 0;
-    J[k].status = TERM;
-
-    job_num--;
-}
-
-
-void handler(int sig)
-{
-    pid_t chld;
-    int status, idx;
-
-    switch(sig) {
-    case SIGTTOU:
-        while(tcgetpgrp(STDOUT_FILENO) != getpgrp())
-            pause();
-        break;
-    case SIGCHLD:
-        while( (chld = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0 ) {
-            idx = find_job(chld);
-            if (WIFCONTINUED(status)) {
-                set_fg_pgrp(0);
-                printf("[%d] + continued\t%s\n", idx, J[idx].name);
-                return;
-            } else if (WIFSTOPPED(status)) {
-                set_fg_pgrp(0);
-                printf("\n[%d] + suspended\t%s\n", idx, J[idx].name);
-                J[idx].status = STOPPED;
-                return;
-            } else { // waited on terminated children
-                set_fg_pgrp(0);
-                J[idx].nfinishedtasks++;
-                //printf("Job Index: %d   NPIDS: %d   Chld: %d\n", idx, J[idx].npids, chld);
-                if (J[idx].nfinishedtasks == J[idx].npids) {
-                    if (J[idx].status == BG) {
-                        printf("\n[%d] + done\t%s\n", idx, J[idx].name);
-                    }
-                    remove_job(idx);
-                }
-            }
-        }
-
-        break;
-
-    default:
-        break;
-    }
-
-}
-
-void builtin_kill (Task T)
-{
-    pid_t pid;
-    int sig, i, job_id, j;
-    int s_flag = 0;
-    int l_flag = 0;
-
-    // no command line arguments are provided
-    if (T.argv[0] != NULL && T.argv[1] == NULL) {
-        printf("Usage: kill [-s <signal>] <pid> | %%<job> ...\n");
-    }
-    // -l flag is specified
-    else if (T.argv[2] == NULL && strcmp(T.argv[1], "-l") == 0) {
-        l_flag = 1;
-        for (i=0; i < 31; i++) {
-            printf("%2d) SIG%-14s%s\n", i+1, sigabbrev(i+1), strsignal(i+1));
-        }
-    }
-    // no specific signal is provided using -s
-    else if (strcmp(T.argv[1], "-s")) {
-        sig = 15; // SIGTERM
-    }
-    // specific signal is provided using -s
-    else if (!strcmp(T.argv[1], "-s")) {
-        s_flag = 1;
-        sig = atoi(T.argv[2]);
-    }
-
-    for (i=1; T.argv[i] != NULL; i++) {
-        // kill specified job
-        if (T.argv[i][0] == '%') {
-            char* token = strtok(T.argv[i], "%");
-            job_id = atoi(token);
-            if (job_id < 0 || job_id > job_num) {
-                printf("pssh: invalid job number: [%d]\n", job_id);
-            }
-            else {
-                for (j=0; j<J[job_id].npids; j++) {
-                    if (kill(J[job_id].pids[j], sig) == -1) {
-                        printf("pssh: could not send SIG%s to job %d\n", sigabbrev(sig), job_id);
-                    }
-                }
-            }
-        }
-        // kill specified process
-        else {
-            if (!strcmp(T.argv[i], "-s") || l_flag || atoi(T.argv[i]) == sig)
-                continue;
-            
-            pid = atoi(T.argv[i]);
-            if (find_job(pid) == -1 && !l_flag && !s_flag) {
-                printf("pssh: invalid pid: [%d]\n", pid);
-            }
-            else if (sig == 0) {
-                if (kill(pid, sig) == 0) {
-                    printf("pssh: PID %d exists and is able to receive signals\n", pid);
-                }
-                else {
-                    if (errno == ESRCH) {
-                        printf("pssh: PID %d does not exist\n", pid);
-                    }
-                    else if (errno == EPERM) {
-                        printf("pssh: PID %d exists, but we can't send it signals\n", pid);
-                    }
-                    else {
-                        printf("pssh: an invalid signal was specified\n");
-                    }
-                }
-            }
-            else {
-                if (kill(pid, sig) == -1) {
-                    printf("pssh: could not send SIG%s to pid %d\n", sigabbrev(sig), pid);
-                    exit(EXIT_FAILURE);
-                }
-            }
-        }
-    }
-}
-
-
-/* Called upon receiving a successful parse.
- * This function is responsible for cycling through the
- * tasks, and forking, executing, etc as necessary to get
- * the job done! */
-void execute_tasks (Parse* P, char* cmdline)
-{
-    unsigned int t;
-    int pipe_fd[P->ntasks-1][2]; // for pipe between each pair of tasks
-    pid_t job_pids[P->ntasks];
-    int job_idx;
-    int via_bg_cmd = 0;
-
-    // install handlers
-    signal(SIGTTOU, handler);
-    signal(SIGCHLD, handler);
-    signal(SIGINT, handler);
-    signal(SIGTSTP, handler);
-    signal(SIGTTIN, handler);
-    
-    if (!isatty(STDOUT_FILENO)) {
-        printf("STDOUT_FILENO is not a tty.\n");
-        exit(EXIT_FAILURE);
-    }
-
-    our_tty = dup(STDOUT_FILENO);
-    job_num++;
-    job_idx = find_availability();
-
-    J[job_idx].name = malloc(strlen(cmdline)+1);
-    J[job_idx].pids = malloc(sizeof(int)*100);
-    strcpy(J[job_idx].name, cmdline);
-    J[job_idx].nfinishedtasks = 0;
-
-    for (t = 0; t < P->ntasks; t++) {
-        if (is_builtin (P->tasks[t].cmd)) {
-            Task T = P->tasks[t];
-            if (!strcmp(T.cmd, "jobs")) {
-                print_jobs();
-                remove_job(job_idx);
-                return;
-            }
-            else if (!strcmp(P->tasks[t].cmd, "kill")) {
-                builtin_kill(T);
-                remove_job(job_idx);
-                return;
-            }
-            else if (!strcmp(T.cmd, "fg") || !strcmp(T.cmd, "bg")) {
-                if (T.argv[0] != NULL && T.argv[1] == NULL) {
-                    printf("Usage: %s %%<job number>\n", T.cmd);
-                }
-                else {
-                    via_bg_cmd = 1;
-                    char* token = strtok(cmdline, "%");
-                    token = strtok(NULL, "%");
-                    int num = atoi(token);
-                    //set_fg_pgrp(0);
-                    if (!J[num].name) {
-                        printf("pssh: invalid job number: [%d]\n", num);
-                    }
-                    else if (!strcmp(T.cmd, "fg")) {
-                        P->background = 0;
-                        J[num].status = FG;
-                        set_fg_pgrp(J[num].pgid);
-                        kill(-J[num].pgid, SIGCONT);
-                        remove_job(job_idx);
-                        return;
-                    }
-                    else {
-                        P->background = 1;
-                        J[num].status = BG;
-                        set_fg_pgrp(0);
-                        kill(-J[num].pgid, SIGCONT);
-                        remove_job(job_idx);
-                        return;
-                    }
-                }
-            }
-            else {
-                builtin_execute (P->tasks[t], P->infile, P->outfile);
-            }
-        }
-        else if (command_found (P->tasks[t].cmd)) {
-            //printf ("pssh: found but can't exec: %s\n", P->tasks[t].cmd);
-            
-            if (t < P->ntasks - 1) {
-                if (pipe(pipe_fd[t]) == -1) {
-                    perror("failed to create pipe(s)\n");
-                    exit(EXIT_FAILURE);
-                }
-            }
-
-            job_pids[t] = fork();
-            setpgid(job_pids[t], job_pids[0]); // place process into process group
-
-            J[job_idx].pids[J[job_idx].npids] = job_pids[t];
-            J[job_idx].npids++;
-            
-            if (P->background == 0) {
-                set_fg_pgrp(job_pids[0]);
-            }
-
-            if (t == 0) {
-                J[job_idx].pgid = job_pids[0]; // place pgrp id into Jobs array
-                if (P->background)
-                    J[job_idx].status = BG;
-                else
-                    J[job_idx].status = FG;
-            }
-            
-            if (job_pids[t] == -1) {
-                perror("error -- failed to fork()\n");
-                exit(EXIT_FAILURE);
-            }
-            else if (job_pids[t] == 0) {
-                close(our_tty);
-                
-                if (P->infile) {
-                    infile_redirect(P->infile);
-                }
-                
-                if (P->outfile) {
-                    outfile_redirect(P->outfile);
-                }
-                
-                if (t > 0) {
-                    close(pipe_fd[t-1][1]);
-                    if (dup2(pipe_fd[t-1][0], STDIN_FILENO) == -1) {
-                        perror("dup2() 1 failed\n");
-                        exit(EXIT_FAILURE);
-                    }
-                    close(pipe_fd[t-1][0]);
-                    //printf("reading from prev works\n");
-                }
-                
-                if (t < P->ntasks - 1) {
-                    close(pipe_fd[t][0]);
-                    if (dup2(pipe_fd[t][1], STDOUT_FILENO) == -1) {
-                        perror("dup2() 4 failed\n");
-                        exit(EXIT_FAILURE);
-                    }
-                    close(pipe_fd[t][1]);
-                    //printf("writing to next works\n");
-                }
-                
-                // execute task(s)
-                execvp(P->tasks[t].cmd, P->tasks[t].argv);
-                printf("pssh: child -- failed to exec!\n");
-                exit(EXIT_FAILURE);
-            }
-            
-            // close parent-side read/write endpoints
-            if (t < P->ntasks - 1) {
-                close(pipe_fd[t][1]);
-            }
-            if (t > 0) {
-                close(pipe_fd[t-1][0]);
-            }
-        }
-        else {
-            printf ("pssh: command not found: %s\n", P->tasks[t].cmd);
-            break;
-        }
-    }
-
-    // check that all child processes have been terminated
-    if (!P->background) {
-        for (t=0; t<P->ntasks; t++) {
-            while (!kill(job_pids[t], 0) && J[job_idx].status == FG)
-                pause();
-        }
-    }
-    else {
-        if (!via_bg_cmd) {
-            printf("[%d] ", job_idx);
-            for (t=0; t<J[job_idx].npids; t++) {
-                printf("%d ", J[job_idx].pids[t]);
-            }
-            printf("\n");
-        }
-    }
-
-    printf(" \n");
-
-    close(our_tty);
-}
-
-
-int main (int argc, char** argv)
-{
-    char* cmdline;
-    Parse* P;
-    // initialize jobs array
-    J = new_jobs();
-
-    print_banner ();
-    char *prompt;
-
-    while (1) {
-        fflush(stdout);
-        prompt = build_prompt();
-        cmdline = readline (prompt);
-
-        char* cmd = malloc(strlen(cmdline)+1);
-        strcpy(cmd, cmdline);
-
-        if (!cmdline)       /* EOF (ex: ctrl-d) */
-            exit (EXIT_SUCCESS);
-
-        P = parse_cmdline (cmdline);
-        if (!P)
-            goto next;
-
-        if (P->invalid_syntax) {
-            printf ("pssh: invalid syntax\n");
-            goto next;
-        }
-
-#if DEBUG_PARSE
-        parse_debug (P);
-#endif
-
-        execute_tasks (P, cmd);
-
-    next:
-        parse_destroy (&P);
-        free(cmd);
-        free(cmdline);
-        free(prompt);
-    }
-}
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <readline/readline.h>
+#include <errno.h>
+
+#include "builtin.h"
+#include "parse.h"
+#include "hash.h"
+#include "launch.h"
+#include "input.h"
+#include "loop.h"
+#include "arena.h"
+#include "pcache.h"
+#include "trace.h"
+#include "stats.h"
+#include "parallel.h"
+#include "admit.h"
+#include "affinity.h"
+#include "prio.h"
+#include "cgroup.h"
+#include "watchdog.h"
+#include "serve.h"
+#include "vars.h"
+#include "expand.h"
+#include "func.h"
+
+/*******************************************
+ * Set to 1 to view the command line parse *
+ *******************************************/
+#define DEBUG_PARSE 0
+
+/* iterations of a loop between looks at the event loop */
+#define LOOP_POLL 256
+
+extern char** environ;
+
+int our_tty = -1;
+int interactive = 1;  /* reading commands from a terminal? */
+int last_status = 0;  /* exit status of the last foreground pipeline */
+pid_t shell_pid;      /* ours, as opposed to a subshell's */
+
+static int at_prompt = 0;  /* readline is showing the prompt */
+static int interrupted = 0; /* ^C while the shell itself was busy */
+static long prompt_ts = 0; /* trace time the prompt went up */
+static Arena* A;           /* scratch memory for one command line */
+static char* pending = NULL; /* the lines so far of an unfinished command */
+
+static Script* running;    /* the Script whose tree is being walked */
+static int loop_depth = 0; /* loops we are in (in this function) */
+static int func_depth = 0; /* function calls we are in */
+static int breaking = 0;   /* loops a `break n` has yet to leave */
+static int continuing = 0; /* ... and a `continue n` */
+static int returning = 0;  /* a `return` on its way out of a function */
+
+
+void print_banner ()
+{
+    printf ("                    ________   \n");
+    printf ("_________________________  /_  \n");
+    printf ("___  __ \\_  ___/_  ___/_  __ \\ \n");
+    printf ("__  /_/ /(__  )_(__  )_  / / / \n");
+    printf ("_  .___//____/ /____/ /_/ /_/  \n");
+    printf ("/_/ Type 'exit' or ctrl+c to quit\n\n");
+}
+
+
+/* **returns** a string used to build the prompt
+ * (DO NOT JUST printf() IN HERE!)
+ *
+ * Note:
+ *   If you modify this function to return a string on the heap,
+ *   be sure to free() it later when appropirate!  */
+static char* build_prompt ()
+{
+    char *cwd = malloc(sizeof(char) * PATH_MAX);
+    if (getcwd(cwd, PATH_MAX) == NULL) {
+      perror("could not return cwd\n");
+      exit(EXIT_FAILURE);
+    }
+    
+    strcat(cwd, "$ ");
+    
+    return cwd;
+}
+
+
+void set_fg_pgrp(int pgrp)
+{
+    void (*sav)(int sig);
+
+    if (!interactive)
+        return;
+
+    if (pgrp == 0)
+        pgrp = getpgrp();
+
+    sav = signal(SIGTTOU, SIG_IGN);
+    tcsetpgrp(our_tty, pgrp);
+    signal(SIGTTOU, sav);
+}
+
+/* `jobs -l` also lists every stage with its resource usage so far */
+void print_jobs(int verbose)
+{
+    if (interactive && getpgrp() != tcgetpgrp(STDOUT_FILENO)) {
+        // ensure shell is the fg group
+        set_fg_pgrp(0);
+    }
+
+    int i;
+    for (i=0; i<njobs; i++) {
+        if (J[i].name && (J[i].pgid || J[i].status == QUEUED)) {
+            char state[24];
+            if (J[i].timedout && J[i].status != QUEUED) {
+                strcpy(state, "timing out");
+            }
+            else if (J[i].frozen && (J[i].status == FG || J[i].status == BG)) {
+                strcpy(state, "frozen");
+            }
+            else if (J[i].status == FG || J[i].status == BG) {
+                strcpy(state, "running");
+            }
+            else if (J[i].status == STOPPED) {
+                strcpy(state, "stopped");
+            }
+            else if (J[i].status == QUEUED) {
+                sprintf(state, "queued #%u", admit_position(i));
+            }
+            printf("[%d] + %s\t%s\n", i, state, J[i].name);
+            if (verbose)
+                job_print_usage(i, stdout);
+        }
+    }
+}
+
+/* records the lifetime of a reaped stage on its own trace track */
+static void trace_stage (int k, unsigned int task)
+{
+    TaskUsage* u = &J[k].usage[task];
+    char state[32];
+
+    if (!trace_enabled())
+        return;
+
+    if (WIFEXITED(u->status))
+        snprintf(state, sizeof(state), "exit %d", WEXITSTATUS(u->status));
+    else
+        snprintf(state, sizeof(state), "SIG%s", sigabbrev(WTERMSIG(u->status)));
+
+    trace_span("stage", u->cmd, trace_ts(&u->start), trace_ts(&u->end),
+               J[k].pids[task], state);
+}
+
+/* Runs synchronously from the event loop (via the signalfd), so it is
+ * free to print and to touch the job table. */
+void handler(int sig)
+{
+    pid_t chld;
+    struct rusage ru;
+    unsigned int task;
+    int status, idx;
+    void* owner;
+    JobDoneFn done;
+
+    switch(sig) {
+    case SIGINT:
+        if (at_prompt) {
+            // discard the partially typed line
+            rl_free_line_state();
+            rl_replace_line("", 0);
+            rl_crlf();
+            rl_on_new_line();
+        }
+        else {
+            interrupted = 1;
+        }
+        break;
+    case SIGCHLD:
+        stats_inc(STAT_SIGCHLD);
+        while( (chld = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &ru)) > 0 ) {
+            idx = find_task(chld, &task);
+            if (idx == -1)
+                continue;
+
+            if (WIFCONTINUED(status)) {
+                printf("[%d] + continued\t%s\n", idx, J[idx].name);
+                trace_instant("job", "continued", 0, J[idx].name);
+            } else if (WIFSTOPPED(status)) {
+                if (J[idx].status == FG) {
+                    set_fg_pgrp(0);
+                    last_status = 128 + WSTOPSIG(status);
+                }
+                printf("\n[%d] + suspended\t%s\n", idx, J[idx].name);
+                trace_instant("job", "stopped", 0, J[idx].name);
+                J[idx].status = STOPPED;
+            } else { // waited on terminated children
+                job_task_done(idx, task, status, &ru);
+                stats_inc(STAT_REAPED);
+                trace_stage(idx, task);
+                job_forget_pid(chld);
+                J[idx].nfinishedtasks++;
+                if (J[idx].status == FG && chld == J[idx].pids[J[idx].npids-1])
+                    last_status = WIFEXITED(status) ? WEXITSTATUS(status) :
+                                                      128 + WTERMSIG(status);
+                //printf("Job Index: %d   NPIDS: %d   Chld: %d\n", idx, J[idx].npids, chld);
+                if (J[idx].nfinishedtasks == J[idx].npids) {
+                    owner = J[idx].owner;
+                    done = J[idx].done;
+                    trace_instant("job", "done", 0, J[idx].name);
+                    if (J[idx].timed || (J[idx].limited && J[idx].cgroup != -1)) {
+                        fflush(stdout);
+                        if (J[idx].timed)
+                            job_print_usage(idx, stderr);
+                        cgroup_job_report(idx, stderr);
+                    }
+                    cgroup_job_destroy(idx);
+                    if (J[idx].status == FG && J[idx].timedout)
+                        last_status = 124;
+                    if (J[idx].timedout && !owner) {
+                        printf("\n[%d] + timed out\t%s\n", idx, J[idx].name);
+                    }
+                    else if (J[idx].status == BG && !owner) {
+                        printf("\n[%d] + done\t%s\n", idx, J[idx].name);
+                    }
+                    if (J[idx].status == FG) {
+                        set_fg_pgrp(0);
+                    }
+                    status = J[idx].timedout ? W_EXITCODE(124, 0) :
+                                               J[idx].usage[J[idx].npids-1].status;
+                    remove_job(idx);
+                    if (done)
+                        done(owner, idx, status);
+                    admit_pump();
+                }
+            }
+        }
+
+        break;
+
+    default:
+        break;
+    }
+
+}
+
+
+static void on_signal (int fd, unsigned int events, void* data)
+{
+    struct signalfd_siginfo si[16];
+    ssize_t n;
+    int i;
+
+    while ((n = read(fd, si, sizeof(si))) > 0) {
+        for (i=0; i<n/sizeof(*si); i++)
+            handler(si[i].ssi_signo);
+    }
+
+    if (at_prompt)
+        rl_forced_update_display();
+}
+
+
+/* The signals we care about are blocked for good and read from a
+ * signalfd instead, so job state only ever changes between events */
+static void signals_init ()
+{
+    sigset_t mask;
+    int sfd;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (interactive) {
+        sigaddset(&mask, SIGINT);
+        sigaddset(&mask, SIGQUIT);
+        sigaddset(&mask, SIGTSTP);
+        sigaddset(&mask, SIGTTIN);
+        sigaddset(&mask, SIGTTOU);
+    }
+
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sfd == -1) {
+        perror("signalfd() failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    loop_add(sfd, EPOLLIN, on_signal, NULL);
+}
+
+
+/* services the event loop until job k is no longer in the foreground */
+static void wait_fg (int k)
+{
+    struct timespec start, end;
+    long t0 = trace_now();
+
+    if (!job_valid(k))
+        return;
+
+    trace_instant("job", "foreground", 0, J[k].name);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (job_valid(k) && J[k].status == FG)
+        loop_once(-1);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats_observe(HIST_FOREGROUND, (end.tv_sec - start.tv_sec) * 1000000L +
+                                   (end.tv_nsec - start.tv_nsec) / 1000);
+    trace_span("job", "wait", t0, trace_now(), 0, NULL);
+}
+
+
+/* Runs a `parallel` batch.  In the foreground the shell keeps the
+ * terminal and services the event loop until the batch is done (^C
+ * cancels it); with '&' the batch carries on from the SIGCHLD path. */
+static void builtin_parallel (Task T, char* infile, int background)
+{
+    Batch* b;
+
+    interrupted = 0;
+
+    if (!(b = parallel_new(T, infile, interactive))) {
+        last_status = 2;
+        return;
+    }
+
+    if (background) {
+        parallel_detach(b);
+        return;
+    }
+
+    while (parallel_busy(b)) {
+        if (interrupted) {
+            parallel_cancel(b);
+            interrupted = 0;
+        }
+        loop_once(-1);
+    }
+
+    last_status = parallel_failed(b) > 101 ? 101 : parallel_failed(b);
+    parallel_free(b);
+}
+
+
+/* hash_lookup(), traced, in the PATH of a `PATH=...` prefix if T has one */
+static const char* lookup (Task* T)
+{
+    long t0 = trace_now();
+    const char* PATH = NULL;
+    const char* path;
+    char** a;
+
+    for (a=T->assign; a && *a; a++)
+        if (!strncmp(*a, "PATH=", 5))
+            PATH = *a + 5;
+
+    path = hash_lookup_in(T->cmd, PATH);
+
+    trace_span("resolve", "hash_lookup", t0, trace_now(), 0, T->cmd);
+
+    return path;
+}
+
+void builtin_kill (Task T)
+{
+    pid_t pid;
+    int sig, i, job_id, j;
+    int s_flag = 0;
+    int l_flag = 0;
+
+    // no command line arguments are provided
+    if (T.argv[0] != NULL && T.argv[1] == NULL) {
+        printf("Usage: kill [-s <signal>] <pid> | %%<job> ...\n");
+    }
+    // -l flag is specified
+    else if (T.argv[2] == NULL && strcmp(T.argv[1], "-l") == 0) {
+        l_flag = 1;
+        for (i=0; i < 31; i++) {
+            printf("%2d) SIG%-14s%s\n", i+1, sigabbrev(i+1), strsignal(i+1));
+        }
+    }
+    // no specific signal is provided using -s
+    else if (strcmp(T.argv[1], "-s")) {
+        sig = 15; // SIGTERM
+    }
+    // specific signal is provided using -s
+    else if (!strcmp(T.argv[1], "-s")) {
+        s_flag = 1;
+        sig = atoi(T.argv[2]);
+    }
+
+    for (i=1; T.argv[i] != NULL; i++) {
+        // kill specified job
+        if (T.argv[i][0] == '%') {
+            job_id = atoi(T.argv[i]+1);
+            if (!job_valid(job_id)) {
+                printf("pssh: invalid job number: [%d]\n", job_id);
+            }
+            else if (J[job_id].status == QUEUED) {
+                // never started: just take it off the queue
+                admit_remove(job_id);
+                remove_job(job_id);
+            }
+            else if (sig == SIGKILL && cgroup_job_kill(job_id) == 0) {
+                // the leaf takes everything the job forked with it
+            }
+            else {
+                for (j=0; j<J[job_id].npids; j++) {
+                    if (kill(J[job_id].pids[j], sig) == -1) {
+                        printf("pssh: could not send SIG%s to job %d\n", sigabbrev(sig), job_id);
+                    }
+                }
+            }
+        }
+        // kill specified process
+        else {
+            if (!strcmp(T.argv[i], "-s") || l_flag || atoi(T.argv[i]) == sig)
+                continue;
+            
+            pid = atoi(T.argv[i]);
+            if (find_job(pid) == -1 && !l_flag && !s_flag) {
+                printf("pssh: invalid pid: [%d]\n", pid);
+            }
+            else if (sig == 0) {
+                if (kill(pid, sig) == 0) {
+                    printf("pssh: PID %d exists and is able to receive signals\n", pid);
+                }
+                else {
+                    if (errno == ESRCH) {
+                        printf("pssh: PID %d does not exist\n", pid);
+                    }
+                    else if (errno == EPERM) {
+                        printf("pssh: PID %d exists, but we can't send it signals\n", pid);
+                    }
+                    else {
+                        printf("pssh: an invalid signal was specified\n");
+                    }
+                }
+            }
+            else {
+                if (kill(pid, sig) == -1) {
+                    printf("pssh: could not send SIG%s to pid %d\n", sigabbrev(sig), pid);
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+    }
+}
+
+
+static void start_queued (int k);
+
+
+/* Runs builtin T in the shell and returns its exit status.  infile
+ * and background are those of its command line (for `parallel`). */
+static int dispatch_builtin (Task T, char* infile, int background)
+{
+    int num;
+
+    if (!strcmp(T.cmd, "jobs")) {
+        print_jobs(T.argv[1] && !strcmp(T.argv[1], "-l"));
+    }
+    else if (!strcmp(T.cmd, "parallel")) {
+        builtin_parallel(T, infile, background);
+        return last_status;
+    }
+    else if (!strcmp(T.cmd, "kill")) {
+        builtin_kill(T);
+    }
+    else if (!strcmp(T.cmd, "fg") || !strcmp(T.cmd, "bg")) {
+        if (T.argv[0] != NULL && T.argv[1] == NULL) {
+            printf("Usage: %s %%<job number>\n", T.cmd);
+            return 2;
+        }
+
+        num = atoi(T.argv[1] + (T.argv[1][0] == '%'));
+        if (!job_valid(num)) {
+            printf("pssh: invalid job number: [%d]\n", num);
+            return 1;
+        }
+        else if (J[num].status == QUEUED) {
+            if (!strcmp(T.cmd, "bg")) {
+                // start it now, whatever the limits say
+                admit_remove(num);
+                start_queued(num);
+            } else {
+                printf("pssh: fg: job [%d] is queued (bg starts it now)\n", num);
+                return 1;
+            }
+        }
+        else if (!strcmp(T.cmd, "fg")) {
+            trace_instant("job", "fg", 0, J[num].name);
+            J[num].status = FG;
+            prio_foreground(num);
+            set_fg_pgrp(J[num].pgid);
+            kill(-J[num].pgid, SIGCONT);
+            wait_fg(num);
+            return last_status;
+        }
+        else {
+            trace_instant("job", "bg", 0, J[num].name);
+            J[num].status = BG;
+            prio_background(num);
+            set_fg_pgrp(0);
+            kill(-J[num].pgid, SIGCONT);
+        }
+    }
+    else if (!strcmp(T.cmd, "break") || !strcmp(T.cmd, "continue")) {
+        num = T.argv[1] ? atoi(T.argv[1]) : 1;
+        if (num < 1) {
+            printf("pssh: %s: loop count out of range\n", T.cmd);
+            return 1;
+        }
+        if (!loop_depth) {
+            printf("pssh: %s: only meaningful in a loop\n", T.cmd);
+            return 0;
+        }
+        if (num > loop_depth)
+            num = loop_depth;
+        if (T.cmd[0] == 'b')
+            breaking = num;
+        else
+            continuing = num;
+    }
+    else if (!strcmp(T.cmd, "return")) {
+        if (!func_depth) {
+            printf("pssh: return: can only return from a function\n");
+            return 1;
+        }
+        returning = 1;
+        return T.argv[1] ? atoi(T.argv[1]) & 0xff : last_status;
+    }
+    else {
+        return builtin_execute(T);
+    }
+
+    return 0;
+}
+
+
+/* dispatch_builtin() with T's NAME=value words set while it runs */
+static int run_builtin (Task T, char* infile, int background)
+{
+    int status;
+
+    if (!T.assign)
+        return dispatch_builtin(T, infile, background);
+
+    var_push(T.assign);
+    status = dispatch_builtin(T, infile, background);
+    var_pop(T.assign);
+
+    return status;
+}
+
+
+/* Is T a builtin?  `env` with arguments is the env program. */
+static int builtin_task (Task* T)
+{
+    return T->cmd && is_builtin(T->cmd) &&
+           !(T->argv[1] && !strcmp(T->cmd, "env"));
+}
+
+
+/* StageFn for a builtin in a pipeline: it runs in a child of its own,
+ * like any other stage.  The builtins that drive the shell's event
+ * loop or other jobs' terminal can't work from there. */
+static int builtin_stage (void* arg)
+{
+    Task* T = arg;
+
+    if (!strcmp(T->cmd, "fg") || !strcmp(T->cmd, "bg") ||
+        !strcmp(T->cmd, "parallel")) {
+        printf("pssh: %s: can't be used in a pipeline\n", T->cmd);
+        return 1;
+    }
+
+    return run_builtin(*T, NULL, 0);
+}
+
+
+static void execute_node (Node* N);
+
+
+/* Runs function f with argv as its $0 .. $n.  The Script its body
+ * lives in is held for the call, since the function may be redefined
+ * (or its command line evicted from the parse cache) while it runs. */
+static int call_function (Func* f, char** argv)
+{
+    Script* owner = f->owner;
+    Script* saved = running;
+    int depth = loop_depth;
+
+    if (func_depth == FUNC_MAX_DEPTH) {
+        printf("pssh: %s: maximum function nesting level exceeded (%d)\n",
+               f->name, FUNC_MAX_DEPTH);
+        return 1;
+    }
+
+    pcache_hold(owner);
+    var_args_push(argv);
+    func_depth++;
+    loop_depth = 0;
+    running = owner;
+
+    execute_node(f->body);
+
+    running = saved;
+    loop_depth = depth;
+    func_depth--;
+    returning = 0;
+    var_args_pop();
+    pcache_put(owner);
+
+    return last_status;
+}
+
+
+/* Runs a stage that needs no process of its own (see runs_here())
+ * right where we are: in the shell, or in the child of shell_stage(). */
+static int run_stage (Task* T)
+{
+    char** a;
+    Func* f;
+    int status;
+
+    if (!T->cmd) {          /* assignments, or everything expanded to nothing */
+        for (a=T->assign; a && *a; a++)
+            var_assign(*a);
+        return 0;
+    }
+
+    if (T->group) {
+        execute_node(T->group);
+        return last_status;
+    }
+
+    if ((f = func_lookup(T->cmd))) {
+        if (!T->assign)
+            return call_function(f, T->argv);
+        var_push(T->assign);
+        status = call_function(f, T->argv);
+        var_pop(T->assign);
+        return status;
+    }
+
+    return run_builtin(*T, NULL, 0);
+}
+
+
+/* StageFn for a stage the shell itself runs: a compound command, a
+ * function, an assignment.  The child becomes a shell of its own: none
+ * of our jobs, no terminal, and a fresh event loop, since the epoll
+ * instance and timerfds it inherited are shared with us.  The tree it
+ * walks is the one in our (still pinned) parse. */
+static int shell_stage (void* arg)
+{
+    Task* T = arg;
+    int k;
+
+    interactive = 0;
+    at_prompt = 0;
+
+    for (k=0; k<njobs; k++) {
+        if (!job_valid(k))
+            continue;
+        if (J[k].cgroup != -1)
+            close(J[k].cgroup);     // the leaf stays with the job
+        J[k].cgroup = -1;
+        remove_job(k);
+    }
+
+    loop_init();
+    admit_init(start_queued);
+    watchdog_init();
+    signals_init();
+
+    return run_stage(T);
+}
+
+
+static StageFn stage_fn (Task* T)
+{
+    if (!T->cmd || T->group || func_lookup(T->cmd))
+        return shell_stage;
+
+    return builtin_task(T) ? builtin_stage : NULL;
+}
+
+
+static int has_builtin (Parse* P)
+{
+    int t;
+
+    for (t=0; t<P->ntasks; t++)
+        if (builtin_task(&P->tasks[t]))
+            return 1;
+
+    return 0;
+}
+
+
+/* Can P run inside the shell, without a fork?  Its one stage has to be
+ * an assignment, a function or a compound command other than a
+ * ( subshell ), in the foreground and with nothing to account for.
+ * (Builtins always run in the shell: see launch_tasks().) */
+static int runs_here (Parse* P)
+{
+    Task* T = &P->tasks[0];
+
+    if (P->ntasks != 1 || P->background || P->timed || P->limits || P->timeout)
+        return 0;
+
+    return !T->cmd || (T->group && T->group->type != NODE_SUBSHELL)
+                   || func_lookup(T->cmd);
+}
+
+
+/* Called upon receiving a successful parse.
+ * This function is responsible for cycling through the
+ * tasks, and forking, executing, etc as necessary to get
+ * the job done!
+ *
+ * job_idx is the job to run the pipeline as (a queued job being
+ * started), or -1 for a new one.  A new background pipeline is
+ * queued instead of started if admission control says so. */
+static void launch_tasks (Parse* P, char* cmdline, int job_idx)
+{
+    unsigned int t;
+    int pipe_fd[P->ntasks-1][2]; // for pipe between each pair of tasks
+    pid_t pid;
+    const char* path;
+    Stage S;
+    cpu_set_t cpus;
+    Limits L;
+    char** w;
+    long deadline;
+    int launched = 0;
+    StageFn fn;
+    int detached, background;
+    Redir R;
+    long t0;
+
+    if (job_idx == -1) {
+        job_idx = find_availability(cmdline, P->ntasks);
+        J[job_idx].timed = P->timed;
+
+        if (P->background && !has_builtin(P) && !admit_ok()) {
+            admit_enqueue(job_idx);
+            if (interactive)
+                printf("[%d] queued #%u\n", job_idx, admit_position(job_idx));
+            last_status = 0;
+            return;
+        }
+    }
+
+    // a job with an owner to report to (serve.h) is never waited for
+    detached = J[job_idx].done != NULL;
+    background = P->background || detached;
+
+    limits_init(&L);
+    if (P->limits) {
+        for (w=P->limits; *w; w++) {
+            if (limits_parse(&L, *w) == -1) {
+                printf("pssh: limit: bad setting: %s\n", *w);
+                last_status = 2;
+                goto done;
+            }
+        }
+        J[job_idx].limited = 1;
+    }
+
+    deadline = watchdog_get_default();
+    if (P->timeout && (deadline = watchdog_parse(P->timeout)) == -1) {
+        printf("pssh: timeout: bad duration: %s\n", P->timeout);
+        last_status = 2;
+        goto done;
+    }
+
+    // a builtin on its own runs right here, without a fork
+    if (P->ntasks == 1 && builtin_task(&P->tasks[0])) {
+        t0 = trace_now();
+        if (redirect_save(&R, P->infile, P->outfile) == -1) {
+            last_status = 1;
+        } else {
+            last_status = run_builtin(P->tasks[0], P->infile, P->background);
+            redirect_restore(&R);
+        }
+        trace_span("builtin", P->tasks[0].cmd, t0, t0 ? trace_now() : 0, 0, NULL);
+        goto done;
+    }
+
+    for (t = 0; t < P->ntasks; t++) {
+        fn = stage_fn (&P->tasks[t]);
+        if (fn || (path = lookup (&P->tasks[t]))) {
+            //printf ("pssh: found but can't exec: %s\n", P->tasks[t].cmd);
+            
+            if (t < P->ntasks - 1) {
+                if (pipe2(pipe_fd[t], O_CLOEXEC) == -1) {
+                    perror("failed to create pipe(s)\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+
+            if (!launched++) {
+                launch_begin_pipeline();
+                affinity_begin_pipeline(P->ntasks);
+                J[job_idx].cgroup = cgroup_job_create(job_idx, &L);
+            }
+
+            S.path = fn ? NULL : path;
+            S.argv = P->tasks[t].argv;
+            S.envp = (P->tasks[t].assign && !fn) ?
+                     var_environ_with(A, P->tasks[t].assign) : NULL;
+            S.fn = fn;
+            S.arg = &P->tasks[t];
+            S.infile = (t == 0) ? P->infile : NULL;
+            S.outfile = (t == P->ntasks - 1) ? P->outfile : NULL;
+            S.in_fd = (t > 0) ? pipe_fd[t-1][0] : -1;
+            S.out_fd = (t < P->ntasks - 1) ? pipe_fd[t][1] : -1;
+            S.next_fd = (t < P->ntasks - 1) ? pipe_fd[t][0] : -1;
+            S.pgid = (interactive || detached) ? J[job_idx].pgid : -1;
+            S.cpus = affinity_stage(t, P->tasks[t].cpus, &cpus) ? &cpus : NULL;
+            S.cgroup = J[job_idx].cgroup;
+            S.limits = limits_set(&L) ? &L : NULL;
+
+            t0 = trace_now();
+            pid = launch_stage(&S);
+            trace_span("launch", launch_mode_name(launch_get_mode()),
+                       t0, trace_now(), 0, P->tasks[t].cmd);
+
+            // close parent-side read/write endpoints
+            if (t < P->ntasks - 1) {
+                close(pipe_fd[t][1]);
+            }
+            if (t > 0) {
+                close(pipe_fd[t-1][0]);
+            }
+
+            if (pid == -1)
+                continue;
+
+            job_add_pid(job_idx, pid, P->tasks[t].cmd ? P->tasks[t].cmd : "");
+
+            if (!J[job_idx].pgid) {
+                J[job_idx].pgid = pid; // place pgrp id into Jobs array
+                if (background)
+                    J[job_idx].status = BG;
+                else
+                    J[job_idx].status = FG;
+            }
+
+            if (background == 0) {
+                set_fg_pgrp(J[job_idx].pgid);
+            }
+        }
+        else {
+            printf ("pssh: command not found: %s\n", P->tasks[t].cmd);
+            stats_inc(STAT_EXEC_FAILURES);
+            last_status = 127;
+            break;
+        }
+    }
+
+    if (!J[job_idx].npids)
+        goto done;
+
+    if (deadline)
+        watchdog_arm(job_idx, deadline);
+
+    // wait for the foreground job to finish or stop
+    if (!background) {
+        wait_fg(job_idx);
+    }
+    else {
+        prio_background(job_idx);
+        last_status = 0;
+        if (interactive) {
+            printf("[%d] ", job_idx);
+            for (t=0; t<J[job_idx].npids; t++) {
+                printf("%d ", J[job_idx].pids[t]);
+            }
+            printf("\n");
+        }
+    }
+
+    if (interactive)
+        printf(" \n");
+
+    job_idx = -1;
+
+done:
+    cgroup_job_destroy(job_idx);
+    remove_job(job_idx);
+}
+
+
+/* Runs pipeline P: its words are expanded (into scratch memory that is
+ * let go of as soon as it has run, so a loop doesn't pile it up), and
+ * then it either runs right here or is launched as a job. */
+void execute_tasks (Parse* P, char* cmdline, int job_idx)
+{
+    ArenaMark m = arena_mark (A);
+    Parse* E = expand_parse (A, P);
+    Redir R;
+
+    if (!E) {
+        last_status = 1;
+    }
+    else if (job_idx == -1 && runs_here (E)) {
+        if (redirect_save (&R, E->infile, E->outfile) == -1) {
+            last_status = 1;
+        } else {
+            last_status = run_stage (&E->tasks[0]);
+            redirect_restore (&R);
+        }
+    }
+    else {
+        launch_tasks (E, cmdline, job_idx);
+    }
+
+    if (P->negate && !P->background)
+        last_status = !last_status;
+
+    arena_release (A, m);
+}
+
+
+/* admission control lets queued job k go: its pipeline is parsed
+ * again (normally a parse cache hit) and run as that job */
+static void start_queued (int k)
+{
+    Script* S = pcache_get(J[k].name);
+
+    Script* saved = running;
+
+    if (!S || S->invalid_syntax || S->root->type != NODE_PIPELINE) {
+        remove_job(k);
+    } else {
+        J[k].status = TERM;
+        running = S;
+        execute_tasks(S->root->pipeline, J[k].name, k);
+        running = saved;
+    }
+
+    pcache_put(S);
+}
+
+
+/* Does the rest of a list get skipped?  A job killed by ^C takes the
+ * rest of its command line with it, and a break, continue or return
+ * skips everything up to the loop or function it is for. */
+static int cancelled ()
+{
+    return interrupted || last_status == 128 + SIGINT ||
+           breaking || continuing || returning;
+}
+
+
+/* After a loop's body: does the loop end here?  A `continue n` ends
+ * the n-1 loops inside the one it continues. */
+static int loop_done ()
+{
+    if (breaking) {
+        breaking--;
+        return 1;
+    }
+
+    if (continuing)
+        return --continuing > 0;
+
+    return cancelled ();
+}
+
+
+/* A loop of nothing but builtins never waits on the event loop, so
+ * every so often it takes a look at it (for a ^C, and for the jobs
+ * it has in the background). */
+static void loop_poll (unsigned long n)
+{
+    if (n % LOOP_POLL == 0)
+        loop_once (0);
+}
+
+
+/* while and until.  Every iteration walks the tree compiled when the
+ * line was parsed, so it costs what its commands cost and no more. */
+static void execute_while (Node* N)
+{
+    unsigned long n;
+    int status = 0;
+
+    loop_depth++;
+
+    for (n=1; ; n++) {
+        loop_poll (n);
+
+        execute_node (N->left);
+        if (cancelled ()) {
+            status = last_status;
+            if (loop_done ())
+                break;
+            continue;
+        }
+        if ((last_status == 0) != (N->type == NODE_WHILE))
+            break;
+
+        execute_node (N->right);
+        status = last_status;
+        if (cancelled () && loop_done ())
+            break;
+    }
+
+    loop_depth--;
+    last_status = status;
+}
+
+
+/* for name in words (the positional parameters without any) */
+static void execute_for (Node* N)
+{
+    ArenaMark m = arena_mark (A);
+    char** list = N->argv;
+    unsigned long n;
+    int status = 0;
+
+    if (!list) {
+        list = var_args ();
+    }
+    else if (N->words && expand_words (A, N->argv, N->words, &list) == -1) {
+        last_status = 1;
+        arena_release (A, m);
+        return;
+    }
+
+    loop_depth++;
+
+    for (n=0; list[n]; n++) {
+        loop_poll (n + 1);
+
+        var_set (N->name, list[n]);
+        execute_node (N->right);
+        status = last_status;
+        if (cancelled () && loop_done ())
+            break;
+    }
+
+    loop_depth--;
+    last_status = status;
+    arena_release (A, m);
+}
+
+
+/* Walks a command line's tree.  `&&` and `||` look at the status of
+ * whatever ran last; every pipeline is its own job, named after its
+ * own part of the line.  A compound command gets here as a stage of
+ * a pipeline (see run_stage()). */
+static void execute_node (Node* N)
+{
+    switch (N->type) {
+    case NODE_PIPELINE:
+        execute_tasks (N->pipeline, N->pipeline->text, -1);
+        break;
+
+    case NODE_SEQ:
+        execute_node (N->left);
+        if (!cancelled ())
+            execute_node (N->right);
+        break;
+
+    case NODE_AND:
+        execute_node (N->left);
+        if (last_status == 0 && !cancelled ())
+            execute_node (N->right);
+        break;
+
+    case NODE_OR:
+        execute_node (N->left);
+        if (last_status != 0 && !cancelled ())
+            execute_node (N->right);
+        break;
+
+    case NODE_SUBSHELL:     /* we are the subshell: see shell_stage() */
+    case NODE_BRACE:
+        execute_node (N->left);
+        break;
+
+    case NODE_IF:
+        execute_node (N->left);
+        if (cancelled ())
+            break;
+        if (last_status == 0)
+            execute_node (N->right);
+        else if (N->other)
+            execute_node (N->other);
+        else
+            last_status = 0;
+        break;
+
+    case NODE_WHILE:
+    case NODE_UNTIL:
+        execute_while (N);
+        break;
+
+    case NODE_FOR:
+        execute_for (N);
+        break;
+
+    case NODE_FUNCTION:
+        func_define (N->name, N->left, running);
+        last_status = 0;
+        break;
+    }
+}
+
+
+/* Parse (or fetch from the parse cache) and run a single command line.
+ * Returns 1, having run nothing, if the line stops in the middle of a
+ * command and the caller has more lines to add to it (more is set). */
+static int run_cmdline (char* cmdline, int more)
+{
+    Script* S;
+    Script* saved = running;
+    long t0 = trace_now ();
+#if DEBUG_PARSE
+    unsigned int i;
+#endif
+
+    S = pcache_get (cmdline);
+    trace_span ("parse", "pcache_get", t0, trace_now (), 0, cmdline);
+    if (!S)
+        return 0;
+
+    if (S->incomplete && more) {
+        pcache_put (S);
+        return 1;
+    }
+
+    stats_inc (STAT_COMMANDS);
+
+    if (S->invalid_syntax) {
+        printf ("pssh: invalid syntax\n");
+        last_status = 2;
+        goto next;
+    }
+
+#if DEBUG_PARSE
+    for (i=0; i<S->npipelines; i++)
+        parse_debug (S->pipelines[i]);
+#endif
+
+    t0 = trace_now ();
+    interrupted = 0;
+    running = S;
+    execute_node (S->root);
+    running = saved;
+    trace_span ("shell", "execute", t0, trace_now (), 0, cmdline);
+
+next:
+    pcache_put (S);
+    arena_reset (A);
+    return 0;
+}
+
+
+/* ServeRunFn: runs a --serve client's command line as a job that
+ * client owns, instead of waiting for it */
+static int serve_cmdline (char* cmdline, void* owner, JobDoneFn done)
+{
+    Script* saved = running;
+    Script* S;
+    Parse* P;
+    int k, pending = 0;
+
+    if (!(S = pcache_get (cmdline)))
+        return 0;
+
+    stats_inc (STAT_COMMANDS);
+
+    if (S->invalid_syntax) {
+        printf ("pssh: invalid syntax\n");
+        last_status = 2;
+    } else {
+        // the client waits on one job, so a list runs in a subshell;
+        // so does anything that would run in the shell itself, which
+        // here is the server (`exit`, `hash -r`, `x=1`, ...)
+        running = S;
+        P = S->root->type == NODE_PIPELINE ? S->root->pipeline : NULL;
+        if (!P || runs_here (P) || (P->ntasks == 1 && builtin_task (&P->tasks[0])))
+            P = parse_group (A, S->root, cmdline);
+
+        k = find_availability (P->text, P->ntasks);
+        J[k].timed = P->timed;
+        J[k].owner = owner;
+        J[k].done = done;
+        execute_tasks (P, P->text, k);
+        pending = job_valid (k) && J[k].owner == owner;
+        running = saved;
+    }
+
+    pcache_put (S);
+    arena_reset (A);
+
+    return pending;
+}
+
+
+/* Runs commands from a script file, the -c string, or a non-tty
+ * stdin.  No banner, no readline, and no terminal job control. */
+static void run_batch (Reader* R)
+{
+    char* line;
+    char* s;
+
+    while ((line = reader_getline (R))) {
+        if (pending) {
+            // a command that goes on over several lines
+            pending = realloc (pending, strlen (pending) + strlen (line) + 2);
+            line = strcat (strcat (pending, "\n"), line);
+        }
+        else {
+            for (s=line; *s == ' ' || *s == '\t'; s++);
+            if (*s == '#')      /* comments and #! lines */
+                continue;
+        }
+
+        if (run_cmdline (line, 1)) {
+            if (!pending)
+                pending = strdup (line);
+            continue;
+        }
+
+        free (pending);
+        pending = NULL;
+        trace_idle ();
+    }
+
+    // the input ran out in the middle of one: it's a syntax error
+    if (pending)
+        run_cmdline (pending, 0);
+
+    reader_destroy (&R);
+
+    // don't walk away from jobs that never got to start
+    while (admit_queued ())
+        loop_once (-1);
+
+    fflush(stdout);
+    exit (last_status);
+}
+
+
+static void line_handler (char* cmdline)
+{
+    char* prompt;
+
+    at_prompt = 0;
+    rl_callback_handler_remove();
+
+    trace_span ("input", "readline", prompt_ts, trace_now (), 0, NULL);
+
+    if (!cmdline)       /* EOF (ex: ctrl-d) */
+        exit (EXIT_SUCCESS);
+
+    if (pending) {
+        pending = realloc (pending, strlen (pending) + strlen (cmdline) + 2);
+        strcat (strcat (pending, "\n"), cmdline);
+        free (cmdline);
+        cmdline = pending;
+        pending = NULL;
+    }
+
+    // the terminal belongs to the job until it's done
+    loop_suspend(STDIN_FILENO);
+    if (run_cmdline (cmdline, 1))
+        pending = cmdline;      // the command goes on: ask for more
+    else
+        free(cmdline);
+    loop_resume(STDIN_FILENO);
+
+    fflush(stdout);
+    trace_flush();      // nothing is being timed while the user types
+    prompt = pending ? strdup("> ") : build_prompt();
+    rl_callback_handler_install(prompt, line_handler);
+    free(prompt);
+    at_prompt = 1;
+    prompt_ts = trace_now();
+}
+
+
+static void on_input (int fd, unsigned int events, void* data)
+{
+    rl_callback_read_char();
+}
+
+
+int main (int argc, char** argv)
+{
+    char* prompt;
+    char* noargs[] = { argv[0], NULL };
+    int fd;
+
+    shell_pid = getpid();
+    vars_init(environ);
+
+    // initialize jobs array
+    new_jobs();
+    launch_init();
+    loop_init();
+    trace_init();
+    stats_init();
+    admit_init(start_queued);
+    watchdog_init();
+    A = arena_new(ARENA_CHUNK);
+
+    if (argc > 1 || !isatty(STDIN_FILENO))
+        interactive = 0;
+
+    signals_init();
+
+    if (argc > 1 && !strcmp(argv[1], "-c")) {
+        if (argc < 3) {
+            fprintf(stderr, "pssh: -c: option requires an argument\n");
+            exit(2);
+        }
+        // pssh -c 'cmd' $0 $1 ...
+        var_args_push (argc > 3 ? argv + 3 : noargs);
+        run_batch (reader_from_string (argv[2]));
+    }
+    else if (argc > 1 && !strcmp(argv[1], "--serve")) {
+        if (argc < 3) {
+            fprintf(stderr, "pssh: --serve: option requires a socket path\n");
+            exit(2);
+        }
+        var_args_push (noargs);
+        serve (argv[2], serve_cmdline);
+    }
+    else if (argc > 1) {
+        if ((fd = open(argv[1], O_RDONLY | O_CLOEXEC)) == -1) {
+            fprintf(stderr, "pssh: %s: %s\n", argv[1], strerror(errno));
+            exit(127);
+        }
+        var_args_push (argv + 1);
+        run_batch (reader_new (fd));
+    }
+
+    var_args_push (noargs);
+
+    if (!interactive) {
+        run_batch (reader_new (STDIN_FILENO));
+    }
+
+    our_tty = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+
+    print_banner ();
+    fflush(stdout);
+
+    rl_catch_signals = 0;
+    rl_catch_sigwinch = 0;
+
+    prompt = build_prompt();
+    rl_callback_handler_install(prompt, line_handler);
+    free(prompt);
+    at_prompt = 1;
+    prompt_ts = trace_now();
+
+    loop_add(STDIN_FILENO, EPOLLIN, on_input, NULL);
+
+    while (1)
+        loop_once(-1);
+}
@@ -0,0 +1,301 @@
+/* Server mode
+ *
+ * Everything runs on the shell's event loop: the listening socket and
+ * every connection are sources next to the signalfd, and a request is
+ * handled start to finish inside one callback.  For the length of
+ * that callback the client's fds are dup2()ed over our stdin, stdout
+ * and stderr, its cwd made ours and its environment the one commands
+ * get (see var_environ_override()), with its PATH used to find them;
+ * then the command line goes to the shell as usual, except that
+ * what would run in the shell itself runs in a subshell (see
+ * serve_cmdline()).  Children inherit all of it.  Our own stdio,
+ * cwd and environment are put back before the next event is looked at.
+ *
+ * A connection whose job is still running is suspended in the loop
+ * (only a hangup gets through) until the SIGCHLD path hands the job
+ * back through serve_done().
+ **********************************************************************/
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "serve.h"
+#include "loop.h"
+#include "trace.h"
+#include "vars.h"
+
+extern int last_status;
+
+typedef struct {
+    int fd;
+    int busy;                 /* its job is still running */
+    int closed;               /* hung up while busy */
+} Conn;
+
+static ServeRunFn run = NULL;
+static int listen_fd = -1;
+static int null_fd = -1;
+static int cwd_fd = -1;
+static int saved_fd[3];       /* our own stdin, stdout, stderr */
+
+static char request[SERVE_MAX_REQUEST + 1];
+static char** envp = NULL;
+static unsigned int envp_size = 0;
+
+
+static void reply (Conn* c, int status)
+{
+    send (c->fd, &status, sizeof(status), MSG_NOSIGNAL);
+}
+
+
+static void conn_close (Conn* c)
+{
+    loop_del (c->fd);
+    close (c->fd);
+
+    if (c->busy)
+        c->closed = 1;        /* freed once its job is reaped */
+    else
+        free (c);
+}
+
+
+/* JobDoneFn for a client's job */
+static void serve_done (void* owner, int k, int status)
+{
+    Conn* c = owner;
+
+    c->busy = 0;
+
+    if (c->closed) {
+        free (c);
+        return;
+    }
+
+    reply (c, WIFEXITED (status) ? WEXITSTATUS (status) : 128 + WTERMSIG (status));
+    loop_resume (c->fd);
+}
+
+
+/* splits the n byte request into cwd, command line and a NULL
+ * terminated envp pointing into it */
+static int unpack (unsigned int n, char** cwd, char** cmdline)
+{
+    char* end = request + n;
+    char* s;
+    unsigned int i = 0;
+
+    request[n] = '\0';
+
+    *cwd = request;
+    *cmdline = *cwd + strlen (*cwd) + 1;
+    if (*cmdline >= end)
+        return -1;
+
+    for (s = *cmdline + strlen (*cmdline) + 1; ; s += strlen (s) + 1) {
+        if (i == envp_size) {
+            envp_size = envp_size ? 2*envp_size : 64;
+            envp = realloc (envp, envp_size * sizeof(*envp));
+        }
+        if (s >= end)
+            break;
+        if (*s)
+            envp[i++] = s;
+    }
+
+    envp[i] = NULL;
+    return 0;
+}
+
+
+/* runs cmdline with the environment of a request */
+static int run_with_env (char* cmdline, Conn* c)
+{
+    const char* path = var_get ("PATH");
+    char* our_path = path ? strdup (path) : NULL;
+    char** e;
+    int pending;
+
+    /* a PATH has a hash table of its own (see hash.h), so this and
+     * putting ours back don't flush anything */
+    for (e=envp; *e && strncmp (*e, "PATH=", 5); e++);
+    if (*e)
+        var_set ("PATH", *e + 5);
+
+    var_environ_override (envp);
+    pending = run (cmdline, c, serve_done);
+    var_environ_override (NULL);
+
+    if (our_path)
+        var_set ("PATH", our_path);
+    else
+        var_unset ("PATH");
+    free (our_path);
+
+    return pending;
+}
+
+
+/* runs one request with the client's fds, cwd and environment */
+static void execute (Conn* c, char* cwd, char* cmdline, int* fds, int nfds)
+{
+    int i, pending = 0;
+
+    for (i=0; i<3; i++)
+        dup2 (i < nfds ? fds[i] : null_fd, i);
+
+    last_status = 0;
+
+    if (chdir (cwd) == -1) {
+        fprintf (stderr, "pssh: %s: %s\n", cwd, strerror (errno));
+        last_status = 1;
+    } else {
+        pending = run_with_env (cmdline, c);
+    }
+
+    fflush (stdout);
+    fflush (stderr);
+
+    fchdir (cwd_fd);
+    for (i=0; i<3; i++)
+        dup2 (saved_fd[i], i);
+
+    if (pending) {
+        c->busy = 1;
+        loop_suspend (c->fd);
+    } else {
+        reply (c, last_status);
+    }
+}
+
+
+static void on_client (int fd, unsigned int events, void* data)
+{
+    union {
+        char buf[CMSG_SPACE (SERVE_MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { request, SERVE_MAX_REQUEST };
+    struct msghdr msg;
+    struct cmsghdr* cm;
+    Conn* c = data;
+    int fds[SERVE_MAX_FDS];
+    int i, nfds = 0;
+    char *cwd, *cmdline;
+    ssize_t n;
+
+    if (c->busy) {
+        if (events & (EPOLLHUP | EPOLLERR))
+            conn_close (c);
+        return;
+    }
+
+    memset (&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    n = recvmsg (fd, &msg, MSG_CMSG_CLOEXEC);
+    if (n == -1 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (n <= 0) {
+        conn_close (c);
+        return;
+    }
+
+    for (cm = CMSG_FIRSTHDR (&msg); cm; cm = CMSG_NXTHDR (&msg, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+            continue;
+        nfds = (cm->cmsg_len - CMSG_LEN (0)) / sizeof(int);
+        if (nfds > SERVE_MAX_FDS)
+            nfds = SERVE_MAX_FDS;
+        memcpy (fds, CMSG_DATA (cm), nfds * sizeof(int));
+    }
+
+    if ((msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) ||
+        unpack (n, &cwd, &cmdline) == -1) {
+        if (nfds > 2)
+            dprintf (fds[2], "pssh: bad request\n");
+        reply (c, 2);
+    } else {
+        execute (c, cwd, cmdline, fds, nfds);
+    }
+
+    for (i=0; i<nfds; i++)
+        close (fds[i]);
+}
+
+
+static void on_accept (int fd, unsigned int events, void* data)
+{
+    Conn* c;
+    int cfd;
+
+    while ((cfd = accept4 (fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        c = calloc (1, sizeof(*c));
+        c->fd = cfd;
+        loop_add (cfd, EPOLLIN, on_client, c);
+    }
+}
+
+
+/* Listens on path and serves requests until killed.  run starts a
+ * command line as a job owned by a connection. */
+void serve (const char* path, ServeRunFn run_fn)
+{
+    struct sockaddr_un addr;
+    sigset_t mask;
+    int i;
+
+    run = run_fn;
+
+    memset (&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen (path) >= sizeof(addr.sun_path)) {
+        fprintf (stderr, "pssh: %s: socket path too long\n", path);
+        exit (2);
+    }
+    strcpy (addr.sun_path, path);
+
+    listen_fd = socket (AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink (path);
+    if (listen_fd == -1 ||
+        bind (listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+        listen (listen_fd, SERVE_BACKLOG) == -1) {
+        fprintf (stderr, "pssh: %s: %s\n", path, strerror (errno));
+        exit (EXIT_FAILURE);
+    }
+
+    null_fd = open ("/dev/null", O_RDWR | O_CLOEXEC);
+    for (i=0; i<3; i++) {
+        if (fcntl (i, F_GETFD) == -1)
+            dup2 (null_fd, i);
+        saved_fd[i] = fcntl (i, F_DUPFD_CLOEXEC, 3);
+    }
+    cwd_fd = open (".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    // a client that goes away mid-write is an EPIPE, not our death;
+    // children start with an empty mask, so they still get SIGPIPE
+    sigemptyset (&mask);
+    sigaddset (&mask, SIGPIPE);
+    sigprocmask (SIG_BLOCK, &mask, NULL);
+
+    loop_add (listen_fd, EPOLLIN, on_accept, NULL);
+
+    while (1) {
+        loop_once (-1);
+        trace_idle ();
+    }
+}
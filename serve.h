@@ -0,0 +1,40 @@
+#ifndef _serve_h_
+#define _serve_h_
+
+#include "jobs.h"
+
+/* Server mode (`pssh --serve <socket>`)
+ *
+ * A long lived pssh that runs command lines for clients connected to a
+ * UNIX socket, through the same parse cache and execute_tasks() as the
+ * prompt, so starting a command costs the fork/spawn and nothing else.
+ * The socket is SOCK_SEQPACKET: every request and every reply is one
+ * message.
+ *
+ * A request carries the client's working directory, the command line
+ * and its environment as NUL terminated strings, in that order:
+ *
+ *   cwd \0 cmdline \0 NAME=value \0 NAME=value \0 ...
+ *
+ * with up to three fds attached (SCM_RIGHTS) that become the job's
+ * stdin, stdout and stderr (missing ones are /dev/null).  Output is
+ * never copied through the server: the job writes straight into the
+ * client's own fds.  Once the job is done, the reply is the exit
+ * status as one int.  A connection has one request in flight at a
+ * time; any number of clients can be connected at once.
+ *
+ * Pipelines run without a terminal, in the background from the shell's
+ * point of view, and are ordinary jobs otherwise (deadlines, limits,
+ * the job table). */
+
+#define SERVE_MAX_REQUEST 65536
+#define SERVE_MAX_FDS     3
+#define SERVE_BACKLOG     128
+
+/* runs cmdline as a job that reports to done(owner, ...) when it is
+ * reaped; returns 0 if it was over before the call returned */
+typedef int (*ServeRunFn) (char* cmdline, void* owner, JobDoneFn done);
+
+void serve (const char* path, ServeRunFn run);
+
+#endif /* _serve_h_ */
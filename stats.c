@@ -0,0 +1,233 @@
+/* Always-on shell metrics
+ *
+ * The periodic dump is written to a temporary file next to the target
+ * and rename()d over it, so a scraper (ex: node_exporter's textfile
+ * collector) never sees a half written file.
+ **********************************************************************/
+#include <sys/types.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "stats.h"
+#include "loop.h"
+#include "jobs.h"
+#include "hash.h"
+
+typedef struct {
+    unsigned long buckets[STATS_BUCKETS];
+    unsigned long count;
+    unsigned long sum;       /* us */
+} Hist;
+
+static const struct {
+    const char* name;
+    const char* help;
+} counter_info[NSTATS] = {
+    { "commands",      "Command lines run" },
+    { "launches",      "Pipeline stages started" },
+    { "exec_failures", "Pipeline stages that could not be started" },
+    { "sigchld",       "SIGCHLD deliveries" },
+    { "reaped",        "Children reaped" },
+    { "timeouts",      "Jobs that ran past their deadline" },
+};
+
+static const struct {
+    const char* name;
+    const char* help;
+} hist_info[NHISTS] = {
+    { "launch",     "Parent-side time to start one pipeline stage" },
+    { "foreground", "Time a job spends in the foreground" },
+};
+
+static unsigned long counters[NSTATS];
+static Hist hists[NHISTS];
+
+static char* dump_file = NULL;
+static pid_t dump_pid = 0;      /* the shell that set the dump up */
+
+
+void stats_inc (Counter c)
+{
+    counters[c]++;
+}
+
+
+void stats_observe (Histogram h, long us)
+{
+    unsigned int b = 0;
+
+    if (us < 0)
+        us = 0;
+
+    /* smallest b with us < 2^b */
+    while (b < STATS_BUCKETS-1 && (unsigned long)us >> b)
+        b++;
+
+    hists[h].buckets[b]++;
+    hists[h].count++;
+    hists[h].sum += us;
+}
+
+
+void stats_reset ()
+{
+    memset (counters, 0, sizeof(counters));
+    memset (hists, 0, sizeof(hists));
+}
+
+
+/* the value below which a fraction q of the observations fall, to
+ * within a bucket */
+static unsigned long hist_quantile (Hist* H, double q)
+{
+    unsigned long seen = 0;
+    unsigned int b;
+
+    for (b=0; b<STATS_BUCKETS; b++) {
+        seen += H->buckets[b];
+        if (seen && seen >= q * H->count)
+            return 1UL << b;
+    }
+
+    return 1UL << (STATS_BUCKETS-1);
+}
+
+
+void stats_print (FILE* fp)
+{
+    unsigned long hits, misses;
+    unsigned int i;
+    Hist* H;
+
+    for (i=0; i<NSTATS; i++)
+        fprintf (fp, "%-16s %lu\n", counter_info[i].name, counters[i]);
+
+    hash_counts (&hits, &misses);
+    fprintf (fp, "%-16s %lu\n", "hash_hits", hits);
+    fprintf (fp, "%-16s %lu\n", "hash_misses", misses);
+    fprintf (fp, "%-16s %u/%u\n", "jobs", job_count (), njobs);
+
+    for (i=0; i<NHISTS; i++) {
+        H = &hists[i];
+        fprintf (fp, "%-16s n=%lu", hist_info[i].name, H->count);
+        if (H->count)
+            fprintf (fp, "  mean=%.1fus  p50<%luus  p90<%luus  p99<%luus",
+                     (double)H->sum / H->count, hist_quantile (H, 0.50),
+                     hist_quantile (H, 0.90), hist_quantile (H, 0.99));
+        fprintf (fp, "\n");
+    }
+}
+
+
+void stats_prometheus (FILE* fp)
+{
+    unsigned long hits, misses, cum;
+    unsigned int i, b;
+    Hist* H;
+
+    for (i=0; i<NSTATS; i++) {
+        fprintf (fp, "# HELP pssh_%s_total %s.\n", counter_info[i].name,
+                 counter_info[i].help);
+        fprintf (fp, "# TYPE pssh_%s_total counter\n", counter_info[i].name);
+        fprintf (fp, "pssh_%s_total %lu\n", counter_info[i].name, counters[i]);
+    }
+
+    hash_counts (&hits, &misses);
+    fprintf (fp, "# HELP pssh_hash_lookups_total Command hash table lookups.\n");
+    fprintf (fp, "# TYPE pssh_hash_lookups_total counter\n");
+    fprintf (fp, "pssh_hash_lookups_total{result=\"hit\"} %lu\n", hits);
+    fprintf (fp, "pssh_hash_lookups_total{result=\"miss\"} %lu\n", misses);
+
+    fprintf (fp, "# HELP pssh_jobs Live jobs.\n");
+    fprintf (fp, "# TYPE pssh_jobs gauge\n");
+    fprintf (fp, "pssh_jobs %u\n", job_count ());
+    fprintf (fp, "# HELP pssh_job_slots Allocated job table slots.\n");
+    fprintf (fp, "# TYPE pssh_job_slots gauge\n");
+    fprintf (fp, "pssh_job_slots %u\n", njobs);
+
+    for (i=0; i<NHISTS; i++) {
+        H = &hists[i];
+        fprintf (fp, "# HELP pssh_%s_seconds %s.\n", hist_info[i].name,
+                 hist_info[i].help);
+        fprintf (fp, "# TYPE pssh_%s_seconds histogram\n", hist_info[i].name);
+
+        for (b=0, cum=0; b<STATS_BUCKETS-1; b++) {
+            cum += H->buckets[b];
+            fprintf (fp, "pssh_%s_seconds_bucket{le=\"%g\"} %lu\n",
+                     hist_info[i].name, (1UL << b) / 1e6, cum);
+        }
+        fprintf (fp, "pssh_%s_seconds_bucket{le=\"+Inf\"} %lu\n",
+                 hist_info[i].name, H->count);
+        fprintf (fp, "pssh_%s_seconds_sum %g\n", hist_info[i].name, H->sum / 1e6);
+        fprintf (fp, "pssh_%s_seconds_count %lu\n", hist_info[i].name, H->count);
+    }
+}
+
+
+static void dump ()
+{
+    char tmp[PATH_MAX];
+    FILE* fp;
+
+    /* a forked child that exit()s inherited the hook but not the job */
+    if (getpid () != dump_pid)
+        return;
+
+    snprintf (tmp, sizeof(tmp), "%s.tmp", dump_file);
+
+    if (!(fp = fopen (tmp, "we")))
+        return;
+
+    stats_prometheus (fp);
+
+    if (fclose (fp) == 0)
+        rename (tmp, dump_file);
+    else
+        unlink (tmp);
+}
+
+
+static void on_timer (int fd, unsigned int events, void* data)
+{
+    unsigned long expirations;
+
+    if (read (fd, &expirations, sizeof(expirations)) > 0)
+        dump ();
+}
+
+
+/* sets up the periodic dump if PSSH_STATS_FILE asks for one */
+void stats_init ()
+{
+    struct itimerspec its;
+    char* file = getenv ("PSSH_STATS_FILE");
+    char* interval = getenv ("PSSH_STATS_INTERVAL");
+    int fd, secs = STATS_INTERVAL;
+
+    if (!file || !*file)
+        return;
+
+    if (interval && atoi (interval) > 0)
+        secs = atoi (interval);
+
+    fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) {
+        perror("timerfd_create() failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memset (&its, 0, sizeof(its));
+    its.it_value.tv_sec = secs;
+    its.it_interval.tv_sec = secs;
+    timerfd_settime (fd, 0, &its, NULL);
+
+    dump_file = strdup (file);
+    dump_pid = getpid ();
+    loop_add (fd, EPOLLIN, on_timer, NULL);
+    atexit (dump);
+}
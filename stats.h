@@ -0,0 +1,47 @@
+#ifndef _stats_h_
+#define _stats_h_
+
+#include <stdio.h>
+
+/* Always-on shell metrics
+ *
+ * Counters are plain unsigned longs bumped with stats_inc(), and
+ * latencies go into histograms with one bucket per power of two
+ * microseconds, so recording either costs a few instructions and no
+ * allocation.  Gauges that other modules already keep (the job table,
+ * the command hash table) are read when a report is made instead of
+ * being mirrored here.
+ *
+ * `stats` prints a summary, `stats -p` the Prometheus text format, and
+ * `stats -r` zeroes everything.  With PSSH_STATS_FILE set, the
+ * Prometheus text is also rewritten into that file every
+ * PSSH_STATS_INTERVAL seconds (default STATS_INTERVAL) from a timerfd
+ * in the event loop. */
+
+#define STATS_BUCKETS  32    /* bucket i: < 2^i us; the last: the rest */
+#define STATS_INTERVAL 10
+
+typedef enum {
+    STAT_COMMANDS,           /* command lines run */
+    STAT_LAUNCHES,           /* stages started (fork or spawn) */
+    STAT_EXEC_FAILURES,      /* stages that could not be started */
+    STAT_SIGCHLD,            /* SIGCHLD deliveries */
+    STAT_REAPED,             /* children reaped */
+    STAT_TIMEOUTS,           /* jobs that ran past their deadline */
+    NSTATS
+} Counter;
+
+typedef enum {
+    HIST_LAUNCH,             /* parent-side cost of starting a stage */
+    HIST_FOREGROUND,         /* time a job spends in the foreground */
+    NHISTS
+} Histogram;
+
+void stats_init ();
+void stats_inc (Counter c);
+void stats_observe (Histogram h, long us);
+void stats_reset ();
+void stats_print (FILE* fp);
+void stats_prometheus (FILE* fp);
+
+#endif /* _stats_h_ */
@@ -0,0 +1,273 @@
+/* Execution trace (Chrome trace-event JSON)
+ *
+ * The output is the "JSON array" flavour of the format: a '[' followed
+ * by one event object per line, closed by trace_stop().  The closing
+ * ']' is optional for the viewers, so a trace cut short by a crash
+ * still loads.
+ *
+ * Span events ("ph": "X") carry their own start and duration, so
+ * nothing has to be matched up later; instants ("ph": "i") mark job
+ * state changes.  Shell work goes on the shell's own track (tid = our
+ * pid) and each stage's lifetime on a track named after its pid.
+ **********************************************************************/
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+
+#include "trace.h"
+
+static int fd = -1;
+static pid_t shell_pid;
+static char* buf = NULL;
+static size_t len = 0;
+static size_t size = 0;
+static unsigned long nevents = 0;
+
+
+static void reserve (size_t n)
+{
+    if (len + n <= size)
+        return;
+
+    while (len + n > size)
+        size = size ? 2*size : 2*TRACE_FLUSH_AT;
+
+    buf = realloc (buf, size);
+}
+
+
+static void append (const char* s, size_t n)
+{
+    reserve (n);
+    memcpy (buf + len, s, n);
+    len += n;
+}
+
+
+static void append_str (const char* s)
+{
+    append (s, strlen (s));
+}
+
+
+/* appends s as the body of a JSON string */
+static void append_escaped (const char* s)
+{
+    char esc[8];
+
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            esc[0] = '\\';
+            esc[1] = *s;
+            append (esc, 2);
+        }
+        else if ((unsigned char)*s < 0x20) {
+            snprintf (esc, sizeof(esc), "\\u%04x", *s);
+            append (esc, 6);
+        }
+        else {
+            append (s, 1);
+        }
+    }
+}
+
+
+/* separates each event from the one before it */
+static void begin ()
+{
+    if (nevents++)
+        append_str (",\n");
+}
+
+
+static void event (const char* ph, const char* cat, const char* name,
+                   long ts, long dur, pid_t tid, const char* detail)
+{
+    char head[160];
+    int n;
+
+    begin ();
+    append_str ("{\"name\": \"");
+    append_escaped (name);
+
+    n = snprintf (head, sizeof(head),
+                  "\", \"cat\": \"%s\", \"ph\": \"%s\", \"ts\": %ld, ",
+                  cat, ph, ts);
+    append (head, n);
+
+    if (dur >= 0)
+        n = snprintf (head, sizeof(head), "\"dur\": %ld, ", dur);
+    else
+        n = snprintf (head, sizeof(head), "\"s\": \"t\", ");
+    append (head, n);
+
+    n = snprintf (head, sizeof(head), "\"pid\": %d, \"tid\": %d",
+                  shell_pid, tid ? tid : shell_pid);
+    append (head, n);
+
+    if (detail) {
+        append_str (", \"args\": {\"detail\": \"");
+        append_escaped (detail);
+        append_str ("\"}");
+    }
+
+    append_str ("}");
+}
+
+
+/* names a track in the viewer */
+static void thread_name (pid_t tid, const char* name)
+{
+    char s[160];
+    int n;
+
+    begin ();
+    n = snprintf (s, sizeof(s), "{\"name\": \"thread_name\", \"ph\": \"M\", "
+                  "\"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"",
+                  shell_pid, tid);
+    append (s, n);
+    append_escaped (name);
+    append_str ("\"}}");
+}
+
+
+/* a forked child that fails before its execve() and exit()s must not
+ * close the shell's trace out from under it */
+static void trace_exit ()
+{
+    if (getpid () == shell_pid)
+        trace_stop ();
+}
+
+
+void trace_init ()
+{
+    char* file = getenv ("PSSH_TRACE");
+
+    atexit (trace_exit);
+
+    if (file && *file)
+        trace_start (file);
+}
+
+
+int trace_start (const char* file)
+{
+    int new_fd;
+
+    new_fd = open (file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (new_fd == -1) {
+        printf ("pssh: trace: %s: %s\n", file, strerror (errno));
+        return -1;
+    }
+
+    trace_stop ();
+
+    fd = new_fd;
+    shell_pid = getpid ();
+    nevents = 0;
+
+    append_str ("[\n");
+    thread_name (shell_pid, "pssh");
+
+    return 0;
+}
+
+
+void trace_stop ()
+{
+    if (fd == -1)
+        return;
+
+    append_str ("\n]\n");
+    trace_flush ();
+
+    close (fd);
+    fd = -1;
+}
+
+
+int trace_enabled ()
+{
+    return fd != -1;
+}
+
+
+long trace_now ()
+{
+    struct timespec ts;
+
+    if (fd == -1)
+        return 0;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return trace_ts (&ts);
+}
+
+
+/* converts a CLOCK_MONOTONIC timestamp to trace time */
+long trace_ts (const struct timespec* ts)
+{
+    return ts->tv_sec * 1000000L + ts->tv_nsec / 1000;
+}
+
+
+/* records [start, end) on tid's track (0: the shell's) */
+void trace_span (const char* cat, const char* name, long start, long end,
+                 pid_t tid, const char* detail)
+{
+    if (fd == -1)
+        return;
+
+    if (tid)
+        thread_name (tid, name);
+
+    event ("X", cat, name, start, end - start, tid, detail);
+}
+
+
+void trace_instant (const char* cat, const char* name, pid_t tid,
+                    const char* detail)
+{
+    if (fd == -1)
+        return;
+
+    event ("i", cat, name, trace_now (), -1, tid, detail);
+}
+
+
+/* writes the buffer out if enough has piled up */
+void trace_idle ()
+{
+    if (len >= TRACE_FLUSH_AT)
+        trace_flush ();
+}
+
+
+void trace_flush ()
+{
+    size_t off = 0;
+    ssize_t n;
+
+    if (fd == -1)
+        return;
+
+    while (off < len) {
+        n = write (fd, buf + off, len - off);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror ("pssh: trace: write() failed\n");
+            break;
+        }
+        off += n;
+    }
+
+    len = 0;
+}
@@ -0,0 +1,37 @@
+#ifndef _trace_h_
+#define _trace_h_
+
+#include <sys/types.h>
+#include <time.h>
+
+/* Execution trace
+ *
+ * When enabled (PSSH_TRACE=<file> in the environment, or `trace on
+ * <file>`), the shell records what it spends its time on as Chrome
+ * trace-event JSON, which chrome://tracing and ui.perfetto.dev load
+ * directly.  Timestamps are CLOCK_MONOTONIC microseconds, the same
+ * clock the job table stamps stages with, so a stage's lifetime can be
+ * emitted straight from its TaskUsage.
+ *
+ * Events are appended to an in-memory buffer and only written out by
+ * trace_idle()/trace_flush() when the shell has nothing better to do,
+ * so the write() never lands inside a span being measured.
+ *
+ * Every call is a no-op while tracing is off; trace_now() returns 0. */
+
+#define TRACE_FLUSH_AT (64*1024)
+
+void trace_init ();
+int trace_start (const char* file);
+void trace_stop ();
+int trace_enabled ();
+long trace_now ();
+long trace_ts (const struct timespec* ts);
+void trace_span (const char* cat, const char* name, long start, long end,
+                 pid_t tid, const char* detail);
+void trace_instant (const char* cat, const char* name, pid_t tid,
+                    const char* detail);
+void trace_idle ();
+void trace_flush ();
+
+#endif /* _trace_h_ */
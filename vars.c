@@ -0,0 +1,467 @@
+/* Shell variables and positional parameters
+ *
+ * A variable is kept as the "NAME=value" string an environment holds,
+ * so exporting it is just a matter of pointing an envp slot at it.
+ **********************************************************************/
+#include <sys/types.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "vars.h"
+#include "arena.h"
+
+extern char** environ;
+extern int last_status;
+extern pid_t shell_pid;
+
+typedef struct Var {
+    char* entry;              /* "NAME=value" */
+    unsigned int len;         /* of NAME */
+    int slot;                 /* its index in envp (-1: not exported) */
+    size_t size;              /* bytes allocated for entry */
+    struct Var* next;
+} Var;
+
+typedef struct {
+    char* name;
+    char* value;              /* what it was (NULL: unset) */
+    int exported;             /* and whether it was */
+} Saved;
+
+typedef struct {
+    char** params;            /* $1 .. $n, NULL terminated */
+    unsigned int n;
+} Frame;
+
+static Var* buckets[VARS_BUCKETS];
+
+static char** envp = NULL;    /* the exported ones, NULL terminated */
+static Var** env_vars = NULL; /* and whose entry each one is */
+static unsigned int nenv = 0;
+static unsigned int env_size = 0;
+static char** env_override = NULL;
+
+static Saved* saved = NULL;   /* see var_push () */
+static unsigned int nsaved = 0;
+static unsigned int saved_size = 0;
+
+static char* no_params[] = { NULL };
+static Frame* frames = NULL;
+static unsigned int nframes = 0;
+static unsigned int frames_size = 0;
+static const char* arg0 = "pssh";
+
+
+static unsigned long hash_n (const char* s, size_t n)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    while (n--) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211UL;
+    }
+
+    return h;
+}
+
+
+static Var** find (const char* name, size_t len)
+{
+    Var** link = &buckets[hash_n (name, len) % VARS_BUCKETS];
+
+    for (; *link; link=&(*link)->next)
+        if ((*link)->len == len && !memcmp ((*link)->entry, name, len))
+            break;
+
+    return link;
+}
+
+
+static Var* set (const char* name, size_t len, const char* value)
+{
+    Var** link = find (name, len);
+    Var* v = *link;
+    size_t n = len + 1 + strlen (value) + 1;
+    const char* old = NULL;
+
+    if (!v) {
+        v = *link = calloc (1, sizeof(*v));
+        v->len = len;
+        v->slot = -1;
+    }
+
+    if (n > v->size) {
+        /* value may be our own (x=$x), so keep it until it's copied */
+        old = v->entry;
+        v->size = n < 32 ? 32 : 2*n;
+        v->entry = malloc (v->size);
+        memcpy (v->entry, name, len);
+        v->entry[len] = '=';
+        if (v->slot != -1)
+            envp[v->slot] = v->entry;
+    }
+
+    memmove (v->entry + len + 1, value, n - len - 1);
+    free ((char*) old);
+
+    return v;
+}
+
+
+static void env_grow ()
+{
+    if (nenv + 1 < env_size)
+        return;
+
+    env_size = env_size ? 2*env_size : 64;
+    envp = realloc (envp, env_size * sizeof(*envp));
+    env_vars = realloc (env_vars, env_size * sizeof(*env_vars));
+    envp[nenv] = NULL;
+
+    /* so that getenv () (readline's, the PSSH_ knobs') sees it too */
+    environ = envp;
+}
+
+
+static void env_add (Var* v)
+{
+    env_grow ();
+    v->slot = nenv;
+    envp[nenv] = v->entry;
+    env_vars[nenv++] = v;
+    envp[nenv] = NULL;
+}
+
+
+/* the last slot takes v's place, so envp never has holes */
+static void env_remove (Var* v)
+{
+    Var* last = env_vars[--nenv];
+
+    envp[v->slot] = last->entry;
+    env_vars[v->slot] = last;
+    last->slot = v->slot;
+    envp[nenv] = NULL;
+    v->slot = -1;
+}
+
+
+/* Imports env (the one the shell was started with): every entry with
+ * a valid name becomes an exported variable. */
+void vars_init (char** env)
+{
+    unsigned int i, n;
+
+    env_grow ();
+
+    for (i=0; env && env[i]; i++) {
+        n = var_name_len (env[i]);
+        if (n && env[i][n] == '=' && !*find (env[i], n))
+            env_add (set (env[i], n, env[i] + n + 1));
+    }
+}
+
+
+/* the length of the variable name s starts with (0: none) */
+unsigned int var_name_len (const char* s)
+{
+    unsigned int n = 0;
+
+    if (!isalpha ((unsigned char)*s) && *s != '_')
+        return 0;
+
+    while (isalnum ((unsigned char)s[n]) || s[n] == '_')
+        n++;
+
+    return n;
+}
+
+
+/* NULL if name isn't set (here, or in the environment that
+ * var_environ_override () put in place) */
+const char* var_get (const char* name)
+{
+    size_t len = strlen (name);
+    Var* v = *find (name, len);
+    char** e;
+
+    if (v)
+        return v->entry + v->len + 1;
+
+    for (e=env_override; e && *e; e++)
+        if (!strncmp (*e, name, len) && (*e)[len] == '=')
+            return *e + len + 1;
+
+    return NULL;
+}
+
+
+void var_set (const char* name, const char* value)
+{
+    set (name, strlen (name), value);
+}
+
+
+/* NAME=value; -1 if word isn't one */
+int var_assign (const char* word)
+{
+    unsigned int n = var_name_len (word);
+
+    if (!n || word[n] != '=')
+        return -1;
+
+    set (word, n, word + n + 1);
+    return 0;
+}
+
+
+void var_unset (const char* name)
+{
+    Var** link = find (name, strlen (name));
+    Var* v = *link;
+
+    if (!v)
+        return;
+
+    if (v->slot != -1)
+        env_remove (v);
+
+    *link = v->next;
+    free (v->entry);
+    free (v);
+}
+
+
+/* Puts name in the environment of the commands we run; an unset one
+ * is set to "".  -1 if name isn't a valid one. */
+int var_export (const char* name)
+{
+    size_t len = strlen (name);
+    Var* v;
+
+    if (var_name_len (name) != len)
+        return -1;
+
+    if (!(v = *find (name, len)))
+        v = set (name, len, "");
+    if (v->slot == -1)
+        env_add (v);
+
+    return 0;
+}
+
+
+/* The environment for the commands we run: the exported variables,
+ * kept up to date as they change, so there is nothing to build. */
+char** var_environ ()
+{
+    return env_override ? env_override : envp;
+}
+
+
+/* Makes var_environ () env instead (a --serve request's), until it
+ * is called again with NULL.  Names that aren't set are looked up in
+ * it as well. */
+void var_environ_override (char** env)
+{
+    env_override = env;
+}
+
+
+/* The environment for a command with NAME=value words in front of
+ * it: var_environ () with those replaced or added, in A. */
+char** var_environ_with (Arena* A, char** assign)
+{
+    char** env = var_environ ();
+    char** e;
+    unsigned int i, j, n, m, len;
+
+    for (n=0; env[n]; n++);
+    for (m=0; assign[m]; m++);
+
+    e = arena_alloc (A, (n + m + 1) * sizeof(*e));
+    memcpy (e, env, n * sizeof(*e));
+
+    for (i=0; i<m; i++) {
+        len = var_name_len (assign[i]) + 1;
+        for (j=0; j<n && strncmp (e[j], assign[i], len); j++);
+        e[j] = assign[i];
+        if (j == n)
+            n++;
+    }
+    e[n] = NULL;
+
+    return e;
+}
+
+
+/* NAME=value words in front of a builtin or a function: they are set
+ * and exported (so the commands those run get them too) until
+ * var_pop (assign), which puts back what was there before. */
+void var_push (char** assign)
+{
+    unsigned int n;
+    Saved* s;
+    Var* v;
+
+    for (; *assign; assign++) {
+        if (nsaved == saved_size) {
+            saved_size = saved_size ? 2*saved_size : 16;
+            saved = realloc (saved, saved_size * sizeof(*saved));
+        }
+
+        n = var_name_len (*assign);
+        v = *find (*assign, n);
+        s = &saved[nsaved++];
+        s->name = strndup (*assign, n);
+        s->value = v ? strdup (v->entry + n + 1) : NULL;
+        s->exported = v && v->slot != -1;
+
+        v = set (*assign, n, *assign + n + 1);
+        if (v->slot == -1)
+            env_add (v);
+    }
+}
+
+
+void var_pop (char** assign)
+{
+    Saved* s;
+    Var* v;
+
+    for (; *assign; assign++) {
+        s = &saved[--nsaved];
+        if (s->value) {
+            v = set (s->name, strlen (s->name), s->value);
+            if (!s->exported && v->slot != -1)
+                env_remove (v);
+        } else {
+            var_unset (s->name);
+        }
+        free (s->name);
+        free (s->value);
+    }
+}
+
+
+static Frame* top ()
+{
+    static Frame none = { no_params, 0 };
+
+    return nframes ? &frames[nframes-1] : &none;
+}
+
+
+/* The value of $name, where name can also be one of the special
+ * parameters (? # $ 0 .. 9 * @).  Numbers and $* are formatted into
+ * a buffer that the next call reuses. */
+const char* var_value (const char* name)
+{
+    static char* buf = NULL;
+    static size_t size = 0;
+    Frame* f = top ();
+    size_t n = 0, len;
+    unsigned int i;
+    char num[24];
+
+    if (isdigit ((unsigned char)*name)) {
+        i = atoi (name);
+        if (i == 0)
+            return arg0;
+        return i <= f->n ? f->params[i-1] : NULL;
+    }
+
+    if (name[1] || !strchr ("?#$*@", *name))
+        return var_get (name);
+
+    if (*name == '?')
+        snprintf (num, sizeof(num), "%d", last_status);
+    else if (*name == '#')
+        snprintf (num, sizeof(num), "%u", f->n);
+    else if (*name == '$')
+        snprintf (num, sizeof(num), "%d", shell_pid);
+
+    if (*name == '?' || *name == '#' || *name == '$') {
+        len = strlen (num) + 1;
+    } else {
+        /* $* and $@: the parameters joined by spaces */
+        for (i=0, len=1; i<f->n; i++)
+            len += strlen (f->params[i]) + 1;
+    }
+
+    if (len > size) {
+        size = 2*len;
+        buf = realloc (buf, size);
+    }
+
+    if (*name == '?' || *name == '#' || *name == '$')
+        return memcpy (buf, num, len);
+
+    for (i=0; i<f->n; i++) {
+        if (i)
+            buf[n++] = ' ';
+        strcpy (buf + n, f->params[i]);
+        n += strlen (f->params[i]);
+    }
+    buf[n] = '\0';
+
+    return buf;
+}
+
+
+/* Makes argv[1..] the positional parameters until var_args_pop().
+ * The first push (the shell's own arguments) sets $0 to argv[0];
+ * the strings are not copied. */
+void var_args_push (char** argv)
+{
+    Frame* f;
+
+    if (nframes == frames_size) {
+        frames_size = frames_size ? 2*frames_size : 16;
+        frames = realloc (frames, frames_size * sizeof(*frames));
+    }
+
+    if (!nframes)
+        arg0 = argv[0];
+
+    f = &frames[nframes++];
+    f->params = argv + 1;
+    for (f->n=0; f->params[f->n]; f->n++);
+}
+
+
+void var_args_pop ()
+{
+    if (nframes)
+        nframes--;
+}
+
+
+/* $1 .. $n, NULL terminated */
+char** var_args ()
+{
+    return top ()->params;
+}
+
+
+unsigned int var_nargs ()
+{
+    return top ()->n;
+}
+
+
+/* `shift n`; -1 if there aren't that many */
+int var_shift (unsigned int n)
+{
+    Frame* f = top ();
+
+    if (n > f->n)
+        return -1;
+
+    f->params += n;
+    f->n -= n;
+
+    return 0;
+}
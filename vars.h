@@ -0,0 +1,45 @@
+#ifndef _vars_h_
+#define _vars_h_
+
+#include "arena.h"
+
+/* Shell variables and positional parameters
+ *
+ * Variables live in a chained hash table keyed on their name; a value
+ * is overwritten in place when the new one fits, so a loop counter
+ * costs no allocation per iteration.  The environment the shell was
+ * started with is imported by vars_init (), every entry exported.
+ *
+ * The exported variables are the envp handed to execve(): each has a
+ * slot in it that points at its own "NAME=value", so setting one
+ * updates the environment as a side effect and export / unset only
+ * add or remove a slot.  Nothing is rebuilt per command.
+ *
+ * The positional parameters ($1 .. $n, $#, $@) are a stack of frames:
+ * the script's arguments at the bottom and one per function call. */
+
+#define VARS_BUCKETS 512
+
+void vars_init (char** env);
+const char* var_get (const char* name);
+void var_set (const char* name, const char* value);
+int var_assign (const char* word);
+void var_unset (const char* name);
+unsigned int var_name_len (const char* s);
+
+int var_export (const char* name);
+char** var_environ ();
+void var_environ_override (char** env);
+char** var_environ_with (Arena* A, char** assign);
+void var_push (char** assign);
+void var_pop (char** assign);
+
+const char* var_value (const char* name);
+
+void var_args_push (char** argv);
+void var_args_pop ();
+char** var_args ();
+unsigned int var_nargs ();
+int var_shift (unsigned int n);
+
+#endif /* _vars_h_ */
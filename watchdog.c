@@ -0,0 +1,284 @@
+/* Job deadlines
+ *
+ * The heap is ordered on absolute CLOCK_MONOTONIC milliseconds and the
+ * timerfd is always armed (TFD_TIMER_ABSTIME) for whatever is on top.
+ * Each entry carries the sequence number its job had when it was
+ * armed; Job.watch holds the current one (0: not watched), so stale
+ * entries are recognized in O(1) when they are popped.
+ **********************************************************************/
+#include <sys/types.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+
+#include "watchdog.h"
+#include "jobs.h"
+#include "loop.h"
+#include "cgroup.h"
+#include "stats.h"
+#include "trace.h"
+
+typedef struct {
+    long when;                /* ms, CLOCK_MONOTONIC */
+    int job;
+    unsigned long seq;
+    int sig;                  /* SIGTERM, then SIGKILL */
+} Deadline;
+
+static Deadline* heap = NULL;
+static unsigned int nheap = 0;
+static unsigned int heap_size = 0;
+
+static unsigned long next_seq = 1;
+static long default_ms = 0;   /* `deadline`: 0 for none */
+static long grace_ms = WATCHDOG_GRACE;
+
+static int timer_fd = -1;
+
+
+static long now_ms ()
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+
+static void heap_swap (unsigned int a, unsigned int b)
+{
+    Deadline d = heap[a];
+
+    heap[a] = heap[b];
+    heap[b] = d;
+}
+
+
+static void heap_push (Deadline d)
+{
+    unsigned int i;
+
+    if (nheap == heap_size) {
+        heap_size = heap_size ? 2*heap_size : 64;
+        heap = realloc (heap, heap_size * sizeof(*heap));
+    }
+
+    heap[i = nheap++] = d;
+
+    for (; i && heap[(i-1)/2].when > heap[i].when; i = (i-1)/2)
+        heap_swap (i, (i-1)/2);
+}
+
+
+static Deadline heap_pop ()
+{
+    Deadline top = heap[0];
+    unsigned int i = 0, c;
+
+    heap[0] = heap[--nheap];
+
+    while ((c = 2*i + 1) < nheap) {
+        if (c+1 < nheap && heap[c+1].when < heap[c].when)
+            c++;
+        if (heap[i].when <= heap[c].when)
+            break;
+        heap_swap (i, c);
+        i = c;
+    }
+
+    return top;
+}
+
+
+static int live (const Deadline* d)
+{
+    return job_valid (d->job) && J[d->job].watch == d->seq;
+}
+
+
+/* arms the timerfd for the earliest live deadline (or disarms it) */
+static void rearm ()
+{
+    struct itimerspec its;
+
+    while (nheap && !live (&heap[0]))
+        heap_pop ();
+
+    memset (&its, 0, sizeof(its));
+    if (nheap) {
+        its.it_value.tv_sec = heap[0].when / 1000;
+        its.it_value.tv_nsec = (heap[0].when % 1000) * 1000000;
+        if (!its.it_value.tv_sec && !its.it_value.tv_nsec)
+            its.it_value.tv_nsec = 1;
+    }
+
+    timerfd_settime (timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+
+/* sends sig to job k's process group, or to each of its live stages
+ * if they never got one of their own (no job control) */
+static void signal_job (int k, int sig)
+{
+    unsigned int i;
+
+    if (sig == SIGKILL && cgroup_job_kill (k) == 0)
+        return;
+
+    if (J[k].pgid && kill (-J[k].pgid, sig) == 0)
+        return;
+
+    for (i=0; i<J[k].npids; i++)
+        if (!J[k].usage[i].done)
+            kill (J[k].pids[i], sig);
+}
+
+
+static void expire (Deadline d)
+{
+    Job* job = &J[d.job];
+
+    if (d.sig == SIGTERM) {
+        stats_inc (STAT_TIMEOUTS);
+        trace_instant ("job", "timeout", 0, job->name);
+        job->timedout = 1;
+        if (job->frozen)
+            cgroup_job_freeze (d.job, 0);
+        signal_job (d.job, SIGCONT);    /* a stopped job can't exit */
+        signal_job (d.job, SIGTERM);
+
+        d.when += grace_ms;
+        d.sig = SIGKILL;
+        heap_push (d);
+    } else {
+        trace_instant ("job", "timeout kill", 0, job->name);
+        job->timedout = 2;
+        signal_job (d.job, SIGKILL);
+    }
+}
+
+
+static void on_timer (int fd, unsigned int events, void* data)
+{
+    unsigned long expirations;
+    long now = now_ms ();
+
+    if (read (fd, &expirations, sizeof(expirations)) <= 0)
+        return;
+
+    while (nheap && heap[0].when <= now) {
+        Deadline d = heap_pop ();
+        if (live (&d))
+            expire (d);
+    }
+
+    rearm ();
+}
+
+
+void watchdog_init ()
+{
+    nheap = 0;                /* again in a subshell: the jobs are not ours */
+
+    timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd == -1) {
+        perror("timerfd_create() failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    loop_add (timer_fd, EPOLLIN, on_timer, NULL);
+}
+
+
+/* "30s", "500ms", "2m", "1h" or plain seconds to ms, or -1 */
+long watchdog_parse (const char* s)
+{
+    char* end;
+    double v = strtod (s, &end);
+
+    if (end == s || v < 0)
+        return -1;
+
+    if (!*end || !strcmp (end, "s"))
+        return v * 1000;
+    if (!strcmp (end, "ms"))
+        return v;
+    if (!strcmp (end, "m"))
+        return v * 60 * 1000;
+    if (!strcmp (end, "h"))
+        return v * 60 * 60 * 1000;
+
+    return -1;
+}
+
+
+/* (re)starts job k's clock: SIGTERM in ms milliseconds */
+void watchdog_arm (int k, long ms)
+{
+    Deadline d;
+
+    d.when = now_ms () + ms;
+    d.job = k;
+    d.seq = J[k].watch = next_seq++;
+    d.sig = SIGTERM;
+
+    heap_push (d);
+    rearm ();
+}
+
+
+void watchdog_disarm (int k)
+{
+    J[k].watch = 0;
+    rearm ();
+}
+
+
+void watchdog_set_default (long ms)
+{
+    default_ms = ms;
+}
+
+
+long watchdog_get_default ()
+{
+    return default_ms;
+}
+
+
+void watchdog_set_grace (long ms)
+{
+    grace_ms = ms;
+}
+
+
+void watchdog_print ()
+{
+    unsigned int i, n = 0;
+    long now = now_ms ();
+
+    if (default_ms)
+        printf("deadline: %.3fs\n", default_ms / 1000.0);
+    else
+        printf("deadline: off\n");
+    printf("grace:    %.3fs\n", grace_ms / 1000.0);
+
+    for (i=0; i<nheap; i++) {
+        if (!live (&heap[i]))
+            continue;
+        printf("  [%d] %s in %.3fs\t%s\n", heap[i].job,
+               heap[i].sig == SIGTERM ? "SIGTERM" : "SIGKILL",
+               (heap[i].when - now) / 1000.0, J[heap[i].job].name);
+        n++;
+    }
+
+    if (!n)
+        printf("  (no jobs watched)\n");
+}
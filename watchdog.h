@@ -0,0 +1,30 @@
+#ifndef _watchdog_h_
+#define _watchdog_h_
+
+/* Job deadlines
+ *
+ * A job started with a `timeout` prefix (ex: `timeout 30s cmd | cmd2`),
+ * or while a default is set with `deadline <duration>`, is given a
+ * deadline.  When it passes, the job's process group gets SIGTERM, and
+ * SIGKILL (through cgroup.kill if it has a leaf) if it is still around
+ * a grace period later.  The job is then reported as timed out and
+ * its exit status is 124.
+ *
+ * Every deadline sits in one min-heap behind a single timerfd that is
+ * armed for the earliest of them, so any number of jobs can be watched
+ * at the cost of one fd.  Entries are never searched for: a job that
+ * finishes (or gets a new deadline) just stops matching its old entry,
+ * which is dropped when it comes up. */
+
+#define WATCHDOG_GRACE 5000   /* ms between SIGTERM and SIGKILL */
+
+void watchdog_init ();
+long watchdog_parse (const char* s);
+void watchdog_arm (int k, long ms);
+void watchdog_disarm (int k);
+void watchdog_set_default (long ms);
+long watchdog_get_default ();
+void watchdog_set_grace (long ms);
+void watchdog_print ();
+
+#endif /* _watchdog_h_ */
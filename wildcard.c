@@ -0,0 +1,510 @@
+/* Pathname expansion
+ *
+ * The pattern is split at '/' into components.  One without wildcards
+ * is just appended to the path being built; the others are compiled
+ * into a Segment (a string of Instrs, with [...] sets as 256-bit maps)
+ * and matched against the entries of every directory reached so far.
+ * Matching walks the Instrs left to right and only ever backtracks to
+ * the last '*', so it is linear in the name for the patterns people
+ * write.
+ *
+ * Nothing recurses while a directory is being read: the entries of a
+ * middle component are collected first, so all reads share one
+ * getdents64() buffer.
+ **********************************************************************/
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#include "wildcard.h"
+
+typedef enum {
+    W_CHAR,             /* c */
+    W_ANY,              /* ? */
+    W_STAR,             /* * */
+    W_SET,              /* [...] */
+} Op;
+
+typedef struct {
+    Op op;
+    unsigned char c;
+    unsigned char* set; /* W_SET: 32 bytes, a bit per byte value */
+} Instr;
+
+typedef struct {
+    char* text;         /* no wildcards: the name, unescaped */
+    Instr* code;        /* otherwise its compiled form */
+    unsigned int n;
+    int globstar;       /* just ** */
+    int dot;            /* starts with a literal '.' */
+} Segment;
+
+/* what getdents64() fills the buffer with */
+typedef struct {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} Dirent;
+
+/* names collected from a directory, '\0' separated */
+typedef struct {
+    char* buf;
+    size_t len;
+    size_t size;
+} Names;
+
+static char* dbuf = NULL;       /* getdents64() buffer */
+
+static char* path = NULL;       /* the path being built */
+static size_t path_size = 0;
+
+static char* pool = NULL;       /* the matches, '\0' separated */
+static size_t pool_len = 0;
+static size_t pool_size = 0;
+static size_t* offs = NULL;     /* where each starts in pool */
+static char** matches = NULL;
+static unsigned int nmatches = 0;
+static unsigned int matches_size = 0;
+
+
+static void grow (char** buf, size_t* size, size_t need)
+{
+    if (need <= *size)
+        return;
+
+    *size = *size ? 2 * *size : 4096;
+    if (*size < need)
+        *size = need;
+    *buf = realloc (*buf, *size);
+}
+
+
+/*** compiling ********************************************************/
+
+static void set_add (unsigned char* set, unsigned char c)
+{
+    set[c >> 3] |= 1 << (c & 7);
+}
+
+
+static int set_has (const unsigned char* set, unsigned char c)
+{
+    return set[c >> 3] & (1 << (c & 7));
+}
+
+
+static int class_add (unsigned char* set, const char* name, size_t len)
+{
+    static const struct {
+        const char* name;
+        int (*fn) (int);
+    } classes[] = {
+        { "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank },
+        { "cntrl", iscntrl }, { "digit", isdigit }, { "graph", isgraph },
+        { "lower", islower }, { "print", isprint }, { "punct", ispunct },
+        { "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit },
+    };
+    unsigned int i, c;
+
+    for (i=0; i<sizeof(classes)/sizeof(*classes); i++) {
+        if (strlen (classes[i].name) != len || strncmp (classes[i].name, name, len))
+            continue;
+        for (c=1; c<256; c++)
+            if (classes[i].fn (c))
+                set_add (set, c);
+        return 0;
+    }
+
+    return -1;
+}
+
+
+/* The [...] at s (e marks the end of the component) into set.  Returns
+ * the byte after its ']', or NULL if it isn't one (no ']', a bad
+ * class), in which case the '[' is just a '['. */
+static const char* compile_set (unsigned char* set, const char* s, const char* e)
+{
+    const char *p = s + 1, *q;
+    unsigned int c, hi, i;
+    int negate = 0;
+
+    memset (set, 0, 32);
+
+    if (p < e && (*p == '!' || *p == '^')) {
+        negate = 1;
+        p++;
+    }
+
+    for (q=p; p < e && (*p != ']' || p == q); ) {
+        if (*p == '[' && p+1 < e && p[1] == ':') {
+            for (s=p+2; s+1 < e && (s[0] != ':' || s[1] != ']'); s++);
+            if (s+1 >= e || class_add (set, p+2, s - p - 2) == -1)
+                return NULL;
+            p = s + 2;
+            continue;
+        }
+
+        if (*p == '\\' && p+1 < e)
+            p++;
+        c = (unsigned char)*p++;
+
+        if (p+1 < e && *p == '-' && p[1] != ']') {
+            p++;
+            if (*p == '\\' && p+1 < e)
+                p++;
+            hi = (unsigned char)*p++;
+            for (i=c; i<=hi; i++)
+                set_add (set, i);
+        } else {
+            set_add (set, c);
+        }
+    }
+
+    if (p >= e)
+        return NULL;
+
+    if (negate)
+        for (i=0; i<32; i++)
+            set[i] = ~set[i];
+    set[0] &= ~1;       /* never the '\0' */
+
+    return p + 1;
+}
+
+
+/* the component [s, e) of the pattern */
+static void compile (Segment* g, const char* s, const char* e)
+{
+    Instr* in;
+    const char* next;
+    char* t;
+    int magic = 0;
+
+    memset (g, 0, sizeof(*g));
+    g->code = calloc (e - s, sizeof(*g->code));
+    g->globstar = e - s == 2 && s[0] == '*' && s[1] == '*';
+
+    while (s < e) {
+        in = &g->code[g->n];
+
+        if (*s == '*') {
+            if (!g->n || g->code[g->n-1].op != W_STAR)
+                g->n++;
+            in->op = W_STAR;
+            s++;
+            magic = 1;
+            continue;
+        }
+
+        if (*s == '?') {
+            in->op = W_ANY;
+            s++;
+            magic = 1;
+        }
+        else if (*s == '[') {
+            in->set = malloc (32);
+            if ((next = compile_set (in->set, s, e))) {
+                in->op = W_SET;
+                s = next;
+                magic = 1;
+            } else {
+                free (in->set);
+                in->set = NULL;
+                in->op = W_CHAR;
+                in->c = *s++;
+            }
+        }
+        else {
+            if (*s == '\\' && s+1 < e)
+                s++;
+            in->op = W_CHAR;
+            in->c = *s++;
+        }
+
+        g->n++;
+    }
+
+    g->dot = g->n && g->code[0].op == W_CHAR && g->code[0].c == '.';
+
+    if (!magic) {
+        g->text = t = malloc (g->n + 1);
+        for (in=g->code; in < g->code + g->n; in++)
+            *t++ = in->c;
+        *t = '\0';
+    }
+}
+
+
+static void segment_free (Segment* g)
+{
+    unsigned int i;
+
+    for (i=0; i<g->n; i++)
+        free (g->code[i].set);
+    free (g->code);
+    free (g->text);
+}
+
+
+/*** matching *********************************************************/
+
+static int match (const Segment* g, const char* s)
+{
+    const Instr *in = g->code, *end = g->code + g->n;
+    const Instr* star = NULL;
+    const char* star_s = NULL;
+
+    if (*s == '.' && !g->dot)
+        return 0;
+
+    while (*s || in < end) {
+        if (in < end) {
+            if (in->op == W_STAR) {
+                star = ++in;
+                star_s = s;
+                continue;
+            }
+            if (*s && (in->op == W_ANY ||
+                       (in->op == W_CHAR && in->c == (unsigned char)*s) ||
+                       (in->op == W_SET && set_has (in->set, *s)))) {
+                in++;
+                s++;
+                continue;
+            }
+        }
+
+        /* let the last '*' take one more character */
+        if (!star || !*star_s)
+            return 0;
+        in = star;
+        s = ++star_s;
+    }
+
+    return 1;
+}
+
+
+/*** walking **********************************************************/
+
+static void add (size_t len, const char* name, int slash)
+{
+    size_t n = strlen (name);
+
+    if (nmatches == matches_size) {
+        matches_size = matches_size ? 2*matches_size : 64;
+        offs = realloc (offs, matches_size * sizeof(*offs));
+    }
+
+    grow (&pool, &pool_size, pool_len + len + n + 2);
+    offs[nmatches++] = pool_len;
+    memcpy (pool + pool_len, path, len);
+    memcpy (pool + pool_len + len, name, n);
+    pool_len += len + n;
+    if (slash)
+        pool[pool_len++] = '/';
+    pool[pool_len++] = '\0';
+}
+
+
+static void names_add (Names* N, const char* name)
+{
+    size_t n = strlen (name) + 1;
+
+    grow (&N->buf, &N->size, N->len + n);
+    memcpy (N->buf + N->len, name, n);
+    N->len += n;
+}
+
+
+/* is entry d of directory fd one?  Symlinks are followed unless this
+ * is for a ** */
+static int is_dir (int fd, Dirent* d, int follow)
+{
+    struct stat st;
+
+    if (d->d_type == DT_DIR)
+        return 1;
+    if (d->d_type != DT_UNKNOWN && (d->d_type != DT_LNK || !follow))
+        return 0;
+
+    return fstatat (fd, d->d_name, &st, follow ? 0 : AT_SYMLINK_NOFOLLOW) == 0
+           && S_ISDIR (st.st_mode);
+}
+
+
+/* Reads the directory path[0, len) (the cwd if len is 0): the entries
+ * segment g matches are added as matches if last is set, and collected
+ * into dirs if they are directories otherwise.  For a ** every entry
+ * matches, and every directory is collected. */
+static void scan (size_t len, Segment* g, int last, int dirs_only, Names* dirs)
+{
+    Dirent* d;
+    long n, pos;
+    int fd, dir;
+
+    path[len] = '\0';
+    if ((fd = open (len ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return;
+
+    if (!dbuf)
+        dbuf = malloc (WILDCARD_BUF);
+
+    while ((n = syscall (SYS_getdents64, fd, dbuf, WILDCARD_BUF)) > 0) {
+        for (pos=0; pos < n; pos += d->d_reclen) {
+            d = (Dirent*)(dbuf + pos);
+
+            if (d->d_name[0] == '.' && (!d->d_name[1] ||
+                    (d->d_name[1] == '.' && !d->d_name[2])))
+                continue;
+
+            if (g->globstar ? d->d_name[0] == '.' : !match (g, d->d_name))
+                continue;
+
+            if (last && !dirs_only) {
+                add (len, d->d_name, 0);
+                if (!g->globstar)
+                    continue;
+            }
+
+            dir = is_dir (fd, d, !g->globstar);
+            if (dir && last && dirs_only)
+                add (len, d->d_name, 1);
+            if (dir && (!last || g->globstar))
+                names_add (dirs, d->d_name);
+        }
+    }
+
+    close (fd);
+}
+
+
+/* Matches segments g[i..n) below the directory path[0, len); again
+ * is set when a ** (g[i]) descends into one more directory */
+static void walk (Segment* g, unsigned int i, unsigned int n, int dirs_only,
+                  size_t len, int again)
+{
+    Names dirs = { NULL, 0, 0 };
+    struct stat st;
+    const char* name;
+    size_t k;
+    int last = i == n-1;
+
+    if (g[i].text) {
+        k = strlen (g[i].text);
+        grow (&path, &path_size, len + k + 2);
+        memcpy (path + len, g[i].text, k + 1);
+
+        if (!last) {
+            path[len + k] = '/';
+            walk (g, i+1, n, dirs_only, len + k + 1, 0);
+        }
+        else if (dirs_only ? stat (path, &st) == 0 && S_ISDIR (st.st_mode)
+                           : lstat (path, &st) == 0) {
+            add (len, g[i].text, dirs_only);
+        }
+        return;
+    }
+
+    /* a ** also matches no directory at all: in the middle it goes on
+     * with the next component, and at the end it matches the directory
+     * it starts from, as in bash: `sub/` then ** gives sub/ as well
+     * (and sub, without the '/', if a component before had wildcards) */
+    if (g[i].globstar && !last) {
+        walk (g, i+1, n, dirs_only, len, 0);
+    } else if (g[i].globstar && len && !again) {
+        for (k=0; k<i && g[k].text; k++);
+        add (k < i ? len-1 : len, "", 0);
+    }
+
+    scan (len, &g[i], last, dirs_only, &dirs);
+
+    for (name=dirs.buf; name < dirs.buf + dirs.len; name += k + 1) {
+        k = strlen (name);
+        grow (&path, &path_size, len + k + 2);
+        memcpy (path + len, name, k);
+        path[len + k] = '/';
+
+        if (g[i].globstar)
+            walk (g, i, n, dirs_only, len + k + 1, 1);
+        else
+            walk (g, i+1, n, dirs_only, len + k + 1, 0);
+    }
+
+    free (dirs.buf);
+}
+
+
+static int by_path (const void* a, const void* b)
+{
+    return strcmp (pool + *(const size_t*)a, pool + *(const size_t*)b);
+}
+
+
+/* Sets *m to the paths pattern matches, sorted, and returns how many
+ * there are (0: none, *m is left alone).  They stay valid until the
+ * next call. */
+unsigned int wildcard_expand (const char* pattern, char*** m)
+{
+    Segment* g;
+    const char *s, *e;
+    unsigned int i, n = 0;
+    size_t len = 0;
+    int dirs_only = 0;
+
+    nmatches = 0;
+    pool_len = 0;
+
+    g = malloc ((strlen (pattern) / 2 + 2) * sizeof(*g));
+    grow (&path, &path_size, strlen (pattern) + 2);
+
+    if (*pattern == '/')
+        path[len++] = '/';
+
+    for (s=pattern; *s; s=e) {
+        while (*s == '/')
+            s++;
+        if (!*s) {
+            dirs_only = 1;      /* a trailing '/' */
+            break;
+        }
+        for (e=s; *e && *e != '/'; e++)
+            if (*e == '\\' && e[1])
+                e++;
+        compile (&g[n++], s, e);
+    }
+
+    if (n)
+        walk (g, 0, n, dirs_only, len, 0);
+
+    for (i=0; i<n; i++)
+        segment_free (&g[i]);
+    free (g);
+
+    if (!nmatches)
+        return 0;
+
+    qsort (offs, nmatches, sizeof(*offs), by_path);
+
+    if (nmatches + 1 > matches_size) {
+        matches_size = nmatches + 1;
+        offs = realloc (offs, matches_size * sizeof(*offs));
+    }
+    matches = realloc (matches, matches_size * sizeof(*matches));
+    for (i=0; i<nmatches; i++)
+        matches[i] = pool + offs[i];
+    matches[nmatches] = NULL;
+
+    *m = matches;
+    return nmatches;
+}
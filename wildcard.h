@@ -0,0 +1,25 @@
+#ifndef _wildcard_h_
+#define _wildcard_h_
+
+/* Pathname expansion
+ *
+ * Expands a pattern such as `*.[ch]` or `lib/?ain.c` into the sorted
+ * list of existing paths it matches.  *, ? and [...] (with ! or ^ to
+ * negate, ranges and [:classes:]) work within one path component, and
+ * a component that is just ** matches any number of directories, none
+ * included (without following symlinks).  A character preceded by a \ is
+ * literal, which is how the lexer passes quoted ones on.  Names that
+ * start with a . are only matched by a component that starts with a
+ * literal one, and . and .. never are.
+ *
+ * Each component is compiled once per expansion, before any directory
+ * is read, and directories are read with getdents64() into a large
+ * buffer whose d_type saves a stat() per entry.  The matches are
+ * collected in one string pool and sorted once, so a directory with a
+ * million entries costs a read of it and an n log n sort. */
+
+#define WILDCARD_BUF (256 * 1024)   /* bytes per getdents64() call */
+
+unsigned int wildcard_expand (const char* pattern, char*** matches);
+
+#endif /* _wildcard_h_ */